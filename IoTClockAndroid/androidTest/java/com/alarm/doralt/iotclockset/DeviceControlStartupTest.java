@@ -0,0 +1,130 @@
+package com.alarm.doralt.iotclockset;
+
+import static org.junit.Assert.assertTrue;
+
+import android.app.Activity;
+import android.app.Application;
+import android.app.Instrumentation;
+import android.content.Intent;
+import android.os.Bundle;
+import android.os.SystemClock;
+import android.support.test.InstrumentationRegistry;
+import android.support.test.runner.AndroidJUnit4;
+import android.util.Log;
+import android.view.View;
+import android.view.ViewTreeObserver;
+
+import java.util.Arrays;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.TimeUnit;
+
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+/**
+ * Measures how long {@link DeviceControlActivity} takes from the launch intent to its first
+ * frame, over several cold activity starts in a warm process. The median and maximum are
+ * reported as instrumentation status ("startup_median_ms", "startup_max_ms") and logged, so
+ * layout changes can be compared before and after:
+ *
+ * <pre>adb shell am instrument -w -e class com.alarm.doralt.iotclockset.DeviceControlStartupTest \
+ *     com.alarm.doralt.iotclockset.test/android.support.test.runner.AndroidJUnitRunner</pre>
+ */
+@RunWith(AndroidJUnit4.class)
+public class DeviceControlStartupTest {
+    private static final String TAG = DeviceControlStartupTest.class.getSimpleName();
+
+    private static final int RUNS = 10;
+    private static final long FIRST_FRAME_TIMEOUT_MS = 5000;
+    // No clock answers at this address; the activity only tries to connect
+    private static final String ADDRESS = "00:00:00:00:00:00";
+
+    @Test
+    public void timeToFirstFrame() throws InterruptedException {
+        final Instrumentation instrumentation = InstrumentationRegistry.getInstrumentation();
+        final Application application =
+                (Application) instrumentation.getTargetContext().getApplicationContext();
+        final long[] times = new long[RUNS];
+
+        for (int i = 0; i < RUNS; i++) {
+            final FirstFrameTimer timer = new FirstFrameTimer();
+            final Intent intent = new Intent(instrumentation.getTargetContext(),
+                    DeviceControlActivity.class)
+                    .putExtra(DeviceControlActivity.EXTRAS_DEVICE_NAME, TAG)
+                    .putExtra(DeviceControlActivity.EXTRAS_DEVICE_ADDRESS, ADDRESS)
+                    .addFlags(Intent.FLAG_ACTIVITY_NEW_TASK);
+
+            application.registerActivityLifecycleCallbacks(timer);
+            timer.mLaunchTime = SystemClock.uptimeMillis();
+            final Activity activity = instrumentation.startActivitySync(intent);
+            try {
+                assertTrue("No frame drawn",
+                        timer.mDrawn.await(FIRST_FRAME_TIMEOUT_MS, TimeUnit.MILLISECONDS));
+            } finally {
+                application.unregisterActivityLifecycleCallbacks(timer);
+                activity.finish();
+                instrumentation.waitForIdleSync();
+            }
+            times[i] = timer.mFirstFrameTime - timer.mLaunchTime;
+        }
+
+        Arrays.sort(times);
+        final Bundle results = new Bundle();
+        results.putLong("startup_median_ms", times[RUNS / 2]);
+        results.putLong("startup_max_ms", times[RUNS - 1]);
+        instrumentation.sendStatus(0, results);
+        Log.i(TAG, "First frame after " + Arrays.toString(times) + " ms");
+    }
+
+    /**
+     * Notes the first frame of the activity created after it is registered. The listener is
+     * attached right after onCreate, before anything has been drawn.
+     */
+    private static class FirstFrameTimer implements Application.ActivityLifecycleCallbacks {
+        final CountDownLatch mDrawn = new CountDownLatch(1);
+        volatile long mLaunchTime;
+        volatile long mFirstFrameTime;
+
+        @Override
+        public void onActivityCreated(Activity activity, Bundle savedInstanceState) {
+            if (!(activity instanceof DeviceControlActivity)) {
+                return;
+            }
+            final View decorView = activity.getWindow().getDecorView();
+            decorView.getViewTreeObserver().addOnPreDrawListener(
+                    new ViewTreeObserver.OnPreDrawListener() {
+                @Override
+                public boolean onPreDraw() {
+                    decorView.getViewTreeObserver().removeOnPreDrawListener(this);
+                    mFirstFrameTime = SystemClock.uptimeMillis();
+                    mDrawn.countDown();
+                    return true;
+                }
+            });
+        }
+
+        @Override
+        public void onActivityStarted(Activity activity) {
+        }
+
+        @Override
+        public void onActivityResumed(Activity activity) {
+        }
+
+        @Override
+        public void onActivityPaused(Activity activity) {
+        }
+
+        @Override
+        public void onActivityStopped(Activity activity) {
+        }
+
+        @Override
+        public void onActivitySaveInstanceState(Activity activity, Bundle outState) {
+        }
+
+        @Override
+        public void onActivityDestroyed(Activity activity) {
+        }
+    }
+}
@@ -19,41 +19,53 @@ package com.alarm.doralt.iotclockset;
 import android.app.Service;
 import android.bluetooth.BluetoothAdapter;
 import android.bluetooth.BluetoothDevice;
-import android.bluetooth.BluetoothGatt;
-import android.bluetooth.BluetoothGattCallback;
-import android.bluetooth.BluetoothGattCharacteristic;
-import android.bluetooth.BluetoothGattDescriptor;
 import android.bluetooth.BluetoothGattService;
 import android.bluetooth.BluetoothManager;
-import android.bluetooth.BluetoothProfile;
 import android.content.Context;
 import android.content.Intent;
 import android.os.Binder;
+import android.os.Handler;
 import android.os.IBinder;
 import android.util.Log;
 
-import java.text.DateFormat;
-import java.text.SimpleDateFormat;
-import java.util.Date;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
 import java.util.List;
-import java.util.UUID;
+import java.util.Map;
 
 /**
  * Service for managing connection and data communication with a GATT server hosted on a
  * given Bluetooth LE device.
+ *
+ * Connections outlive the activities that use them: each clock keeps its
+ * {@code ClockConnection}, with the discovered services, so sending to the same clock again
+ * needs neither connection setup nor discovery. The service is started as well as bound, and
+ * closes everything once no activity has been bound for {@link #IDLE_TIMEOUT_MS}.
+ *
+ * Started with {@link #ACTION_SYNC_FLEET}, it sets the time of a list of clocks, several at a
+ * time, reporting through {@link #ACTION_FLEET_PROGRESS} and {@link #ACTION_FLEET_FINISHED}.
  */
 public class BluetoothLeService extends Service {
     private final static String TAG = BluetoothLeService.class.getSimpleName();
 
+    // Clocks whose connections are kept; the least recently used one is closed beyond that.
+    // Android allows 7 links at once.
+    private static final int MAX_CONNECTIONS = 7;
+    // Clocks synced at the same time, leaving a link for the clock being set up
+    private static final int FLEET_CONCURRENCY = MAX_CONNECTIONS - 1;
+    // Time the connections are kept without any bound activity
+    private static final long IDLE_TIMEOUT_MS = 60000;
+
     private BluetoothManager mBluetoothManager;
     private BluetoothAdapter mBluetoothAdapter;
     private String mBluetoothDeviceAddress;
-    private BluetoothGatt mBluetoothGatt;
-    private int mConnectionState = STATE_DISCONNECTED;
-
-    private static final int STATE_DISCONNECTED = 0;
-    private static final int STATE_CONNECTING = 1;
-    private static final int STATE_CONNECTED = 2;
+    private final Handler mHandler = new Handler();
+    private boolean mBound;
+    private volatile FleetSync mFleet;
+    // Connections by device address, least recently used first
+    private final LinkedHashMap<String, ClockConnection> mConnections =
+            new LinkedHashMap<String, ClockConnection>(MAX_CONNECTIONS + 1, 0.75f, true);
 
     public final static String ACTION_GATT_CONNECTED =
             "com.example.bluetooth.le.ACTION_GATT_CONNECTED";
@@ -65,53 +77,133 @@ public class BluetoothLeService extends Service {
             "com.example.bluetooth.le.ACTION_DATA_AVAILABLE";
     public final static String EXTRA_DATA =
             "com.example.bluetooth.le.EXTRA_DATA";
+    // Address of the clock an action is about
+    public final static String EXTRA_ADDRESS =
+            "com.example.bluetooth.le.EXTRA_ADDRESS";
+
+    // Start command syncing the time of the clocks in EXTRA_ADDRESSES
+    public final static String ACTION_SYNC_FLEET =
+            "com.alarm.doralt.iotclockset.ACTION_SYNC_FLEET";
+    public final static String EXTRA_ADDRESSES =
+            "com.alarm.doralt.iotclockset.EXTRA_ADDRESSES";
+    // A clock of the fleet changed to EXTRA_FLEET_STATE, one of the FleetSync states
+    public final static String ACTION_FLEET_PROGRESS =
+            "com.alarm.doralt.iotclockset.ACTION_FLEET_PROGRESS";
+    public final static String EXTRA_FLEET_STATE =
+            "com.alarm.doralt.iotclockset.EXTRA_FLEET_STATE";
+    // The fleet sync ended, with EXTRA_FLEET_SYNCED, EXTRA_FLEET_FAILED and
+    // EXTRA_FLEET_ELAPSED_MS
+    public final static String ACTION_FLEET_FINISHED =
+            "com.alarm.doralt.iotclockset.ACTION_FLEET_FINISHED";
+    public final static String EXTRA_FLEET_SYNCED =
+            "com.alarm.doralt.iotclockset.EXTRA_FLEET_SYNCED";
+    public final static String EXTRA_FLEET_FAILED =
+            "com.alarm.doralt.iotclockset.EXTRA_FLEET_FAILED";
+    public final static String EXTRA_FLEET_ELAPSED_MS =
+            "com.alarm.doralt.iotclockset.EXTRA_FLEET_ELAPSED_MS";
+
+    // Implements callback methods for connection events that the app cares about.  For
+    // example, connection change and services discovered.
+    private final ClockConnection.Listener mConnectionListener = new ClockConnection.Listener() {
+        @Override
+        public void onConnectionStateChanged(ClockConnection connection, int state) {
+            if (state == ClockConnection.STATE_CONNECTED) {
+                broadcastUpdate(ACTION_GATT_CONNECTED, connection);
+            } else if (state == ClockConnection.STATE_DISCONNECTED) {
+                broadcastUpdate(ACTION_GATT_DISCONNECTED, connection);
+            }
+            final FleetSync fleet = mFleet;
+            if (fleet != null) {
+                fleet.onConnectionStateChanged(connection, state);
+            }
+        }
 
+        @Override
+        public void onReady(ClockConnection connection) {
+            broadcastUpdate(ACTION_GATT_SERVICES_DISCOVERED, connection);
+            final FleetSync fleet = mFleet;
+            if (fleet != null) {
+                fleet.onReady(connection);
+            }
+        }
 
-    // Implements callback methods for GATT events that the app cares about.  For example,
-    // connection change and services discovered.
-    private final BluetoothGattCallback mGattCallback = new BluetoothGattCallback() {
         @Override
-        public void onConnectionStateChange(BluetoothGatt gatt, int status, int newState) {
-            String intentAction;
-            if (newState == BluetoothProfile.STATE_CONNECTED) {
-                intentAction = ACTION_GATT_CONNECTED;
-                mConnectionState = STATE_CONNECTED;
-                broadcastUpdate(intentAction);
-                Log.i(TAG, "Connected to GATT server.");
-                // Attempts to discover services after successful connection.
-                Log.i(TAG, "Attempting to start service discovery:" +
-                        mBluetoothGatt.discoverServices());
-
-            } else if (newState == BluetoothProfile.STATE_DISCONNECTED) {
-                intentAction = ACTION_GATT_DISCONNECTED;
-                mConnectionState = STATE_DISCONNECTED;
-                Log.i(TAG, "Disconnected from GATT server.");
-                broadcastUpdate(intentAction);
+        public void onOperationComplete(ClockConnection connection,
+                                        GattOperationQueue.Operation operation) {
+            final FleetSync fleet = mFleet;
+            if (fleet != null) {
+                fleet.onOperationComplete(connection, operation);
             }
         }
 
         @Override
-        public void onServicesDiscovered(BluetoothGatt gatt, int status) {
-            if (status == BluetoothGatt.GATT_SUCCESS) {
-                broadcastUpdate(ACTION_GATT_SERVICES_DISCOVERED);
-            } else {
-                Log.w(TAG, "onServicesDiscovered received: " + status);
+        public void onOperationFailed(ClockConnection connection,
+                                      GattOperationQueue.Operation operation, int status) {
+            final FleetSync fleet = mFleet;
+            if (fleet != null) {
+                fleet.onOperationFailed(connection, operation);
+            }
+        }
+    };
+
+    private final FleetSync.Host mFleetHost = new FleetSync.Host() {
+        @Override
+        public ClockConnection open(String address) {
+            return openConnection(address);
+        }
+
+        @Override
+        public void release(ClockConnection connection) {
+            // The clock being set up keeps its link
+            if (!connection.getAddress().equals(mBluetoothDeviceAddress)) {
+                connection.disconnect();
             }
         }
 
+        @Override
+        public void onProgress(FleetSync fleet, String address, int state) {
+            final Intent intent = new Intent(ACTION_FLEET_PROGRESS);
+            intent.putExtra(EXTRA_ADDRESS, address);
+            intent.putExtra(EXTRA_FLEET_STATE, state);
+            sendBroadcast(intent);
+        }
+
+        @Override
+        public void onFinished(FleetSync fleet, int synced, int failed, long elapsedMs) {
+            final Intent intent = new Intent(ACTION_FLEET_FINISHED);
+            intent.putExtra(EXTRA_FLEET_SYNCED, synced);
+            intent.putExtra(EXTRA_FLEET_FAILED, failed);
+            intent.putExtra(EXTRA_FLEET_ELAPSED_MS, elapsedMs);
+            sendBroadcast(intent);
+
+            mFleet = null;
+            mHandler.post(new Runnable() {
+                @Override
+                public void run() {
+                    if (!mBound) {
+                        mHandler.postDelayed(mIdleShutdown, IDLE_TIMEOUT_MS);
+                    }
+                }
+            });
+        }
+    };
 
+    private final Runnable mIdleShutdown = new Runnable() {
         @Override
-        public void onCharacteristicWrite(BluetoothGatt gatt,
-                                          BluetoothGattCharacteristic characteristic,
-                                          int status) {
-            if (status != BluetoothGatt.GATT_SUCCESS) {
-                Log.e(TAG, "Write failed");
+        public void run() {
+            if (mFleet != null) {
+                // Posted again when the fleet sync finishes
+                return;
             }
+            Log.i(TAG, "Idle, closing connections.");
+            closeAll();
+            stopSelf();
         }
     };
 
-    private void broadcastUpdate(final String action) {
+    private void broadcastUpdate(final String action, ClockConnection connection) {
         final Intent intent = new Intent(action);
+        intent.putExtra(EXTRA_ADDRESS, connection.getAddress());
         sendBroadcast(intent);
     }
 
@@ -125,16 +217,49 @@ public class BluetoothLeService extends Service {
 
     @Override
     public IBinder onBind(Intent intent) {
+        mBound = true;
+        mHandler.removeCallbacks(mIdleShutdown);
         return mBinder;
     }
 
+    @Override
+    public void onRebind(Intent intent) {
+        mBound = true;
+        mHandler.removeCallbacks(mIdleShutdown);
+    }
+
     @Override
     public boolean onUnbind(Intent intent) {
-        // After using a given device, you should make sure that BluetoothGatt.close() is called
-        // such that resources are cleaned up properly.  In this particular example, close() is
-        // invoked when the UI is disconnected from the Service.
-        close();
-        return super.onUnbind(intent);
+        mBound = false;
+        // The connections are kept for the next activity; they are closed if none binds
+        // within IDLE_TIMEOUT_MS.
+        mHandler.postDelayed(mIdleShutdown, IDLE_TIMEOUT_MS);
+        return true;
+    }
+
+    @Override
+    public int onStartCommand(Intent intent, int flags, int startId) {
+        if (intent != null && ACTION_SYNC_FLEET.equals(intent.getAction())) {
+            final ArrayList<String> addresses = intent.getStringArrayListExtra(EXTRA_ADDRESSES);
+            if (!initialize() || addresses == null || !syncFleet(addresses)) {
+                Log.w(TAG, "Fleet sync not started");
+                if (!mBound && mFleet == null) {
+                    mHandler.postDelayed(mIdleShutdown, IDLE_TIMEOUT_MS);
+                }
+            }
+        }
+        return START_NOT_STICKY;
+    }
+
+    @Override
+    public void onDestroy() {
+        mHandler.removeCallbacks(mIdleShutdown);
+        final FleetSync fleet = mFleet;
+        if (fleet != null) {
+            fleet.cancel();
+        }
+        closeAll();
+        super.onDestroy();
     }
 
     private final IBinder mBinder = new LocalBinder();
@@ -170,9 +295,9 @@ public class BluetoothLeService extends Service {
      * @param address The device address of the destination device.
      *
      * @return Return true if the connection is initiated successfully. The connection result
-     *         is reported asynchronously through the
-     *         {@code BluetoothGattCallback#onConnectionStateChange(android.bluetooth.BluetoothGatt, int, int)}
-     *         callback.
+     *         is reported asynchronously through {@link #ACTION_GATT_CONNECTED} and, once the
+     *         clock can be written, {@link #ACTION_GATT_SERVICES_DISCOVERED}. Both are sent
+     *         again at once if the clock is already connected.
      */
     public boolean connect(final String address) {
         if (mBluetoothAdapter == null || address == null) {
@@ -180,44 +305,75 @@ public class BluetoothLeService extends Service {
             return false;
         }
 
-        // Previously connected device.  Try to reconnect.
-        if (mBluetoothDeviceAddress != null && address.equals(mBluetoothDeviceAddress)
-                && mBluetoothGatt != null) {
-            Log.d(TAG, "Trying to use an existing mBluetoothGatt for connection.");
-            if (mBluetoothGatt.connect()) {
-                mConnectionState = STATE_CONNECTING;
-                return true;
-            } else {
-                return false;
+        mBluetoothDeviceAddress = address;
+
+        final ClockConnection connection;
+        synchronized (mConnections) {
+            connection = mConnections.get(address);
+        }
+        if (connection != null && connection.getState() == ClockConnection.STATE_CONNECTED) {
+            Log.d(TAG, "Reusing the connection to " + address);
+            broadcastUpdate(ACTION_GATT_CONNECTED, connection);
+            if (connection.isReady()) {
+                broadcastUpdate(ACTION_GATT_SERVICES_DISCOVERED, connection);
             }
+            return true;
         }
+        return openConnection(address) != null;
+    }
 
-        final BluetoothDevice device = mBluetoothAdapter.getRemoteDevice(address);
-        if (device == null) {
-            Log.w(TAG, "Device not found.  Unable to connect.");
+    /**
+     * Sets the time of several clocks, {@link #FLEET_CONCURRENCY} at a time. Progress is
+     * reported through {@link #ACTION_FLEET_PROGRESS} and the end through
+     * {@link #ACTION_FLEET_FINISHED}.
+     *
+     * @return Return false if Bluetooth is not initialized or a fleet sync is running.
+     */
+    public boolean syncFleet(List<String> addresses) {
+        if (mBluetoothAdapter == null || mFleet != null) {
             return false;
         }
-        // We want to directly connect to the device, so we are setting the autoConnect
-        // parameter to false.
-        mBluetoothGatt = device.connectGatt(this, false, mGattCallback);
-        Log.d(TAG, "Trying to create a new connection.");
-        mBluetoothDeviceAddress = address;
-        mConnectionState = STATE_CONNECTING;
+        final FleetSync fleet = new FleetSync(mFleetHost, addresses, FLEET_CONCURRENCY);
+        mFleet = fleet;
+        mHandler.removeCallbacks(mIdleShutdown);
+        fleet.start();
         return true;
     }
 
+    /**
+     * Returns the connection to a clock, creating it if needed, and starts connecting it.
+     *
+     * @return Return null if the connection could not be initiated.
+     */
+    private ClockConnection openConnection(String address) {
+        ClockConnection connection;
+        synchronized (mConnections) {
+            connection = mConnections.get(address);
+        }
+        if (connection == null) {
+            final BluetoothDevice device = mBluetoothAdapter.getRemoteDevice(address);
+            if (device == null) {
+                Log.w(TAG, "Device not found.  Unable to connect.");
+                return null;
+            }
+            connection = new ClockConnection(this, device, mConnectionListener);
+            addConnection(connection);
+        }
+        return connection.connect() ? connection : null;
+    }
+
     /**
      * Disconnects an existing connection or cancel a pending connection. The disconnection result
-     * is reported asynchronously through the
-     * {@code BluetoothGattCallback#onConnectionStateChange(android.bluetooth.BluetoothGatt, int, int)}
-     * callback.
+     * is reported asynchronously through {@link #ACTION_GATT_DISCONNECTED}. The connection is
+     * kept for a later {@link #connect(String)}.
      */
     public void disconnect() {
-        if (mBluetoothAdapter == null || mBluetoothGatt == null) {
+        final ClockConnection connection = getConnection();
+        if (mBluetoothAdapter == null || connection == null) {
             Log.w(TAG, "BluetoothAdapter not initialized");
             return;
         }
-        mBluetoothGatt.disconnect();
+        connection.disconnect();
     }
 
     /**
@@ -225,14 +381,52 @@ public class BluetoothLeService extends Service {
      * released properly.
      */
     public void close() {
-        if (mBluetoothGatt == null) {
-            return;
+        final ClockConnection connection;
+        synchronized (mConnections) {
+            connection = mConnections.remove(mBluetoothDeviceAddress);
+        }
+        if (connection != null) {
+            connection.close();
         }
-        mBluetoothGatt.close();
-        mBluetoothGatt = null;
     }
 
+    private void closeAll() {
+        synchronized (mConnections) {
+            for (ClockConnection connection : mConnections.values()) {
+                connection.close();
+            }
+            mConnections.clear();
+        }
+    }
+
+    private void addConnection(ClockConnection connection) {
+        synchronized (mConnections) {
+            mConnections.put(connection.getAddress(), connection);
+
+            // Closes the least recently used connections beyond MAX_CONNECTIONS, except those
+            // a fleet sync is using
+            final FleetSync fleet = mFleet;
+            final Iterator<Map.Entry<String, ClockConnection>> it =
+                    mConnections.entrySet().iterator();
+            while (mConnections.size() > MAX_CONNECTIONS && it.hasNext()) {
+                final ClockConnection eldest = it.next().getValue();
+                if (eldest != connection
+                        && (fleet == null || !fleet.isActive(eldest.getAddress()))) {
+                    eldest.close();
+                    it.remove();
+                }
+            }
+        }
+    }
 
+    /**
+     * Returns the connection to the clock of the last {@link #connect(String)}.
+     */
+    private ClockConnection getConnection() {
+        synchronized (mConnections) {
+            return mConnections.get(mBluetoothDeviceAddress);
+        }
+    }
 
     /**
      * Retrieves a list of supported GATT services on the connected device. This should be
@@ -241,17 +435,95 @@ public class BluetoothLeService extends Service {
      * @return A {@code List} of supported services.
      */
     public List<BluetoothGattService> getSupportedGattServices() {
-        if (mBluetoothGatt == null) return null;
+        final ClockConnection connection = getConnection();
+        if (connection == null) return null;
 
-        return mBluetoothGatt.getServices();
+        return connection.getServices();
     }
-    public void writeCharacteristic(BluetoothGattCharacteristic characteristic,
-                                    ClockPage cl) {
-        if (mBluetoothGatt == null || characteristic == null) {
-            Log.w(TAG, "BluetoothAdapter not initialized");
-            return;
+
+    /**
+     * Returns true when the clock is connected and its characteristic resolved.
+     */
+    public boolean isReady() {
+        final ClockConnection connection = getConnection();
+        return connection != null && connection.isReady();
+    }
+
+    /**
+     * Returns the ATT MTU negotiated on the current connection, {@link ClockConnection#DEFAULT_MTU}
+     * until the negotiation has completed.
+     */
+    public int getMtu() {
+        final ClockConnection connection = getConnection();
+        return connection != null ? connection.getMtu() : ClockConnection.DEFAULT_MTU;
+    }
+
+    /**
+     * Returns the largest value that fits in a single characteristic write.
+     */
+    public int getMaxWritePayload() {
+        return getMtu() - 3;
+    }
+
+    /**
+     * Asks for the shortest connection interval for a transfer, such as provisioning. The
+     * request is queued, so it takes effect before the writes queued after it.
+     */
+    public void beginFastTransfer() {
+        final ClockConnection connection = getConnection();
+        if (connection != null) {
+            connection.beginFastTransfer();
+        }
+    }
+
+    /**
+     * Drops back to the balanced connection interval once the writes queued before this call
+     * have completed.
+     */
+    public void endFastTransfer() {
+        final ClockConnection connection = getConnection();
+        if (connection != null) {
+            connection.endFastTransfer();
         }
-        // cl when send is hit will send the data
-        cl.onActivityResult(mBluetoothGatt, characteristic);
+    }
+
+    /**
+     * Queues the time and alarms set by a {@code ClockPage} for writing to the clock. Returns
+     * at once; the writes run one after the other on the connection's operation queue thread.
+     * The time is written alone, through the Current Time Service, unless the user chose a
+     * one-shot alarm to go with it.
+     *
+     * @return Return false if the clock is not ready.
+     */
+    public boolean sendTime(ClockPage cl) {
+        final ClockConnection connection = getConnection();
+        if (connection == null || !connection.isReady()) {
+            Log.w(TAG, "Clock not ready");
+            return false;
+        }
+        final GattClockTransport transport = new GattClockTransport(
+                connection.getOperationQueue(), connection.getClockCharacteristic(),
+                connection.getMtu(), false);
+        connection.beginFastTransfer();
+        if (cl.hasOneShotAlarm()) {
+            // The text protocol sets the time together with alarm slot 0
+            cl.sendTime(transport);
+        } else if (connection.getCurrentTimeCharacteristic() != null) {
+            cl.sendCurrentTime(new GattClockTransport(connection.getOperationQueue(),
+                    connection.getCurrentTimeCharacteristic(), connection.getMtu(), true));
+        } else {
+            // The text protocol would overwrite alarm slot 0 with a time nobody picked
+            Log.w(TAG, "Clock has no Current Time Service, time not set");
+        }
+        if (!cl.getAlarms().isEmpty()) {
+            if (connection.getMailboxCharacteristic() != null) {
+                cl.sendAlarms(new GattClockTransport(connection.getOperationQueue(),
+                        connection.getMailboxCharacteristic(), connection.getMtu(), false));
+            } else {
+                Log.w(TAG, "Clock has no mailbox, alarms not sent");
+            }
+        }
+        connection.endFastTransfer();
+        return true;
     }
 }
@@ -0,0 +1,303 @@
+package com.alarm.doralt.iotclockset;
+
+import android.bluetooth.BluetoothDevice;
+import android.bluetooth.BluetoothGatt;
+import android.bluetooth.BluetoothGattCallback;
+import android.bluetooth.BluetoothGattCharacteristic;
+import android.bluetooth.BluetoothGattService;
+import android.bluetooth.BluetoothProfile;
+import android.content.Context;
+import android.util.Log;
+
+import java.util.Collections;
+import java.util.List;
+import java.util.UUID;
+
+/**
+ * The GATT connection to one clock. The BluetoothGatt is kept open across disconnections, so
+ * a reconnection reuses it together with the services already discovered and the resolved
+ * clock characteristic. Services are only discovered again when the device reports that they
+ * changed. All GATT requests go through the connection's {@link GattOperationQueue}.
+ */
+public class ClockConnection {
+    private final static String TAG = ClockConnection.class.getSimpleName();
+
+    public static final int STATE_DISCONNECTED = 0;
+    public static final int STATE_CONNECTING = 1;
+    public static final int STATE_CONNECTED = 2;
+
+    // ATT MTU before negotiation, and the largest one asked for
+    public static final int DEFAULT_MTU = 23;
+    private static final int MAX_MTU = 517;
+
+    /**
+     * Connection events, called on a Binder thread.
+     */
+    public interface Listener {
+        void onConnectionStateChanged(ClockConnection connection, int state);
+
+        /** The clock characteristic is resolved and writes can be queued. */
+        void onReady(ClockConnection connection);
+
+        void onOperationComplete(ClockConnection connection,
+                                 GattOperationQueue.Operation operation);
+
+        void onOperationFailed(ClockConnection connection,
+                               GattOperationQueue.Operation operation, int status);
+    }
+
+    private final Context mContext;
+    private final BluetoothDevice mDevice;
+    private final Listener mListener;
+    private final GattOperationQueue mOperationQueue;
+    private BluetoothGatt mGatt;
+    private volatile int mState = STATE_DISCONNECTED;
+    private volatile int mMtu = DEFAULT_MTU;
+    private volatile BluetoothGattCharacteristic mClockCharacteristic;
+    private volatile BluetoothGattCharacteristic mCurrentTimeCharacteristic;
+    private volatile BluetoothGattCharacteristic mMailboxCharacteristic;
+
+    private final BluetoothGattCallback mGattCallback = new BluetoothGattCallback() {
+        @Override
+        public void onConnectionStateChange(BluetoothGatt gatt, int status, int newState) {
+            if (newState == BluetoothProfile.STATE_CONNECTED) {
+                mState = STATE_CONNECTED;
+                mMtu = DEFAULT_MTU;
+                Log.i(TAG, "Connected to " + getAddress());
+                mOperationQueue.setGatt(gatt);
+                mListener.onConnectionStateChanged(ClockConnection.this, mState);
+
+                // The MTU is negotiated again on every connection; the services are not.
+                mOperationQueue.enqueue(new GattOperationQueue.RequestMtu(MAX_MTU));
+                if (mClockCharacteristic == null) {
+                    mOperationQueue.enqueue(new GattOperationQueue.DiscoverServices());
+                } else {
+                    mListener.onReady(ClockConnection.this);
+                }
+            } else if (newState == BluetoothProfile.STATE_DISCONNECTED) {
+                mState = STATE_DISCONNECTED;
+                Log.i(TAG, "Disconnected from " + getAddress());
+                mOperationQueue.setGatt(null);
+                mListener.onConnectionStateChanged(ClockConnection.this, mState);
+            }
+        }
+
+        @Override
+        public void onServicesDiscovered(BluetoothGatt gatt, int status) {
+            if (status == BluetoothGatt.GATT_SUCCESS) {
+                mClockCharacteristic = findCharacteristic(gatt.getServices(),
+                        Constants.BOARD_SERVICES, Constants.BOARD_WR);
+                // Missing from firmware built without the Current Time Service
+                mCurrentTimeCharacteristic = findCharacteristic(gatt.getServices(),
+                        Constants.CURRENT_TIME_SERVICE, Constants.CURRENT_TIME);
+                mMailboxCharacteristic = findCharacteristic(gatt.getServices(),
+                        Constants.MAILBOX_SERVICE, Constants.MAILBOX_REQUEST);
+            } else {
+                Log.w(TAG, "onServicesDiscovered received: " + status);
+            }
+            mOperationQueue.onComplete(GattOperationQueue.DiscoverServices.class, null, status);
+            if (mClockCharacteristic != null) {
+                mListener.onReady(ClockConnection.this);
+            }
+        }
+
+        @Override
+        public void onMtuChanged(BluetoothGatt gatt, int mtu, int status) {
+            if (status == BluetoothGatt.GATT_SUCCESS) {
+                mMtu = mtu;
+                Log.i(TAG, "MTU " + mtu);
+            } else {
+                Log.w(TAG, "onMtuChanged received: " + status);
+            }
+            mOperationQueue.onComplete(GattOperationQueue.RequestMtu.class, null, status);
+        }
+
+        @Override
+        public void onCharacteristicWrite(BluetoothGatt gatt,
+                                          BluetoothGattCharacteristic characteristic,
+                                          int status) {
+            // Starts the next queued operation
+            mOperationQueue.onComplete(GattOperationQueue.WriteCharacteristic.class,
+                    characteristic, status);
+        }
+
+        // Service Changed indication, delivered from API 31. Declared without @Override so the
+        // class also builds against older SDKs.
+        public void onServiceChanged(BluetoothGatt gatt) {
+            Log.i(TAG, "Services changed on " + getAddress());
+            mClockCharacteristic = null;
+            mCurrentTimeCharacteristic = null;
+            mMailboxCharacteristic = null;
+            mOperationQueue.enqueue(new GattOperationQueue.DiscoverServices());
+        }
+    };
+
+    private final GattOperationQueue.Listener mQueueListener = new GattOperationQueue.Listener() {
+        @Override
+        public void onOperationComplete(GattOperationQueue.Operation operation) {
+            mListener.onOperationComplete(ClockConnection.this, operation);
+        }
+
+        @Override
+        public void onOperationFailed(GattOperationQueue.Operation operation, int status) {
+            Log.e(TAG, getAddress() + " failed: " + operation + ", status " + status);
+            mListener.onOperationFailed(ClockConnection.this, operation, status);
+        }
+
+        @Override
+        public void onIdle() {
+        }
+    };
+
+    public ClockConnection(Context context, BluetoothDevice device, Listener listener) {
+        mContext = context;
+        mDevice = device;
+        mListener = listener;
+        mOperationQueue = new GattOperationQueue(mQueueListener);
+    }
+
+    public String getAddress() {
+        return mDevice.getAddress();
+    }
+
+    public int getState() {
+        return mState;
+    }
+
+    /**
+     * Returns true when connected and the clock characteristic is resolved.
+     */
+    public boolean isReady() {
+        return mState == STATE_CONNECTED && mClockCharacteristic != null;
+    }
+
+    /**
+     * Connects, reusing the BluetoothGatt of an earlier connection if there is one. The result
+     * is reported through {@link Listener#onConnectionStateChanged}.
+     *
+     * @return Return true if the connection is initiated successfully.
+     */
+    public synchronized boolean connect() {
+        if (mState != STATE_DISCONNECTED) {
+            return true;
+        }
+        if (mGatt == null) {
+            // We want to directly connect to the device, so we are setting the autoConnect
+            // parameter to false.
+            mGatt = mDevice.connectGatt(mContext, false, mGattCallback);
+            if (mGatt == null) {
+                return false;
+            }
+            Log.d(TAG, "Trying to create a new connection.");
+        } else {
+            Log.d(TAG, "Trying to use an existing BluetoothGatt for connection.");
+            if (!mGatt.connect()) {
+                return false;
+            }
+        }
+        mState = STATE_CONNECTING;
+        return true;
+    }
+
+    /**
+     * Disconnects, keeping the BluetoothGatt for a later {@link #connect()}.
+     */
+    public synchronized void disconnect() {
+        if (mGatt != null) {
+            mGatt.disconnect();
+        }
+    }
+
+    /**
+     * Releases the BluetoothGatt and the operation queue. The connection cannot be used again.
+     */
+    public synchronized void close() {
+        mOperationQueue.setGatt(null);
+        mOperationQueue.quit();
+        if (mGatt != null) {
+            mGatt.close();
+            mGatt = null;
+        }
+        mState = STATE_DISCONNECTED;
+    }
+
+    public GattOperationQueue getOperationQueue() {
+        return mOperationQueue;
+    }
+
+    /**
+     * Returns the characteristic the time is written to, or null until it has been resolved.
+     */
+    public BluetoothGattCharacteristic getClockCharacteristic() {
+        return mClockCharacteristic;
+    }
+
+    /**
+     * Returns the Current Time characteristic, or null if the clock has none or it has not been
+     * resolved yet.
+     */
+    public BluetoothGattCharacteristic getCurrentTimeCharacteristic() {
+        return mCurrentTimeCharacteristic;
+    }
+
+    /**
+     * Returns the mailbox request characteristic, or null if the clock has none or it has not
+     * been resolved yet.
+     */
+    public BluetoothGattCharacteristic getMailboxCharacteristic() {
+        return mMailboxCharacteristic;
+    }
+
+    /**
+     * Returns the services discovered on the device.
+     */
+    public synchronized List<BluetoothGattService> getServices() {
+        if (mGatt == null) {
+            return Collections.emptyList();
+        }
+        return mGatt.getServices();
+    }
+
+    /**
+     * Returns the ATT MTU negotiated on the current connection, {@link #DEFAULT_MTU} until the
+     * negotiation has completed.
+     */
+    public int getMtu() {
+        return mMtu;
+    }
+
+    /**
+     * Returns the largest value that fits in a single characteristic write.
+     */
+    public int getMaxWritePayload() {
+        return mMtu - 3;
+    }
+
+    /**
+     * Asks for the shortest connection interval for a transfer, such as provisioning. The
+     * request is queued, so it takes effect before the writes queued after it.
+     */
+    public void beginFastTransfer() {
+        mOperationQueue.enqueue(new GattOperationQueue.RequestConnectionPriority(
+                BluetoothGatt.CONNECTION_PRIORITY_HIGH));
+    }
+
+    /**
+     * Drops back to the balanced connection interval once the writes queued before this call
+     * have completed.
+     */
+    public void endFastTransfer() {
+        mOperationQueue.enqueue(new GattOperationQueue.RequestConnectionPriority(
+                BluetoothGatt.CONNECTION_PRIORITY_BALANCED));
+    }
+
+    private static BluetoothGattCharacteristic findCharacteristic(
+            List<BluetoothGattService> services, String serviceUuid, String characteristicUuid) {
+        for (BluetoothGattService gattService : services) {
+            if (gattService.getUuid().toString().equals(serviceUuid)) {
+                return gattService.getCharacteristic(UUID.fromString(characteristicUuid));
+            }
+        }
+        return null;
+    }
+}
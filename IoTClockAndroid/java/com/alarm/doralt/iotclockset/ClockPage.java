@@ -1,6 +1,4 @@
 package com.alarm.doralt.iotclockset;
-import java.text.DateFormat;
-import java.text.SimpleDateFormat;
 import java.util.Calendar;
 import android.bluetooth.BluetoothAdapter;
 import android.bluetooth.BluetoothDevice;
@@ -19,7 +17,15 @@ import android.view.View;
 import android.widget.Button;
 import android.widget.Toast;
 
+import com.alarm.doralt.iotclockset.protocol.ClockAlarm;
+import com.alarm.doralt.iotclockset.protocol.ClockMessage;
+import com.alarm.doralt.iotclockset.protocol.ClockProtocol;
+import com.alarm.doralt.iotclockset.protocol.ClockTransport;
+import com.alarm.doralt.iotclockset.protocol.CurrentTime;
+import com.alarm.doralt.iotclockset.protocol.Mailbox;
+
 import java.io.File;
+import java.util.ArrayList;
 import java.util.Date;
 import java.util.List;
 
@@ -27,34 +33,87 @@ public class ClockPage {
 
     static String HOURS = "";
     static String MINUTES = "";
-    private BluetoothGattCharacteristic mCharacteristic;
-    private BluetoothGatt               mGatt;
+    // Alarms beside the one-shot alarm above, one per mailbox slot at most
+    static final int MAX_ALARMS = Mailbox.ALARM_SLOTS - Mailbox.FIRST_MAILBOX_SLOT;
+    private final ArrayList<ClockAlarm> mAlarms = new ArrayList<ClockAlarm>();
+    private int mMailboxSeq;
     protected void ClockPage() {
 
     }
 
-    private String getDateTime() {
-        DateFormat dateFormat = new SimpleDateFormat("yyyy/MM/dd HH:mm");
-        Date date = new Date();
-        return dateFormat.format(date);
+    /**
+     * Returns true if the user chose a one-shot alarm, which only the text protocol of
+     * {@link #sendTime(ClockTransport)} can set.
+     */
+    protected boolean hasOneShotAlarm() {
+        return !HOURS.isEmpty() && !MINUTES.isEmpty();
+    }
+
+    /**
+     * Sends the current time and the chosen one-shot alarm, one character per write as every
+     * clock reads it. This overwrites the clock's alarm slot 0. With a queueing transport this
+     * returns at once.
+     *
+     * @return Return false if no one-shot alarm has been chosen.
+     */
+    protected boolean sendTime(ClockTransport transport){
+        if (!hasOneShotAlarm()) {
+            return false;
+        }
+        ClockMessage message = ClockMessage.of(Calendar.getInstance(),
+                Integer.parseInt(HOURS), Integer.parseInt(MINUTES));
+        ClockProtocol.send(transport, message, ClockProtocol.Framing.BYTES);
+        return true;
+    }
+
+    /**
+     * Sets only the clock's time, through the Current Time Service, leaving all its alarms
+     * alone.
+     *
+     * @param currentTime transport to the Current Time characteristic.
+     */
+    protected void sendCurrentTime(ClockTransport currentTime) {
+        // The phone's clock follows network time, so the clock may use it for its drift
+        currentTime.write(CurrentTime.encode(Calendar.getInstance(),
+                CurrentTime.ADJUST_EXTERNAL_REF), true);
+    }
+
+    /**
+     * Adds an alarm for {@link #sendAlarms(ClockTransport)}.
+     *
+     * @return Return false if there are {@link #MAX_ALARMS} already.
+     */
+    protected boolean addAlarm(ClockAlarm alarm) {
+        if (mAlarms.size() >= MAX_ALARMS) {
+            return false;
+        }
+        mAlarms.add(alarm);
+        return true;
     }
 
-    protected void onActivityResult(BluetoothGatt gatt,
-                                    BluetoothGattCharacteristic characteristic){
-        mGatt = gatt;
-        mCharacteristic = characteristic;
+    protected void clearAlarms() {
+        mAlarms.clear();
+    }
 
-        String data =  getDateTime() + " "+HOURS+":"+MINUTES;
-        //data = "B";
-        for (int i = 0; i<data.length();i++) {
-            char x = data.charAt(i);
-            try {
-                Thread.sleep(2000);
-            } catch (InterruptedException e) {
-                e.printStackTrace();
-            }
-            mCharacteristic.setValue((int) x, BluetoothGattCharacteristic.FORMAT_UINT8, 0);
-            mGatt.writeCharacteristic(mCharacteristic);
+    protected List<ClockAlarm> getAlarms() {
+        return mAlarms;
+    }
+
+    /**
+     * Replaces the clock's mailbox alarms with the ones added here: every mailbox slot is
+     * freed, then the alarms are added. Does nothing if none were added.
+     *
+     * @param mailbox transport to the mailbox request characteristic.
+     */
+    protected void sendAlarms(ClockTransport mailbox) {
+        if (mAlarms.isEmpty()) {
+            return;
+        }
+        for (int slot = Mailbox.FIRST_MAILBOX_SLOT; slot < Mailbox.ALARM_SLOTS; slot++) {
+            mailbox.write(Mailbox.deleteAlarm(mMailboxSeq++, slot), true);
+        }
+        for (ClockAlarm alarm : mAlarms) {
+            mailbox.write(Mailbox.addAlarm(mMailboxSeq++, alarm), true);
         }
     }
 
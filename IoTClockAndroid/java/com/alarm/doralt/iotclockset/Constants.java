@@ -23,4 +23,10 @@ public class Constants {
     public static final String TI_CC1350_APP    = "SimpleBLEPeripheral"; //TODO: check if connects
     public static String BOARD_SERVICES         = "0000fff0-0000-1000-8000-00805f9b34fb";
     public static String BOARD_WR               = "0000fff3-0000-1000-8000-00805f9b34fb";
+    // Current Time Service and its Current Time characteristic
+    public static String CURRENT_TIME_SERVICE   = "00001805-0000-1000-8000-00805f9b34fb";
+    public static String CURRENT_TIME           = "00002a2b-0000-1000-8000-00805f9b34fb";
+    // Mailbox service and its request characteristic
+    public static String MAILBOX_SERVICE        = "0000ffb0-0000-1000-8000-00805f9b34fb";
+    public static String MAILBOX_REQUEST        = "0000ffb1-0000-1000-8000-00805f9b34fb";
 }
@@ -18,8 +18,6 @@ package com.alarm.doralt.iotclockset;
 
 import android.app.Activity;
 import android.bluetooth.BluetoothAdapter;
-import android.bluetooth.BluetoothGattCharacteristic;
-import android.bluetooth.BluetoothGattService;
 import android.content.BroadcastReceiver;
 import android.content.ComponentName;
 import android.content.Context;
@@ -33,15 +31,19 @@ import android.view.Menu;
 import android.view.MenuItem;
 import android.view.View;
 import android.widget.Button;
+import android.widget.CheckBox;
 import android.widget.ExpandableListView;
-import android.widget.ScrollView;
+import android.widget.NumberPicker;
 import android.widget.SimpleExpandableListAdapter;
 import android.widget.TextView;
+import android.widget.Toast;
 
+import com.alarm.doralt.iotclockset.protocol.ClockAlarm;
+
+import java.text.DateFormatSymbols;
 import java.util.ArrayList;
 import java.util.HashMap;
-import java.util.List;
-import java.util.UUID;
+import java.util.Locale;
 
 /**
  * For a given BLE device, this Activity provides the user interface to connect, display data,
@@ -60,9 +62,14 @@ public class DeviceControlActivity extends Activity {
     private String mDeviceName;
     private String mDeviceAddress;
     private BluetoothLeService mBluetoothLeService;
-    private BluetoothGattCharacteristic mWriteCharacteristic;
-    private ScrollView mHourButton;
-    private ScrollView mMinuteButton;
+    // Send was pressed before the clock was ready
+    private boolean mSendPending;
+    private View mPicker;
+    private NumberPicker mHourPicker;
+    private NumberPicker mMinutePicker;
+    private WeekdayPicker mWeekdayPicker;
+    private CheckBox mOneShot;
+    private TextView mAlarmList;
     private Button mSendButton;
     private ClockPage        mCP;
 
@@ -96,47 +103,33 @@ public class DeviceControlActivity extends Activity {
         @Override
         public void onReceive(Context context, Intent intent){
                 final String action = intent.getAction();
+                // Connections to other clocks are kept by the service too
+                if (!mDeviceAddress.equals(
+                        intent.getStringExtra(BluetoothLeService.EXTRA_ADDRESS))) {
+                    return;
+                }
                 if (BluetoothLeService.ACTION_GATT_CONNECTED.equals(action)) {
                     updateConnectionState(R.string.connected);
-                    mHourButton.setVisibility(View.VISIBLE);
-                    mMinuteButton.setVisibility(View.VISIBLE);
+                    KnownClocks.add(DeviceControlActivity.this, mDeviceAddress);
+                    mPicker.setVisibility(View.VISIBLE);
                     mSendButton.setVisibility(View.VISIBLE);
 
                     invalidateOptionsMenu();
                 } else if (BluetoothLeService.ACTION_GATT_DISCONNECTED.equals(action)) {
                     updateConnectionState(R.string.disconnected);
-                    mHourButton.setVisibility(View.INVISIBLE);
-                    mMinuteButton.setVisibility(View.INVISIBLE);
+                    mPicker.setVisibility(View.INVISIBLE);
                     mSendButton.setVisibility(View.INVISIBLE);
                     invalidateOptionsMenu();
                 } else if (BluetoothLeService.ACTION_GATT_SERVICES_DISCOVERED.equals(action)) {
-                    // Find the write characteristic of the board's GATT service
-                    initializeCharacteristic(mBluetoothLeService.getSupportedGattServices());
-                    // Start writing data (phone's rotation vector)
-                    mBluetoothLeService.writeCharacteristic(mWriteCharacteristic,
-                            mCP);
-                    ;
+                    // The clock can be written; send if the user is waiting for it
+                    if (mSendPending && mBluetoothLeService != null) {
+                        mSendPending = !mBluetoothLeService.sendTime(mCP);
+                    }
                 } else if (BluetoothLeService.ACTION_DATA_AVAILABLE.equals(action)) {
                     displayData(intent.getStringExtra(BluetoothLeService.EXTRA_DATA));
                 }
             }
     };
-    private void initializeCharacteristic(List<BluetoothGattService> supportedGattServices) {
-        if (supportedGattServices != null) {
-            String service_uuid = null;
-            String wr_uuid      = Constants.BOARD_WR;
-            // Finds the appropriate service
-            for (BluetoothGattService gattService : supportedGattServices) {
-                service_uuid = gattService.getUuid().toString();
-                if (service_uuid.equals(Constants.BOARD_SERVICES)) {
-                    // Retrieves the write characteristic
-                    mWriteCharacteristic = gattService.getCharacteristic(UUID.fromString(wr_uuid));
-                    break;
-                }
-            }
-        }
-    }
-
     private void updateConnectionState(final int resourceId) {
         runOnUiThread(new Runnable() {
             @Override
@@ -144,14 +137,81 @@ public class DeviceControlActivity extends Activity {
             }
         });
     }
-    public void setHour(View v){
-        Button b = (Button)v;
-        ClockPage.HOURS = b.getText().toString();
+    // Two digit labels for the hour and minute pickers
+    private static final NumberPicker.Formatter TWO_DIGITS = new NumberPicker.Formatter() {
+        @Override
+        public String format(int value) {
+            return String.format(Locale.US, "%02d", value);
+        }
+    };
+
+    private final NumberPicker.OnValueChangeListener mTimeChangeListener =
+            new NumberPicker.OnValueChangeListener() {
+        @Override
+        public void onValueChange(NumberPicker picker, int oldVal, int newVal) {
+            updatePickedTime();
+        }
+    };
+
+    // The picked time goes to the clock's one-shot alarm only when the user asked for one;
+    // otherwise Set leaves that alarm alone and sets just the time.
+    private void updatePickedTime() {
+        if (mOneShot.isChecked()) {
+            ClockPage.HOURS = TWO_DIGITS.format(mHourPicker.getValue());
+            ClockPage.MINUTES = TWO_DIGITS.format(mMinutePicker.getValue());
+        } else {
+            ClockPage.HOURS = "";
+            ClockPage.MINUTES = "";
+        }
+    }
+
+    public void toggleOneShot(View v) {
+        updatePickedTime();
     }
-    public void setMinutes(View v){
-        Button b = (Button)v;
-        ClockPage.MINUTES = b.getText().toString();
+
+    public void addAlarm(View v) {
+        final ClockAlarm alarm = new ClockAlarm(mHourPicker.getValue(),
+                mMinutePicker.getValue(), mWeekdayPicker.getDays());
+        if (!mCP.addAlarm(alarm)) {
+            Toast.makeText(this, getString(R.string.too_many_alarms, ClockPage.MAX_ALARMS),
+                    Toast.LENGTH_SHORT).show();
+            return;
+        }
+        mWeekdayPicker.setDays(ClockAlarm.ONCE);
+        showAlarms();
+    }
+
+    public void clearAlarms(View v) {
+        mCP.clearAlarms();
+        showAlarms();
     }
+
+    private void showAlarms() {
+        if (mCP.getAlarms().isEmpty()) {
+            mAlarmList.setText(R.string.no_alarms);
+            return;
+        }
+        final String[] weekdays = new DateFormatSymbols().getShortWeekdays();
+        final StringBuilder text = new StringBuilder();
+        for (ClockAlarm alarm : mCP.getAlarms()) {
+            if (text.length() > 0) {
+                text.append('\n');
+            }
+            text.append(TWO_DIGITS.format(alarm.getHour())).append(':')
+                    .append(TWO_DIGITS.format(alarm.getMinute()));
+            if (alarm.getDays() == ClockAlarm.ONCE) {
+                text.append(' ').append(getString(R.string.alarm_once));
+            }
+            for (int day = 0; day < 7; day++) {
+                if (alarm.ringsOn(day)) {
+                    // Index 1 is Sunday
+                    text.append(' ').append(weekdays[day + 1]);
+                }
+            }
+        }
+        mAlarmList.setText(text);
+    }
+
     @Override
     public void onCreate(Bundle savedInstanceState) {
         super.onCreate(savedInstanceState);
@@ -163,8 +223,12 @@ public class DeviceControlActivity extends Activity {
 
         // Sets up UI references.
         ((TextView) findViewById(R.id.device_address)).setText(mDeviceAddress);
-        mHourButton = findViewById(R.id.hours);
-        mMinuteButton = findViewById(R.id.minutes);
+        mPicker = findViewById(R.id.picker);
+        mHourPicker = findViewById(R.id.hours);
+        mMinutePicker = findViewById(R.id.minutes);
+        mWeekdayPicker = findViewById(R.id.weekdays);
+        mOneShot = findViewById(R.id.one_shot);
+        mAlarmList = findViewById(R.id.alarm_list);
         mSendButton = findViewById(R.id.setBluetooth);
         mConnectionState    = findViewById(R.id.connection_state);
         mDataField          = findViewById(R.id.data_value);
@@ -172,18 +236,50 @@ public class DeviceControlActivity extends Activity {
         //getActionBar().setTitle(mDeviceName);
         //getActionBar().setDisplayHomeAsUpEnabled(true);
         Intent gattServiceIntent = new Intent(this, BluetoothLeService.class);
+        // Started as well as bound, so the connection outlives this activity
+        startService(gattServiceIntent);
         bindService(gattServiceIntent, mServiceConnection, BIND_AUTO_CREATE);
         mCP = new ClockPage();
+
+        mHourPicker.setMinValue(0);
+        mHourPicker.setMaxValue(23);
+        mHourPicker.setFormatter(TWO_DIGITS);
+        mHourPicker.setOnValueChangedListener(mTimeChangeListener);
+        mMinutePicker.setMinValue(0);
+        mMinutePicker.setMaxValue(59);
+        mMinutePicker.setFormatter(TWO_DIGITS);
+        mMinutePicker.setOnValueChangedListener(mTimeChangeListener);
+        updatePickedTime();
     }
-    protected void sendData(View v) {
+
+    @Override
+    protected void onResume() {
+        super.onResume();
         registerReceiver(mGattUpdateReceiver, makeGattUpdateIntentFilter());
         if (mBluetoothLeService != null) {
+            // Reports the current state at once if still connected
+            final boolean result = mBluetoothLeService.connect(mDeviceAddress);
+            Log.d(TAG, "Connect request result=" + result);
+        }
+    }
+
+    @Override
+    protected void onPause() {
+        super.onPause();
+        unregisterReceiver(mGattUpdateReceiver);
+    }
+
+    public void sendData(View v) {
+        if (mBluetoothLeService == null) {
+            return;
+        }
+        // An open connection with resolved services is written at once; otherwise the
+        // time goes out when the clock is ready.
+        mSendPending = !mBluetoothLeService.sendTime(mCP);
+        if (mSendPending) {
             final boolean result = mBluetoothLeService.connect(mDeviceAddress);
             Log.d(TAG, "Connect request result=" + result);
         }
-        //updateConnectionState(R.string.connected);
-        initializeCharacteristic(mBluetoothLeService.getSupportedGattServices());
-        mBluetoothLeService.writeCharacteristic(mWriteCharacteristic, mCP);
     }
     private static IntentFilter makeGattUpdateIntentFilter() {
         final IntentFilter intentFilter = new IntentFilter();
@@ -21,11 +21,20 @@ import android.app.ListActivity;
 import android.bluetooth.BluetoothAdapter;
 import android.bluetooth.BluetoothDevice;
 import android.bluetooth.BluetoothManager;
+import android.bluetooth.le.BluetoothLeScanner;
+import android.bluetooth.le.ScanCallback;
+import android.bluetooth.le.ScanFilter;
+import android.bluetooth.le.ScanResult;
+import android.bluetooth.le.ScanSettings;
+import android.content.BroadcastReceiver;
 import android.content.Context;
 import android.content.Intent;
+import android.content.IntentFilter;
 import android.content.pm.PackageManager;
 import android.os.Bundle;
 import android.os.Handler;
+import android.os.ParcelUuid;
+import android.util.Log;
 import android.view.LayoutInflater;
 import android.view.Menu;
 import android.view.MenuItem;
@@ -38,20 +47,66 @@ import android.widget.TextView;
 import android.widget.Toast;
 
 import java.util.ArrayList;
+import java.util.Collections;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Set;
 import java.util.UUID;
 
 /**
  * Activity for scanning and displaying available Bluetooth LE devices.
  */
 public class DeviceScanActivity extends ListActivity {
+    private final static String TAG = DeviceScanActivity.class.getSimpleName();
+
     private LeDeviceListAdapter mLeDeviceListAdapter;
     private BluetoothAdapter mBluetoothAdapter;
+    private BluetoothLeScanner mScanner;
     private boolean mScanning;
     private Handler mHandler;
+    // Known clocks not seen yet in this scan
+    private Set<String> mExpectedClocks;
 
     private static final int REQUEST_ENABLE_BT = 1;
-    // Stops scanning after 10 seconds.
+    // Stops scanning after 10 seconds, or once every known clock has been seen.
     private static final long SCAN_PERIOD = 10000;
+    // Text of the FleetSync states
+    private static final int[] SYNC_STATE_TEXT = {
+            R.string.fleet_queued,
+            R.string.fleet_connecting,
+            R.string.fleet_syncing,
+            R.string.fleet_done,
+            R.string.fleet_failed
+    };
+
+    private final Runnable mStopScan = new Runnable() {
+        @Override
+        public void run() {
+            scanLeDevice(false);
+        }
+    };
+
+    // Shows the progress of a fleet sync in the device list.
+    private final BroadcastReceiver mFleetReceiver = new BroadcastReceiver() {
+        @Override
+        public void onReceive(Context context, Intent intent) {
+            final String action = intent.getAction();
+            if (BluetoothLeService.ACTION_FLEET_PROGRESS.equals(action)) {
+                mLeDeviceListAdapter.setSyncState(
+                        intent.getStringExtra(BluetoothLeService.EXTRA_ADDRESS),
+                        intent.getIntExtra(BluetoothLeService.EXTRA_FLEET_STATE,
+                                FleetSync.STATE_QUEUED));
+                mLeDeviceListAdapter.notifyDataSetChanged();
+            } else if (BluetoothLeService.ACTION_FLEET_FINISHED.equals(action)) {
+                final long elapsed =
+                        intent.getLongExtra(BluetoothLeService.EXTRA_FLEET_ELAPSED_MS, 0);
+                Toast.makeText(DeviceScanActivity.this, getString(R.string.fleet_finished,
+                        intent.getIntExtra(BluetoothLeService.EXTRA_FLEET_SYNCED, 0),
+                        intent.getIntExtra(BluetoothLeService.EXTRA_FLEET_FAILED, 0),
+                        elapsed / 1000.0), Toast.LENGTH_LONG).show();
+            }
+        }
+    };
 
     @Override
     public void onCreate(Bundle savedInstanceState) {
@@ -78,6 +133,9 @@ public class DeviceScanActivity extends ListActivity {
             finish();
             return;
         }
+
+        // Keeps the clocks connected to before on time in the background
+        ResyncJobService.schedule(this);
     }
 
     @Override
@@ -87,7 +145,10 @@ public class DeviceScanActivity extends ListActivity {
             menu.findItem(R.id.menu_stop).setVisible(false);
             menu.findItem(R.id.menu_scan).setVisible(true);
             menu.findItem(R.id.menu_refresh).setActionView(null);
+            menu.findItem(R.id.menu_sync_all).setVisible(
+                    mLeDeviceListAdapter != null && mLeDeviceListAdapter.getCount() > 0);
         } else {
+            menu.findItem(R.id.menu_sync_all).setVisible(false);
             menu.findItem(R.id.menu_stop).setVisible(true);
             menu.findItem(R.id.menu_scan).setVisible(false);
             menu.findItem(R.id.menu_refresh).setActionView(
@@ -106,6 +167,9 @@ public class DeviceScanActivity extends ListActivity {
             case R.id.menu_stop:
                 scanLeDevice(false);
                 break;
+            case R.id.menu_sync_all:
+                syncAll();
+                break;
         }
         return true;
     }
@@ -126,6 +190,10 @@ public class DeviceScanActivity extends ListActivity {
         // Initializes list view adapter.
         mLeDeviceListAdapter = new LeDeviceListAdapter();
         setListAdapter(mLeDeviceListAdapter);
+        final IntentFilter fleetFilter = new IntentFilter();
+        fleetFilter.addAction(BluetoothLeService.ACTION_FLEET_PROGRESS);
+        fleetFilter.addAction(BluetoothLeService.ACTION_FLEET_FINISHED);
+        registerReceiver(mFleetReceiver, fleetFilter);
         scanLeDevice(true);
     }
 
@@ -142,10 +210,26 @@ public class DeviceScanActivity extends ListActivity {
     @Override
     protected void onPause() {
         super.onPause();
+        unregisterReceiver(mFleetReceiver);
         scanLeDevice(false);
         mLeDeviceListAdapter.clear();
     }
 
+    /**
+     * Sets the time of every listed clock. The service runs the sync, so it carries on if the
+     * activity goes away.
+     */
+    private void syncAll() {
+        final ArrayList<String> addresses = new ArrayList<String>();
+        for (int i = 0; i < mLeDeviceListAdapter.getCount(); i++) {
+            addresses.add(mLeDeviceListAdapter.getDevice(i).getAddress());
+        }
+        final Intent intent = new Intent(this, BluetoothLeService.class);
+        intent.setAction(BluetoothLeService.ACTION_SYNC_FLEET);
+        intent.putStringArrayListExtra(BluetoothLeService.EXTRA_ADDRESSES, addresses);
+        startService(intent);
+    }
+
     @Override
     protected void onListItemClick(ListView l, View v, int position, long id) {
         final BluetoothDevice device = mLeDeviceListAdapter.getDevice(position);
@@ -154,29 +238,35 @@ public class DeviceScanActivity extends ListActivity {
         intent.putExtra(DeviceControlActivity.EXTRAS_DEVICE_NAME, device.getName());
         intent.putExtra(DeviceControlActivity.EXTRAS_DEVICE_ADDRESS, device.getAddress());
         if (mScanning) {
-            mBluetoothAdapter.stopLeScan(mLeScanCallback);
-            mScanning = false;
+            scanLeDevice(false);
         }
         startActivity(intent);
     }
 
     private void scanLeDevice(final boolean enable) {
-        if (enable) {
+        // Null while Bluetooth is off
+        mScanner = mBluetoothAdapter.getBluetoothLeScanner();
+        mHandler.removeCallbacks(mStopScan);
+        if (enable && mScanner != null) {
             // Stops scanning after a pre-defined scan period.
-            mHandler.postDelayed(new Runnable() {
-                @Override
-                public void run() {
-                    mScanning = false;
-                    mBluetoothAdapter.stopLeScan(mLeScanCallback);
-                    invalidateOptionsMenu();
-                }
-            }, SCAN_PERIOD);
+            mHandler.postDelayed(mStopScan, SCAN_PERIOD);
 
+            // Only clocks are reported; the scan runs at full duty while the list is shown.
+            final List<ScanFilter> filters = Collections.singletonList(new ScanFilter.Builder()
+                    .setServiceUuid(ParcelUuid.fromString(Constants.BOARD_SERVICES))
+                    .build());
+            final ScanSettings settings = new ScanSettings.Builder()
+                    .setScanMode(ScanSettings.SCAN_MODE_LOW_LATENCY)
+                    .build();
+
+            mExpectedClocks = KnownClocks.get(this);
             mScanning = true;
-            mBluetoothAdapter.startLeScan(mLeScanCallback);
+            mScanner.startScan(filters, settings, mScanCallback);
         } else {
+            if (mScanning && mScanner != null) {
+                mScanner.stopScan(mScanCallback);
+            }
             mScanning = false;
-            mBluetoothAdapter.stopLeScan(mLeScanCallback);
         }
         invalidateOptionsMenu();
     }
@@ -184,26 +274,36 @@ public class DeviceScanActivity extends ListActivity {
     // Adapter for holding devices found through scanning.
     private class LeDeviceListAdapter extends BaseAdapter {
         private ArrayList<BluetoothDevice> mLeDevices;
+        // Fleet sync state by address
+        private HashMap<String, Integer> mSyncStates;
         private LayoutInflater mInflator;
 
         public LeDeviceListAdapter() {
             super();
             mLeDevices = new ArrayList<BluetoothDevice>();
+            mSyncStates = new HashMap<String, Integer>();
             mInflator = DeviceScanActivity.this.getLayoutInflater();
         }
 
-        public void addDevice(BluetoothDevice device) {
+        public boolean addDevice(BluetoothDevice device) {
             if(!mLeDevices.contains(device)) {
                 mLeDevices.add(device);
+                return true;
             }
+            return false;
         }
 
         public BluetoothDevice getDevice(int position) {
             return mLeDevices.get(position);
         }
 
+        public void setSyncState(String address, int state) {
+            mSyncStates.put(address, state);
+        }
+
         public void clear() {
             mLeDevices.clear();
+            mSyncStates.clear();
         }
 
         @Override
@@ -230,6 +330,7 @@ public class DeviceScanActivity extends ListActivity {
                 viewHolder = new ViewHolder();
                 viewHolder.deviceAddress = (TextView) view.findViewById(R.id.device_address);
                 viewHolder.deviceName = (TextView) view.findViewById(R.id.device_name);
+                viewHolder.syncState = (TextView) view.findViewById(R.id.device_sync_state);
                 view.setTag(viewHolder);
             } else {
                 viewHolder = (ViewHolder) view.getTag();
@@ -242,29 +343,45 @@ public class DeviceScanActivity extends ListActivity {
             else
                 viewHolder.deviceName.setText(R.string.unknown_device);
             viewHolder.deviceAddress.setText(device.getAddress());
+            final Integer syncState = mSyncStates.get(device.getAddress());
+            if (syncState != null) {
+                viewHolder.syncState.setText(SYNC_STATE_TEXT[syncState]);
+                viewHolder.syncState.setVisibility(View.VISIBLE);
+            } else {
+                viewHolder.syncState.setVisibility(View.GONE);
+            }
 
             return view;
         }
     }
 
-    // Device scan callback.
-    private BluetoothAdapter.LeScanCallback mLeScanCallback =
-            new BluetoothAdapter.LeScanCallback() {
+    // Device scan callback, called on the UI thread.
+    private final ScanCallback mScanCallback = new ScanCallback() {
 
         @Override
-        public void onLeScan(final BluetoothDevice device, int rssi, byte[] scanRecord) {
-            runOnUiThread(new Runnable() {
-                @Override
-                public void run() {
-                    mLeDeviceListAdapter.addDevice(device);
-                    mLeDeviceListAdapter.notifyDataSetChanged();
-                }
-            });
+        public void onScanResult(int callbackType, ScanResult result) {
+            final BluetoothDevice device = result.getDevice();
+            // Repeated advertisements of a listed device do not touch the list.
+            if (mLeDeviceListAdapter.addDevice(device)) {
+                mLeDeviceListAdapter.notifyDataSetChanged();
+            }
+            if (mExpectedClocks.remove(device.getAddress()) && mExpectedClocks.isEmpty()) {
+                scanLeDevice(false);
+            }
+        }
+
+        @Override
+        public void onScanFailed(int errorCode) {
+            Log.w(TAG, "Scan failed: " + errorCode);
+            mHandler.removeCallbacks(mStopScan);
+            mScanning = false;
+            invalidateOptionsMenu();
         }
     };
 
     static class ViewHolder {
         TextView deviceName;
         TextView deviceAddress;
+        TextView syncState;
     }
 }
\ No newline at end of file
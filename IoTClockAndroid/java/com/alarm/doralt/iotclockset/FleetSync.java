@@ -0,0 +1,215 @@
+package com.alarm.doralt.iotclockset;
+
+import android.bluetooth.BluetoothGattCharacteristic;
+import android.os.SystemClock;
+import android.util.Log;
+
+import com.alarm.doralt.iotclockset.protocol.CurrentTime;
+
+import java.util.Calendar;
+import java.util.Collection;
+import java.util.Collections;
+import java.util.HashMap;
+import java.util.LinkedList;
+import java.util.Map;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+
+/**
+ * Sets the time of many clocks at once. Up to {@code concurrency} clocks are connected at the
+ * same time, each with its own operation queue; the others wait in the order given and take
+ * the first free slot. A clock is done once its Current Time write has been acknowledged,
+ * and is then released to free the slot, so a fleet of N clocks takes about
+ * ceil(N / concurrency) times as long as one.
+ *
+ * Connection events are passed in from the {@code ClockConnection.Listener} of the connections,
+ * on any thread.
+ */
+public class FleetSync {
+    private final static String TAG = FleetSync.class.getSimpleName();
+
+    // Progress of one clock
+    public static final int STATE_QUEUED = 0;
+    public static final int STATE_CONNECTING = 1;
+    public static final int STATE_SYNCING = 2;
+    public static final int STATE_DONE = 3;
+    public static final int STATE_FAILED = 4;
+
+    /**
+     * Provides the connections and receives the progress.
+     */
+    public interface Host {
+        /**
+         * Returns the connection to a clock, connecting it if needed, or null if that fails.
+         */
+        ClockConnection open(String address);
+
+        /**
+         * Called when a clock is done with, synced or not, to free its slot.
+         */
+        void release(ClockConnection connection);
+
+        void onProgress(FleetSync fleet, String address, int state);
+
+        void onFinished(FleetSync fleet, int synced, int failed, long elapsedMs);
+    }
+
+    private final Host mHost;
+    private final int mConcurrency;
+    private final LinkedList<String> mQueued = new LinkedList<String>();
+    // Clocks in progress, with their Current Time write once it is queued
+    private final Map<String, GattOperationQueue.Operation> mActive =
+            new HashMap<String, GattOperationQueue.Operation>();
+    // The keys of mActive, readable without the lock
+    private final Set<String> mActiveAddresses =
+            Collections.newSetFromMap(new ConcurrentHashMap<String, Boolean>());
+    private long mStartTime;
+    private int mSynced;
+    private int mFailed;
+    private boolean mFinished;
+
+    public FleetSync(Host host, Collection<String> addresses, int concurrency) {
+        mHost = host;
+        mConcurrency = concurrency;
+        for (String address : addresses) {
+            if (!mQueued.contains(address)) {
+                mQueued.add(address);
+            }
+        }
+    }
+
+    /**
+     * Connects the first clocks.
+     */
+    public synchronized void start() {
+        mStartTime = SystemClock.elapsedRealtime();
+        Log.i(TAG, "Syncing " + mQueued.size() + " clocks, " + mConcurrency + " at a time");
+        for (String address : mQueued) {
+            setState(address, STATE_QUEUED);
+        }
+        fill();
+    }
+
+    /**
+     * Fails the clocks in progress and drops the queued ones.
+     */
+    public synchronized void cancel() {
+        for (String address : mActive.keySet().toArray(new String[0])) {
+            finish(address, STATE_FAILED);
+        }
+        while (!mQueued.isEmpty()) {
+            finish(mQueued.removeFirst(), STATE_FAILED);
+        }
+        checkFinished();
+    }
+
+    public synchronized boolean isFinished() {
+        return mFinished;
+    }
+
+    /**
+     * Returns true while the clock is being synced, so its connection must be kept. Does not
+     * take the lock, so it may be called while holding others.
+     */
+    public boolean isActive(String address) {
+        return mActiveAddresses.contains(address);
+    }
+
+    public synchronized void onConnectionStateChanged(ClockConnection connection, int state) {
+        if (state == ClockConnection.STATE_DISCONNECTED
+                && mActive.containsKey(connection.getAddress())) {
+            Log.w(TAG, connection.getAddress() + " disconnected before it was synced");
+            finish(connection.getAddress(), STATE_FAILED);
+            fill();
+        }
+    }
+
+    public synchronized void onReady(ClockConnection connection) {
+        final String address = connection.getAddress();
+        if (!mActive.containsKey(address) || mActive.get(address) != null) {
+            return;
+        }
+
+        final BluetoothGattCharacteristic characteristic =
+                connection.getCurrentTimeCharacteristic();
+        if (characteristic == null) {
+            // The clock's own text protocol would also overwrite its alarm
+            Log.w(TAG, address + " has no Current Time characteristic");
+            finish(address, STATE_FAILED);
+            fill();
+            return;
+        }
+
+        // The time is taken as late as possible, when the write is queued
+        final GattOperationQueue.Operation write = new GattOperationQueue.WriteCharacteristic(
+                characteristic,
+                CurrentTime.encode(Calendar.getInstance(), CurrentTime.ADJUST_EXTERNAL_REF),
+                BluetoothGattCharacteristic.WRITE_TYPE_DEFAULT, true, null);
+        mActive.put(address, write);
+        setState(address, STATE_SYNCING);
+        connection.getOperationQueue().enqueue(write);
+    }
+
+    public synchronized void onOperationComplete(ClockConnection connection,
+                                                 GattOperationQueue.Operation operation) {
+        final String address = connection.getAddress();
+        if (operation != null && mActive.get(address) == operation) {
+            finish(address, STATE_DONE);
+            mHost.release(connection);
+            fill();
+        }
+    }
+
+    public synchronized void onOperationFailed(ClockConnection connection,
+                                               GattOperationQueue.Operation operation) {
+        final String address = connection.getAddress();
+        if (operation != null && mActive.get(address) == operation) {
+            finish(address, STATE_FAILED);
+            mHost.release(connection);
+            fill();
+        }
+    }
+
+    // Connects queued clocks until every slot is taken
+    private void fill() {
+        while (mActive.size() < mConcurrency && !mQueued.isEmpty()) {
+            final String address = mQueued.removeFirst();
+            mActive.put(address, null);
+            mActiveAddresses.add(address);
+            setState(address, STATE_CONNECTING);
+
+            final ClockConnection connection = mHost.open(address);
+            if (connection == null) {
+                finish(address, STATE_FAILED);
+            } else if (connection.isReady()) {
+                onReady(connection);
+            }
+        }
+        checkFinished();
+    }
+
+    private void finish(String address, int state) {
+        mActive.remove(address);
+        mActiveAddresses.remove(address);
+        if (state == STATE_DONE) {
+            mSynced++;
+        } else {
+            mFailed++;
+        }
+        setState(address, state);
+    }
+
+    private void setState(String address, int state) {
+        mHost.onProgress(this, address, state);
+    }
+
+    private void checkFinished() {
+        if (!mFinished && mActive.isEmpty() && mQueued.isEmpty()) {
+            mFinished = true;
+            final long elapsed = SystemClock.elapsedRealtime() - mStartTime;
+            Log.i(TAG, "Synced " + mSynced + " clocks, " + mFailed + " failed, in "
+                    + elapsed + " ms");
+            mHost.onFinished(this, mSynced, mFailed, elapsed);
+        }
+    }
+}
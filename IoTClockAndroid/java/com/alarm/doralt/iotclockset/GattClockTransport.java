@@ -0,0 +1,43 @@
+package com.alarm.doralt.iotclockset;
+
+import android.bluetooth.BluetoothGattCharacteristic;
+
+import com.alarm.doralt.iotclockset.protocol.ClockTransport;
+
+/**
+ * Runs the clock protocol over a connection's {@link GattOperationQueue}. Writes are queued,
+ * so they return at once and go out one after the other. The writes made through one
+ * transport form one message: if one of them fails for good, the rest are dropped.
+ */
+public class GattClockTransport implements ClockTransport {
+    private final GattOperationQueue mQueue;
+    private final BluetoothGattCharacteristic mCharacteristic;
+    private final int mMtu;
+    private final boolean mIdempotent;
+
+    /**
+     * @param idempotent true if the clock takes every value written through this transport
+     *                   the same way when it comes twice, so a write that timed out may be
+     *                   sent again.
+     */
+    public GattClockTransport(GattOperationQueue queue,
+                              BluetoothGattCharacteristic characteristic, int mtu,
+                              boolean idempotent) {
+        mQueue = queue;
+        mCharacteristic = characteristic;
+        mMtu = mtu;
+        mIdempotent = idempotent;
+    }
+
+    @Override
+    public int getMtu() {
+        return mMtu;
+    }
+
+    @Override
+    public void write(byte[] value, boolean withResponse) {
+        mQueue.writeCharacteristic(mCharacteristic, value, withResponse
+                ? BluetoothGattCharacteristic.WRITE_TYPE_DEFAULT
+                : BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE, mIdempotent, this);
+    }
+}
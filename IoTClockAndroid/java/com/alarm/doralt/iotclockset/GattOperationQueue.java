@@ -0,0 +1,410 @@
+package com.alarm.doralt.iotclockset;
+
+import android.bluetooth.BluetoothGatt;
+import android.bluetooth.BluetoothGattCharacteristic;
+import android.os.Handler;
+import android.os.HandlerThread;
+import android.util.Log;
+
+import com.alarm.doralt.iotclockset.protocol.ClockProtocol;
+
+import java.util.Iterator;
+import java.util.LinkedList;
+
+/**
+ * Serializes the GATT operations of one connection. BluetoothGatt runs a single operation at
+ * a time and silently rejects the next one while it is busy, so each queued operation is
+ * started from the completion callback of the previous one. An operation that does not
+ * complete within its timeout or completes with an error is retried up to
+ * {@link #MAX_RETRIES} times, unless it is a write that may have reached the clock already
+ * (see {@link ClockProtocol#maySendAgain(boolean, boolean)}). A write that fails for good
+ * fails the rest of its message with it. Callbacks that do not answer the running operation,
+ * such as the late answer to one that timed out, are ignored. The queue runs on its own thread, never on
+ * the UI thread.
+ */
+public class GattOperationQueue {
+    private final static String TAG = GattOperationQueue.class.getSimpleName();
+
+    public static final long OPERATION_TIMEOUT_MS = 2000;
+    // Discovery takes a round trip per attribute group and the MTU exchange may wait for the
+    // clock's slave latency; both can run at the idle connection interval of up to 1 s.
+    public static final long DISCOVERY_TIMEOUT_MS = 30000;
+    public static final long MTU_TIMEOUT_MS = 10000;
+    public static final int MAX_RETRIES = 2;
+
+    // Status passed to the listener for operations that did not complete
+    public static final int STATUS_TIMEOUT = -1;
+    public static final int STATUS_NOT_STARTED = -2;
+    public static final int STATUS_DISCONNECTED = -3;
+    // An earlier write of the same message failed
+    public static final int STATUS_MESSAGE_FAILED = -4;
+
+    /**
+     * A GATT operation. {@link #start(BluetoothGatt)} is called on the queue thread and must
+     * issue exactly one BluetoothGatt request whose callback ends in
+     * {@link GattOperationQueue#onComplete(Class, BluetoothGattCharacteristic, int)}.
+     */
+    public static abstract class Operation {
+        private int mAttempts;
+
+        /**
+         * Issues the request.
+         *
+         * @return Return true if BluetoothGatt accepted the request.
+         */
+        abstract boolean start(BluetoothGatt gatt);
+
+        /**
+         * Returns how long to wait for the callback before the request counts as lost.
+         */
+        long getTimeoutMs() {
+            return OPERATION_TIMEOUT_MS;
+        }
+
+        /**
+         * Returns true if a callback reported for the given operation type and characteristic
+         * answers this operation.
+         */
+        boolean isAnsweredBy(Class<? extends Operation> type,
+                             BluetoothGattCharacteristic characteristic) {
+            return type == getClass();
+        }
+
+        /**
+         * Returns false for requests that BluetoothGatt answers without a callback; the next
+         * operation then starts as soon as this one has been issued.
+         */
+        boolean hasCallback() {
+            return true;
+        }
+
+        /**
+         * Returns true if the operation may be started again after failing with the given
+         * status.
+         */
+        boolean mayRetry(int status) {
+            return true;
+        }
+
+        /**
+         * Returns the message the operation is part of, or null if it stands alone.
+         */
+        Object getMessage() {
+            return null;
+        }
+    }
+
+    /**
+     * Discovers the services of the device; completed from onServicesDiscovered.
+     */
+    public static class DiscoverServices extends Operation {
+        @Override
+        boolean start(BluetoothGatt gatt) {
+            return gatt.discoverServices();
+        }
+
+        @Override
+        long getTimeoutMs() {
+            return DISCOVERY_TIMEOUT_MS;
+        }
+
+        @Override
+        public String toString() {
+            return "discover services";
+        }
+    }
+
+    /**
+     * Negotiates the ATT MTU; completed from onMtuChanged.
+     */
+    public static class RequestMtu extends Operation {
+        private final int mMtu;
+
+        public RequestMtu(int mtu) {
+            mMtu = mtu;
+        }
+
+        @Override
+        boolean start(BluetoothGatt gatt) {
+            return gatt.requestMtu(mMtu);
+        }
+
+        @Override
+        long getTimeoutMs() {
+            return MTU_TIMEOUT_MS;
+        }
+
+        @Override
+        public String toString() {
+            return "request MTU " + mMtu;
+        }
+    }
+
+    /**
+     * Asks for a connection interval class, e.g.
+     * {@code BluetoothGatt.CONNECTION_PRIORITY_HIGH}. There is no callback for it.
+     */
+    public static class RequestConnectionPriority extends Operation {
+        private final int mPriority;
+
+        public RequestConnectionPriority(int priority) {
+            mPriority = priority;
+        }
+
+        @Override
+        boolean start(BluetoothGatt gatt) {
+            return gatt.requestConnectionPriority(mPriority);
+        }
+
+        @Override
+        boolean hasCallback() {
+            return false;
+        }
+
+        @Override
+        public String toString() {
+            return "request connection priority " + mPriority;
+        }
+    }
+
+    /**
+     * Writes a value to a characteristic. A write that timed out is not retried unless it is
+     * idempotent.
+     */
+    public static class WriteCharacteristic extends Operation {
+        private final BluetoothGattCharacteristic mCharacteristic;
+        private final byte[] mValue;
+        private final int mWriteType;
+        private final boolean mIdempotent;
+        private final Object mMessage;
+
+        /**
+         * @param idempotent true if the clock takes the value the same way when it comes twice.
+         * @param message    the message the write is part of: if the write fails for good, the
+         *                   queued writes of the same message are dropped. Null if the write
+         *                   stands alone.
+         */
+        public WriteCharacteristic(BluetoothGattCharacteristic characteristic, byte[] value,
+                                   int writeType, boolean idempotent, Object message) {
+            mCharacteristic = characteristic;
+            mValue = value;
+            mWriteType = writeType;
+            mIdempotent = idempotent;
+            mMessage = message;
+        }
+
+        @Override
+        boolean start(BluetoothGatt gatt) {
+            // The characteristic object is shared; set it up only when it is this write's turn
+            mCharacteristic.setWriteType(mWriteType);
+            mCharacteristic.setValue(mValue);
+            return gatt.writeCharacteristic(mCharacteristic);
+        }
+
+        @Override
+        boolean isAnsweredBy(Class<? extends Operation> type,
+                             BluetoothGattCharacteristic characteristic) {
+            return super.isAnsweredBy(type, characteristic) && characteristic != null
+                    && characteristic.getUuid().equals(mCharacteristic.getUuid())
+                    && characteristic.getInstanceId() == mCharacteristic.getInstanceId();
+        }
+
+        @Override
+        boolean mayRetry(int status) {
+            return ClockProtocol.maySendAgain(mIdempotent, status == STATUS_TIMEOUT);
+        }
+
+        @Override
+        Object getMessage() {
+            return mMessage;
+        }
+
+        @Override
+        public String toString() {
+            return "write " + mCharacteristic.getUuid();
+        }
+    }
+
+    /**
+     * Reports completed operations, operations that failed for good and an empty queue.
+     */
+    public interface Listener {
+        void onOperationComplete(Operation operation);
+
+        void onOperationFailed(Operation operation, int status);
+
+        void onIdle();
+    }
+
+    private final HandlerThread mThread;
+    private final Handler mHandler;
+    private final Listener mListener;
+    private final LinkedList<Operation> mPending = new LinkedList<Operation>();
+    private BluetoothGatt mGatt;
+    private Operation mCurrent;
+    // Message of the last write that failed for good; its writes still being queued are dropped
+    private Object mFailedMessage;
+
+    private final Runnable mTimeout = new Runnable() {
+        @Override
+        public void run() {
+            Log.w(TAG, "Timed out: " + mCurrent);
+            complete(STATUS_TIMEOUT);
+        }
+    };
+
+    public GattOperationQueue(Listener listener) {
+        mListener = listener;
+        mThread = new HandlerThread(TAG);
+        mThread.start();
+        mHandler = new Handler(mThread.getLooper());
+    }
+
+    /**
+     * Sets the connection operations run on. Operations are held until there is one; setting
+     * null, on disconnection, fails everything queued.
+     */
+    public void setGatt(final BluetoothGatt gatt) {
+        mHandler.post(new Runnable() {
+            @Override
+            public void run() {
+                mGatt = gatt;
+                if (gatt == null) {
+                    failAll(STATUS_DISCONNECTED);
+                } else {
+                    next();
+                }
+            }
+        });
+    }
+
+    /**
+     * Adds an operation to the end of the queue. May be called from any thread.
+     */
+    public void enqueue(final Operation operation) {
+        mHandler.post(new Runnable() {
+            @Override
+            public void run() {
+                if (mFailedMessage != null && operation.getMessage() == mFailedMessage) {
+                    mListener.onOperationFailed(operation, STATUS_MESSAGE_FAILED);
+                    return;
+                }
+                mPending.add(operation);
+                next();
+            }
+        });
+    }
+
+    /**
+     * Queues a characteristic write.
+     *
+     * @param writeType  {@code BluetoothGattCharacteristic.WRITE_TYPE_DEFAULT} or
+     *                   {@code WRITE_TYPE_NO_RESPONSE}.
+     * @param idempotent true if the clock takes the value the same way when it comes twice.
+     * @param message    the message the write is part of, or null if it stands alone.
+     */
+    public void writeCharacteristic(BluetoothGattCharacteristic characteristic, byte[] value,
+                                    int writeType, boolean idempotent, Object message) {
+        enqueue(new WriteCharacteristic(characteristic, value, writeType, idempotent, message));
+    }
+
+    /**
+     * Completes the running operation if the callback answers it. Called from the
+     * BluetoothGattCallback method that reports an operation, on any thread.
+     *
+     * @param type           the class of the operation the callback answers.
+     * @param characteristic the characteristic of the callback, or null if it has none.
+     * @param status         {@code BluetoothGatt.GATT_SUCCESS} or the error status of the
+     *                       callback.
+     */
+    public void onComplete(final Class<? extends Operation> type,
+                           final BluetoothGattCharacteristic characteristic, final int status) {
+        mHandler.post(new Runnable() {
+            @Override
+            public void run() {
+                if (mCurrent == null || !mCurrent.isAnsweredBy(type, characteristic)) {
+                    // Late answer to an operation that already timed out, or to a request
+                    // the queue did not issue
+                    Log.w(TAG, "Ignored " + type.getSimpleName() + " callback, status "
+                            + status + ", running " + mCurrent);
+                    return;
+                }
+                complete(status);
+            }
+        });
+    }
+
+    /**
+     * Drops every queued operation and stops the queue thread.
+     */
+    public void quit() {
+        mHandler.removeCallbacksAndMessages(null);
+        mThread.quit();
+    }
+
+    private void complete(int status) {
+        mHandler.removeCallbacks(mTimeout);
+
+        final Operation operation = mCurrent;
+        mCurrent = null;
+        if (status == BluetoothGatt.GATT_SUCCESS) {
+            mListener.onOperationComplete(operation);
+        } else if (operation.mAttempts <= MAX_RETRIES && mGatt != null
+                && operation.mayRetry(status)) {
+            Log.w(TAG, "Retrying " + operation + ", status " + status);
+            mPending.addFirst(operation);
+        } else {
+            fail(operation, status);
+        }
+        next();
+    }
+
+    // Reports an operation failed for good, and drops the queued rest of its message
+    private void fail(Operation operation, int status) {
+        mListener.onOperationFailed(operation, status);
+        final Object message = operation.getMessage();
+        if (message == null) {
+            return;
+        }
+        mFailedMessage = message;
+        for (Iterator<Operation> i = mPending.iterator(); i.hasNext(); ) {
+            final Operation pending = i.next();
+            if (pending.getMessage() == message) {
+                i.remove();
+                mListener.onOperationFailed(pending, STATUS_MESSAGE_FAILED);
+            }
+        }
+    }
+
+    private void next() {
+        while (mCurrent == null && mGatt != null && !mPending.isEmpty()) {
+            final Operation operation = mPending.removeFirst();
+            operation.mAttempts++;
+            if (operation.start(mGatt)) {
+                if (!operation.hasCallback()) {
+                    mListener.onOperationComplete(operation);
+                    continue;
+                }
+                mCurrent = operation;
+                mHandler.postDelayed(mTimeout, operation.getTimeoutMs());
+                return;
+            }
+            Log.w(TAG, "Could not start " + operation);
+            fail(operation, STATUS_NOT_STARTED);
+        }
+        if (mCurrent == null && mPending.isEmpty()) {
+            mListener.onIdle();
+        }
+    }
+
+    private void failAll(int status) {
+        mHandler.removeCallbacks(mTimeout);
+        if (mCurrent != null) {
+            mListener.onOperationFailed(mCurrent, status);
+            mCurrent = null;
+        }
+        while (!mPending.isEmpty()) {
+            mListener.onOperationFailed(mPending.removeFirst(), status);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+package com.alarm.doralt.iotclockset;
+
+import android.content.Context;
+import android.content.SharedPreferences;
+
+import java.util.Collections;
+import java.util.HashSet;
+import java.util.Set;
+
+/**
+ * Addresses of the clocks this phone has connected to, kept in shared preferences so a scan
+ * knows which devices to expect.
+ */
+public class KnownClocks {
+    private static final String PREFS_NAME = "known_clocks";
+    private static final String KEY_ADDRESSES = "addresses";
+
+    /**
+     * Returns a modifiable copy of the known clock addresses.
+     */
+    public static Set<String> get(Context context) {
+        return new HashSet<String>(prefs(context).getStringSet(KEY_ADDRESSES,
+                Collections.<String>emptySet()));
+    }
+
+    /**
+     * Remembers a clock.
+     */
+    public static void add(Context context, String address) {
+        final Set<String> addresses = get(context);
+        if (addresses.add(address)) {
+            prefs(context).edit().putStringSet(KEY_ADDRESSES, addresses).apply();
+        }
+    }
+
+    private static SharedPreferences prefs(Context context) {
+        return context.getSharedPreferences(PREFS_NAME, Context.MODE_PRIVATE);
+    }
+}
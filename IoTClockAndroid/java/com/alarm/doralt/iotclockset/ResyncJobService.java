@@ -0,0 +1,292 @@
+package com.alarm.doralt.iotclockset;
+
+import android.app.job.JobInfo;
+import android.app.job.JobParameters;
+import android.app.job.JobScheduler;
+import android.app.job.JobService;
+import android.bluetooth.BluetoothAdapter;
+import android.bluetooth.BluetoothManager;
+import android.bluetooth.le.BluetoothLeScanner;
+import android.bluetooth.le.ScanCallback;
+import android.bluetooth.le.ScanFilter;
+import android.bluetooth.le.ScanResult;
+import android.bluetooth.le.ScanSettings;
+import android.content.BroadcastReceiver;
+import android.content.ComponentName;
+import android.content.Context;
+import android.content.Intent;
+import android.content.IntentFilter;
+import android.content.ServiceConnection;
+import android.os.Handler;
+import android.os.IBinder;
+import android.os.ParcelUuid;
+import android.os.SystemClock;
+import android.util.Log;
+
+import com.alarm.doralt.iotclockset.protocol.ClockStatus;
+import com.alarm.doralt.iotclockset.protocol.SkewEstimate;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.TimeZone;
+
+/**
+ * Keeps the known clocks on time without the user. Every {@link #PERIOD_MS} it scans briefly
+ * and bounds each clock's offset from the minutes in its advertisements. Only the clocks whose
+ * time is not set, or may be more than {@link #SKEW_THRESHOLD_S} off, are connected to and
+ * synced through {@link BluetoothLeService#syncFleet(List)}; a clock in sync costs nothing but
+ * the scan.
+ */
+public class ResyncJobService extends JobService {
+    private final static String TAG = ResyncJobService.class.getSimpleName();
+
+    private static final int JOB_ID = 1;
+    private static final long PERIOD_MS = 6 * 60 * 60 * 1000L;
+    // Longest scan; it stops sooner once every known clock has been decided on
+    private static final long SCAN_PERIOD = 10000;
+    // Largest offset left alone, in seconds. The clock shows minutes, and one sighting of
+    // the advertised minute bounds the offset only to a 62 s range.
+    private static final double SKEW_THRESHOLD_S = 60;
+
+    private final Handler mHandler = new Handler();
+    private JobParameters mParams;
+    private BluetoothLeScanner mScanner;
+    private boolean mScanning;
+    private Set<String> mKnownClocks;
+    private final Map<String, SkewEstimate> mEstimates = new HashMap<String, SkewEstimate>();
+    private final Set<String> mUnsetClocks = new HashSet<String>();
+    // Clocks to sync once the service is bound
+    private ArrayList<String> mPendingSync;
+    private BluetoothLeService mBluetoothLeService;
+    private boolean mBound;
+    private boolean mReceiverRegistered;
+
+    private final Runnable mStopScan = new Runnable() {
+        @Override
+        public void run() {
+            scanDone();
+        }
+    };
+
+    private final ServiceConnection mServiceConnection = new ServiceConnection() {
+        @Override
+        public void onServiceConnected(ComponentName componentName, IBinder service) {
+            mBluetoothLeService = ((BluetoothLeService.LocalBinder) service).getService();
+            if (mPendingSync != null) {
+                startSync();
+            }
+        }
+
+        @Override
+        public void onServiceDisconnected(ComponentName componentName) {
+            mBluetoothLeService = null;
+        }
+    };
+
+    private final BroadcastReceiver mFleetReceiver = new BroadcastReceiver() {
+        @Override
+        public void onReceive(Context context, Intent intent) {
+            Log.i(TAG, "Resynced " + intent.getIntExtra(BluetoothLeService.EXTRA_FLEET_SYNCED, 0)
+                    + " clocks");
+            finish(false);
+        }
+    };
+
+    // Device scan callback, called on the main thread.
+    private final ScanCallback mScanCallback = new ScanCallback() {
+        @Override
+        public void onScanResult(int callbackType, ScanResult result) {
+            final String address = result.getDevice().getAddress();
+            // Results may still be queued after the scan was stopped
+            if (!mScanning || !mKnownClocks.contains(address)
+                    || result.getScanRecord() == null) {
+                return;
+            }
+            final ClockStatus status = ClockStatus.decode(result.getScanRecord()
+                    .getManufacturerSpecificData(ClockStatus.COMPANY_ID));
+            if (status == null) {
+                // Firmware without the advertised status, or with its 1900 based version 1
+                return;
+            }
+
+            if (!status.isTimeSet()) {
+                mUnsetClocks.add(address);
+            } else {
+                SkewEstimate estimate = mEstimates.get(address);
+                if (estimate == null) {
+                    estimate = new SkewEstimate();
+                    mEstimates.put(address, estimate);
+                }
+                estimate.add(status.getEpochMinutes(), localSeconds(result.getTimestampNanos()));
+            }
+            if (allDecided()) {
+                scanDone();
+            }
+        }
+
+        @Override
+        public void onScanFailed(int errorCode) {
+            Log.w(TAG, "Scan failed: " + errorCode);
+            mScanning = false;
+            finish(true);
+        }
+    };
+
+    /**
+     * Schedules the periodic resync unless it is already scheduled.
+     */
+    public static void schedule(Context context) {
+        final JobScheduler scheduler =
+                (JobScheduler) context.getSystemService(Context.JOB_SCHEDULER_SERVICE);
+        for (JobInfo job : scheduler.getAllPendingJobs()) {
+            if (job.getId() == JOB_ID) {
+                return;
+            }
+        }
+        scheduler.schedule(new JobInfo.Builder(JOB_ID,
+                new ComponentName(context, ResyncJobService.class))
+                .setPeriodic(PERIOD_MS)
+                .setPersisted(true)
+                .build());
+    }
+
+    @Override
+    public boolean onStartJob(JobParameters params) {
+        mKnownClocks = KnownClocks.get(this);
+        if (mKnownClocks.isEmpty()) {
+            return false;
+        }
+        final BluetoothManager bluetoothManager =
+                (BluetoothManager) getSystemService(Context.BLUETOOTH_SERVICE);
+        final BluetoothAdapter adapter = bluetoothManager.getAdapter();
+        // Null while Bluetooth is off
+        mScanner = adapter == null ? null : adapter.getBluetoothLeScanner();
+        if (mScanner == null) {
+            return false;
+        }
+
+        mParams = params;
+        mEstimates.clear();
+        mUnsetClocks.clear();
+        mPendingSync = null;
+        bindService(new Intent(this, BluetoothLeService.class), mServiceConnection,
+                BIND_AUTO_CREATE);
+        mBound = true;
+
+        // Only the known clocks are reported, so the controller can filter in hardware
+        final List<ScanFilter> filters = new ArrayList<ScanFilter>();
+        for (String address : mKnownClocks) {
+            filters.add(new ScanFilter.Builder()
+                    .setDeviceAddress(address)
+                    .setServiceUuid(ParcelUuid.fromString(Constants.BOARD_SERVICES))
+                    .build());
+        }
+        final ScanSettings settings = new ScanSettings.Builder()
+                .setScanMode(ScanSettings.SCAN_MODE_LOW_LATENCY)
+                .build();
+        mHandler.postDelayed(mStopScan, SCAN_PERIOD);
+        mScanning = true;
+        mScanner.startScan(filters, settings, mScanCallback);
+        return true;
+    }
+
+    @Override
+    public boolean onStopJob(JobParameters params) {
+        cleanUp();
+        mParams = null;
+        return true;
+    }
+
+    // Every known clock has been seen, and is either unset or known to be in or out of sync
+    private boolean allDecided() {
+        for (String address : mKnownClocks) {
+            final SkewEstimate estimate = mEstimates.get(address);
+            if (!mUnsetClocks.contains(address) && (estimate == null
+                    || !(estimate.isWithin(SKEW_THRESHOLD_S)
+                    || estimate.isBeyond(SKEW_THRESHOLD_S)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private void scanDone() {
+        stopScan();
+
+        final ArrayList<String> addresses = new ArrayList<String>(mUnsetClocks);
+        for (Map.Entry<String, SkewEstimate> entry : mEstimates.entrySet()) {
+            final SkewEstimate estimate = entry.getValue();
+            if (!mUnsetClocks.contains(entry.getKey())
+                    && !estimate.isWithin(SKEW_THRESHOLD_S)) {
+                Log.d(TAG, entry.getKey() + " offset in [" + estimate.getLow() + ", "
+                        + estimate.getHigh() + ") s");
+                addresses.add(entry.getKey());
+            }
+        }
+        Log.i(TAG, "Seen " + (mEstimates.size() + mUnsetClocks.size()) + " of "
+                + mKnownClocks.size() + " clocks, " + addresses.size() + " to resync");
+
+        if (addresses.isEmpty()) {
+            finish(false);
+            return;
+        }
+        mPendingSync = addresses;
+        if (mBluetoothLeService != null) {
+            startSync();
+        }
+    }
+
+    private void startSync() {
+        final IntentFilter filter = new IntentFilter(BluetoothLeService.ACTION_FLEET_FINISHED);
+        registerReceiver(mFleetReceiver, filter);
+        mReceiverRegistered = true;
+        if (!mBluetoothLeService.initialize() || !mBluetoothLeService.syncFleet(mPendingSync)) {
+            // A sync started by the user is already running
+            finish(false);
+        }
+        mPendingSync = null;
+    }
+
+    private void stopScan() {
+        mHandler.removeCallbacks(mStopScan);
+        if (mScanning) {
+            mScanner.stopScan(mScanCallback);
+            mScanning = false;
+        }
+    }
+
+    private void cleanUp() {
+        stopScan();
+        mPendingSync = null;
+        if (mReceiverRegistered) {
+            unregisterReceiver(mFleetReceiver);
+            mReceiverRegistered = false;
+        }
+        if (mBound) {
+            unbindService(mServiceConnection);
+            mBound = false;
+            mBluetoothLeService = null;
+        }
+    }
+
+    private void finish(boolean reschedule) {
+        if (mParams == null) {
+            return;
+        }
+        cleanUp();
+        jobFinished(mParams, reschedule);
+        mParams = null;
+    }
+
+    // Local time, in seconds since 1970, at an elapsedRealtimeNanos() timestamp
+    private static double localSeconds(long timestampNanos) {
+        final long now = System.currentTimeMillis();
+        final double wallMs = now
+                - (SystemClock.elapsedRealtimeNanos() - timestampNanos) / 1000000.0;
+        return (wallMs + TimeZone.getDefault().getOffset(now)) / 1000.0;
+    }
+}
@@ -0,0 +1,81 @@
+package com.alarm.doralt.iotclockset;
+
+import android.content.Context;
+import android.graphics.Canvas;
+import android.graphics.Paint;
+import android.util.AttributeSet;
+import android.view.MotionEvent;
+import android.view.View;
+
+import java.text.DateFormatSymbols;
+
+/**
+ * Seven weekday toggles drawn by a single view, for the days an alarm repeats on. The
+ * selection is a mask with bit 0 for Sunday, as the clock stores it.
+ */
+public class WeekdayPicker extends View {
+    private static final int DAYS = 7;
+
+    private final String[] mLabels = new String[DAYS];
+    private final Paint mTextPaint = new Paint(Paint.ANTI_ALIAS_FLAG);
+    private final Paint mSelectedPaint = new Paint(Paint.ANTI_ALIAS_FLAG);
+    private int mDays;
+
+    public WeekdayPicker(Context context, AttributeSet attrs) {
+        super(context, attrs);
+
+        // Index 1 is Sunday
+        final String[] weekdays = new DateFormatSymbols().getShortWeekdays();
+        for (int i = 0; i < DAYS; i++) {
+            mLabels[i] = weekdays[i + 1].substring(0, 1);
+        }
+
+        final float density = getResources().getDisplayMetrics().density;
+        mTextPaint.setTextAlign(Paint.Align.CENTER);
+        mTextPaint.setTextSize(16 * density);
+        mSelectedPaint.setColor(getResources().getColor(R.color.colorAccent));
+        setClickable(true);
+    }
+
+    /**
+     * Returns the selected days, bit 0 for Sunday; 0 if none.
+     */
+    public int getDays() {
+        return mDays;
+    }
+
+    public void setDays(int days) {
+        mDays = days;
+        invalidate();
+    }
+
+    @Override
+    protected void onDraw(Canvas canvas) {
+        final float cell = (float) getWidth() / DAYS;
+        final float centerY = getHeight() / 2f;
+        final float radius = Math.min(cell, getHeight()) / 2f - 2;
+        final float baseline = centerY - (mTextPaint.descent() + mTextPaint.ascent()) / 2;
+
+        for (int i = 0; i < DAYS; i++) {
+            final float centerX = cell * i + cell / 2;
+            final boolean selected = (mDays & (1 << i)) != 0;
+            if (selected) {
+                canvas.drawCircle(centerX, centerY, radius, mSelectedPaint);
+            }
+            mTextPaint.setColor(selected ? 0xFFFFFFFF : 0xFF000000);
+            canvas.drawText(mLabels[i], centerX, baseline, mTextPaint);
+        }
+    }
+
+    @Override
+    public boolean onTouchEvent(MotionEvent event) {
+        if (event.getAction() == MotionEvent.ACTION_UP) {
+            final int day = (int) (event.getX() * DAYS / getWidth());
+            if (day >= 0 && day < DAYS) {
+                setDays(mDays ^ (1 << day));
+            }
+            performClick();
+        }
+        return true;
+    }
+}
@@ -0,0 +1,47 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+/**
+ * An alarm as the clock stores it: a time of day and the weekdays it rings on.
+ */
+public final class ClockAlarm {
+    // Weekday mask, bit 0 for Sunday; no day set means the alarm rings once
+    public static final int ONCE = 0;
+    public static final int ALL_DAYS = 0x7F;
+
+    private final int mHour;
+    private final int mMinute;
+    private final int mDays;
+
+    /**
+     * @param days weekday mask, bit 0 for Sunday, or {@link #ONCE}.
+     * @throws IllegalArgumentException if a field is out of range.
+     */
+    public ClockAlarm(int hour, int minute, int days) {
+        if (hour < 0 || hour > 23 || minute < 0 || minute > 59
+                || (days & ~ALL_DAYS) != 0) {
+            throw new IllegalArgumentException("Alarm " + hour + ":" + minute + ", " + days);
+        }
+        mHour = hour;
+        mMinute = minute;
+        mDays = days;
+    }
+
+    public int getHour() {
+        return mHour;
+    }
+
+    public int getMinute() {
+        return mMinute;
+    }
+
+    public int getDays() {
+        return mDays;
+    }
+
+    /**
+     * Returns true if the alarm rings on a weekday, 0 for Sunday.
+     */
+    public boolean ringsOn(int weekday) {
+        return (mDays & (1 << weekday)) != 0;
+    }
+}
@@ -0,0 +1,148 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import java.nio.charset.Charset;
+import java.util.Calendar;
+import java.util.Locale;
+
+/**
+ * The time and alarm a clock is set with. On the wire it is the "yyyy/MM/dd HH:mm HH:mm" text
+ * the firmware parses: the local date and time followed by the alarm, which the clock rings
+ * once. This class has no Android dependencies.
+ */
+public final class ClockMessage {
+    /** Length of the encoded text; the clock applies it once this many bytes have arrived. */
+    public static final int LENGTH = 22;
+
+    private static final Charset ASCII = Charset.forName("US-ASCII");
+    // Offsets of the separators in the encoded text
+    private static final int[] SEPARATOR_OFFSETS = {4, 7, 10, 13, 16, 19};
+    private static final char[] SEPARATOR_CHARS = {'/', '/', ' ', ':', ' ', ':'};
+
+    private final int mYear;
+    private final int mMonth;
+    private final int mDay;
+    private final int mHour;
+    private final int mMinute;
+    private final int mAlarmHour;
+    private final int mAlarmMinute;
+
+    /**
+     * @param month 1 to 12.
+     * @throws IllegalArgumentException if a field is out of range.
+     */
+    public ClockMessage(int year, int month, int day, int hour, int minute,
+                        int alarmHour, int alarmMinute) {
+        mYear = check("year", year, 0, 9999);
+        mMonth = check("month", month, 1, 12);
+        mDay = check("day", day, 1, 31);
+        mHour = check("hour", hour, 0, 23);
+        mMinute = check("minute", minute, 0, 59);
+        mAlarmHour = check("alarm hour", alarmHour, 0, 23);
+        mAlarmMinute = check("alarm minute", alarmMinute, 0, 59);
+    }
+
+    /**
+     * Sets the clock to the time of a calendar, to the minute.
+     */
+    public static ClockMessage of(Calendar now, int alarmHour, int alarmMinute) {
+        return new ClockMessage(now.get(Calendar.YEAR), now.get(Calendar.MONTH) + 1,
+                now.get(Calendar.DAY_OF_MONTH), now.get(Calendar.HOUR_OF_DAY),
+                now.get(Calendar.MINUTE), alarmHour, alarmMinute);
+    }
+
+    /**
+     * Returns the {@link #LENGTH} byte text sent to the clock.
+     */
+    public byte[] encode() {
+        return String.format(Locale.US, "%04d/%02d/%02d %02d:%02d %02d:%02d",
+                mYear, mMonth, mDay, mHour, mMinute, mAlarmHour, mAlarmMinute).getBytes(ASCII);
+    }
+
+    /**
+     * Parses the text the clock received, as {@link #encode()} writes it.
+     *
+     * @throws IllegalArgumentException if the text is malformed or a field is out of range.
+     */
+    public static ClockMessage decode(byte[] value) {
+        if (value.length != LENGTH) {
+            throw new IllegalArgumentException("Length " + value.length + ", expected " + LENGTH);
+        }
+        for (int i = 0; i < SEPARATOR_OFFSETS.length; i++) {
+            if (value[SEPARATOR_OFFSETS[i]] != SEPARATOR_CHARS[i]) {
+                throw new IllegalArgumentException("Expected '" + SEPARATOR_CHARS[i]
+                        + "' at " + SEPARATOR_OFFSETS[i]);
+            }
+        }
+        return new ClockMessage(digits(value, 0, 4), digits(value, 5, 2), digits(value, 8, 2),
+                digits(value, 11, 2), digits(value, 14, 2), digits(value, 17, 2),
+                digits(value, 20, 2));
+    }
+
+    public int getYear() {
+        return mYear;
+    }
+
+    public int getMonth() {
+        return mMonth;
+    }
+
+    public int getDay() {
+        return mDay;
+    }
+
+    public int getHour() {
+        return mHour;
+    }
+
+    public int getMinute() {
+        return mMinute;
+    }
+
+    public int getAlarmHour() {
+        return mAlarmHour;
+    }
+
+    public int getAlarmMinute() {
+        return mAlarmMinute;
+    }
+
+    @Override
+    public boolean equals(Object o) {
+        if (!(o instanceof ClockMessage)) {
+            return false;
+        }
+        final ClockMessage other = (ClockMessage) o;
+        return mYear == other.mYear && mMonth == other.mMonth && mDay == other.mDay
+                && mHour == other.mHour && mMinute == other.mMinute
+                && mAlarmHour == other.mAlarmHour && mAlarmMinute == other.mAlarmMinute;
+    }
+
+    @Override
+    public int hashCode() {
+        return ((((mYear * 13 + mMonth) * 32 + mDay) * 24 + mHour) * 60 + mMinute) * 1440
+                + mAlarmHour * 60 + mAlarmMinute;
+    }
+
+    @Override
+    public String toString() {
+        return new String(encode(), ASCII);
+    }
+
+    private static int check(String name, int value, int min, int max) {
+        if (value < min || value > max) {
+            throw new IllegalArgumentException(name + " " + value + " out of range");
+        }
+        return value;
+    }
+
+    private static int digits(byte[] value, int offset, int count) {
+        int result = 0;
+        for (int i = offset; i < offset + count; i++) {
+            if (value[i] < '0' || value[i] > '9') {
+                throw new IllegalArgumentException("Expected a digit at " + i);
+            }
+            result = result * 10 + (value[i] - '0');
+        }
+        return result;
+    }
+}
@@ -0,0 +1,97 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Splits a {@link ClockMessage} into the writes the clock's time characteristic accepts and
+ * sends them over a {@link ClockTransport}.
+ */
+public final class ClockProtocol {
+    /**
+     * How a message is split into writes.
+     */
+    public enum Framing {
+        /** One character per Write Request; every firmware version accepts it. */
+        BYTES,
+        /**
+         * [seq][characters...] frames filling the MTU, up to {@link #MAX_FRAME_LEN} bytes,
+         * sent as Write Commands.
+         */
+        STREAM
+    }
+
+    // ATT opcode and handle in front of every written value
+    public static final int ATT_WRITE_OVERHEAD = 3;
+    // Longest value the clock's time characteristic accepts, SIMPLEPROFILE_CHAR3_MAX_LEN in
+    // the firmware, whatever the MTU
+    public static final int MAX_FRAME_LEN = 20;
+    // Stream frames the clock takes before it has to acknowledge. A message never needs more,
+    // so no acknowledgement is waited for.
+    public static final int STREAM_WINDOW = 8;
+
+    private ClockProtocol() {
+    }
+
+    /**
+     * Returns the values to write, in order.
+     *
+     * @param mtu ATT MTU of the link.
+     * @throws IllegalArgumentException if the MTU leaves no room for a stream frame's data.
+     */
+    public static List<byte[]> frame(ClockMessage message, Framing framing, int mtu) {
+        final byte[] text = message.encode();
+        final List<byte[]> writes = new ArrayList<byte[]>();
+
+        if (framing == Framing.BYTES) {
+            for (byte b : text) {
+                writes.add(new byte[] {b});
+            }
+            return writes;
+        }
+
+        // A one byte value is taken as a single character, so frames carry at least one
+        final int chunk = Math.min(mtu - ATT_WRITE_OVERHEAD, MAX_FRAME_LEN) - 1;
+        if (chunk < 1) {
+            throw new IllegalArgumentException("MTU " + mtu + " too small for stream frames");
+        }
+        for (int offset = 0, seq = 0; offset < text.length; offset += chunk, seq++) {
+            final int end = Math.min(offset + chunk, text.length);
+            final byte[] frame = new byte[end - offset + 1];
+            // Sequence number 0 restarts the clock's stream, dropping any partial message
+            frame[0] = (byte) seq;
+            System.arraycopy(text, offset, frame, 1, end - offset);
+            writes.add(frame);
+        }
+        return writes;
+    }
+
+    /**
+     * Sends a message.
+     *
+     * @return Return the number of writes made.
+     */
+    public static int send(ClockTransport transport, ClockMessage message, Framing framing) {
+        final List<byte[]> writes = frame(message, framing, transport.getMtu());
+        final boolean withResponse = framing == Framing.BYTES;
+        for (byte[] value : writes) {
+            transport.write(value, withResponse);
+        }
+        return writes.size();
+    }
+
+    /**
+     * Returns true if a write that did not complete may be sent again. A write whose response
+     * never came may have reached the clock already, so it is sent again only if the clock
+     * takes it the same way twice, as a Current Time. A repeated text character would shift
+     * the rest of the message, and a repeated mailbox request to add an alarm would take a
+     * second slot; the clock does not match requests by their sequence number.
+     *
+     * @param idempotent   true if the clock takes the value the same way when it comes twice.
+     * @param responseLost true if the write timed out waiting for its response, rather than
+     *                     being refused by the clock.
+     */
+    public static boolean maySendAgain(boolean idempotent, boolean responseLost) {
+        return idempotent || !responseLost;
+    }
+}
@@ -0,0 +1,92 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+/**
+ * The status a clock puts in the manufacturer specific data of its advertisements, so it can
+ * be checked with a scan, without connecting.
+ */
+public final class ClockStatus {
+    // Company identifier the data is advertised under (Texas Instruments)
+    public static final int COMPANY_ID = 0x000D;
+    // Layout version this class decodes, and its length after the company identifier.
+    // Version 1 firmware counted its minutes from 1900 and is not decoded.
+    public static final int VERSION = 2;
+    public static final int LENGTH = 11;
+
+    public static final int NO_ALARM = 0xFFFF;
+
+    public static final int FLAG_TIME_SET = 0x01;
+    public static final int FLAG_ALARM_ARMED = 0x02;
+    public static final int FLAG_RINGING = 0x04;
+    public static final int FLAG_DISMISSED = 0x08;
+
+    private final long mEpochMinutes;
+    private final int mNextAlarm;
+    private final int mFlags;
+    private final int mFirmwareVersion;
+    private final int mBatteryVoltage;
+
+    private ClockStatus(long epochMinutes, int nextAlarm, int flags, int firmwareVersion,
+                        int batteryVoltage) {
+        mEpochMinutes = epochMinutes;
+        mNextAlarm = nextAlarm;
+        mFlags = flags;
+        mFirmwareVersion = firmwareVersion;
+        mBatteryVoltage = batteryVoltage;
+    }
+
+    /**
+     * Decodes the manufacturer specific data that follows the company identifier.
+     *
+     * @return Return null if there is none or it has another layout version.
+     */
+    public static ClockStatus decode(byte[] data) {
+        if (data == null || data.length < LENGTH || data[0] != VERSION) {
+            return null;
+        }
+        return new ClockStatus(
+                (data[1] & 0xFFL) | (data[2] & 0xFFL) << 8 | (data[3] & 0xFFL) << 16
+                        | (data[4] & 0xFFL) << 24,
+                (data[5] & 0xFF) | (data[6] & 0xFF) << 8,
+                data[7] & 0xFF,
+                (data[8] & 0xFF) | (data[9] & 0xFF) << 8,
+                data[10] & 0xFF);
+    }
+
+    /**
+     * Returns the clock's local time in minutes since 1970, 0 if its time is not set. Like
+     * the phone's local time in {@link SkewEstimate#add}, it counts the local wall clock as
+     * if it were UTC.
+     */
+    public long getEpochMinutes() {
+        return mEpochMinutes;
+    }
+
+    /**
+     * Returns the next alarm as minute of the day, or {@link #NO_ALARM}.
+     */
+    public int getNextAlarm() {
+        return mNextAlarm;
+    }
+
+    public int getFlags() {
+        return mFlags;
+    }
+
+    public boolean isTimeSet() {
+        return (mFlags & FLAG_TIME_SET) != 0;
+    }
+
+    /**
+     * Returns the firmware version, major in the high byte.
+     */
+    public int getFirmwareVersion() {
+        return mFirmwareVersion;
+    }
+
+    /**
+     * Returns the battery voltage in units of 1/32 V.
+     */
+    public int getBatteryVoltage() {
+        return mBatteryVoltage;
+    }
+}
@@ -0,0 +1,22 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+/**
+ * Carries writes to the clock's time characteristic. A write may be sent before it returns or
+ * queued, but writes must reach the clock in the order they were made. A write whose response
+ * does not come is sent again only where {@link ClockProtocol#maySendAgain(boolean, boolean)}
+ * allows it; otherwise it fails, and so do the writes made after it.
+ */
+public interface ClockTransport {
+    /**
+     * Returns the ATT MTU of the link. A write carries at most MTU - 3 bytes.
+     */
+    int getMtu();
+
+    /**
+     * Writes a value to the time characteristic.
+     *
+     * @param withResponse true for a Write Request, which the clock acknowledges, false for a
+     *                     Write Command.
+     */
+    void write(byte[] value, boolean withResponse);
+}
@@ -0,0 +1,45 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import java.util.Calendar;
+
+/**
+ * The Current Time characteristic value of the Current Time Service. Writing it sets only the
+ * clock's time, leaving its alarms alone.
+ */
+public final class CurrentTime {
+    public static final int LENGTH = 10;
+
+    // Adjust reason bits
+    public static final int ADJUST_MANUAL = 0x01;
+    public static final int ADJUST_EXTERNAL_REF = 0x02;
+    public static final int ADJUST_TIME_ZONE = 0x04;
+    public static final int ADJUST_DST = 0x08;
+
+    private CurrentTime() {
+    }
+
+    /**
+     * Encodes the local time of a calendar.
+     *
+     * @param adjustReason {@link #ADJUST_EXTERNAL_REF} when the time comes from the phone's
+     *                     network time, so the clock may use it to estimate its drift.
+     */
+    public static byte[] encode(Calendar now, int adjustReason) {
+        final int year = now.get(Calendar.YEAR);
+        // Calendar counts the week from Sunday = 1, the characteristic from Monday = 1
+        final int dayOfWeek = (now.get(Calendar.DAY_OF_WEEK) + 5) % 7 + 1;
+
+        return new byte[] {
+                (byte) year,
+                (byte) (year >> 8),
+                (byte) (now.get(Calendar.MONTH) + 1),
+                (byte) now.get(Calendar.DAY_OF_MONTH),
+                (byte) now.get(Calendar.HOUR_OF_DAY),
+                (byte) now.get(Calendar.MINUTE),
+                (byte) now.get(Calendar.SECOND),
+                (byte) dayOfWeek,
+                (byte) (now.get(Calendar.MILLISECOND) * 256 / 1000),
+                (byte) adjustReason
+        };
+    }
+}
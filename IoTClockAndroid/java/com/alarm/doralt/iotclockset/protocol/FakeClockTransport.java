@@ -0,0 +1,231 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * An in-memory clock for running the protocol off the device. Writes are taken the way the
+ * firmware takes them on its time characteristic, and the link time they would need is
+ * counted on a virtual clock instead of being waited for.
+ *
+ * <p>The link model: data moves only in connection events, one every connection interval. A
+ * written value, with its ATT and L2CAP headers, is split into link layer packets of
+ * {@link #LL_PAYLOAD} bytes. Write Commands fill up to {@code packetsPerEvent} packets per
+ * event. A Write Request is answered in the event after the one that carried it, and the next
+ * write goes out in the event after that. A Write Request whose response is lost, see
+ * {@link #loseResponse(int)}, is waited for {@link #RESPONSE_TIMEOUT_US}; it is then sent again
+ * if {@link ClockProtocol#maySendAgain(boolean, boolean)} allows it, or it fails together with
+ * every later write, as a queue of the app fails the rest of the message.
+ *
+ * <p>Not thread safe.
+ */
+public class FakeClockTransport implements ClockTransport {
+    // Link layer payload without data length extension, and the L2CAP header inside it
+    public static final int LL_PAYLOAD = 27;
+    private static final int L2CAP_HEADER = 4;
+    private static final int ATT_MIN_MTU = 23;
+    // The app's GattOperationQueue.OPERATION_TIMEOUT_MS
+    public static final long RESPONSE_TIMEOUT_US = 2000000;
+
+    private final long mConnectionIntervalUs;
+    private final int mMtu;
+    private final int mPacketsPerEvent;
+    private boolean mIdempotent;
+
+    // Connection event the next packet goes in, and the packets already in it
+    private long mEvent;
+    private int mEventPackets;
+    // Last connection event that carried anything
+    private long mLastEvent = -1;
+    private int mWrites;
+    private int mPackets;
+    // Write whose response is lost once, counted from 0, or -1
+    private int mLostResponse = -1;
+    private boolean mFailed;
+    private int mFailedWrites;
+
+    // Receive state, as the firmware keeps it per connection
+    private final byte[] mRxBuf = new byte[ClockMessage.LENGTH];
+    private int mRxLen;
+    private int mNextSeq;
+    private int mRejectedFrames;
+    private final List<ClockMessage> mReceived = new ArrayList<ClockMessage>();
+
+    /**
+     * @param connectionIntervalUs connection interval, 7500 us at the highest priority.
+     * @param mtu                  negotiated ATT MTU.
+     * @param packetsPerEvent      link layer packets the phone sends per connection event.
+     */
+    public FakeClockTransport(long connectionIntervalUs, int mtu, int packetsPerEvent) {
+        if (connectionIntervalUs <= 0 || mtu < ATT_MIN_MTU || packetsPerEvent < 1) {
+            throw new IllegalArgumentException();
+        }
+        mConnectionIntervalUs = connectionIntervalUs;
+        mMtu = mtu;
+        mPacketsPerEvent = packetsPerEvent;
+    }
+
+    @Override
+    public int getMtu() {
+        return mMtu;
+    }
+
+    /**
+     * Sets whether the values written are taken the same way when they come twice, as a
+     * transport of the app declares them. False at first.
+     */
+    public void setIdempotent(boolean idempotent) {
+        mIdempotent = idempotent;
+    }
+
+    /**
+     * Loses the response to a Write Request once: the clock takes the write, but the phone
+     * never hears so and times out.
+     *
+     * @param write index of the write, counted from 0 since the last {@link #reset()}.
+     */
+    public void loseResponse(int write) {
+        mLostResponse = write;
+    }
+
+    @Override
+    public void write(byte[] value, boolean withResponse) {
+        if (value.length == 0 || value.length > mMtu - ClockProtocol.ATT_WRITE_OVERHEAD
+                || value.length > ClockProtocol.MAX_FRAME_LEN) {
+            throw new IllegalArgumentException("Value length " + value.length);
+        }
+        if (mFailed) {
+            mFailedWrites++;
+            return;
+        }
+        final boolean lost = withResponse && mWrites == mLostResponse;
+        send(value, withResponse);
+        if (lost) {
+            // The phone waits out the timeout; the next write goes in the event after it
+            mLastEvent = mEvent - 2 + RESPONSE_TIMEOUT_US / mConnectionIntervalUs;
+            mEvent = mLastEvent + 1;
+            if (ClockProtocol.maySendAgain(mIdempotent, true)) {
+                send(value, withResponse);
+            } else {
+                mFailed = true;
+                mFailedWrites++;
+            }
+        }
+    }
+
+    private void send(byte[] value, boolean withResponse) {
+        mWrites++;
+
+        final int packets = (value.length + ClockProtocol.ATT_WRITE_OVERHEAD + L2CAP_HEADER
+                + LL_PAYLOAD - 1) / LL_PAYLOAD;
+        for (int i = 0; i < packets; i++) {
+            if (mEventPackets == mPacketsPerEvent) {
+                mEvent++;
+                mEventPackets = 0;
+            }
+            mEventPackets++;
+            mPackets++;
+        }
+        mLastEvent = mEvent;
+        if (withResponse) {
+            // The response comes in the next event; the following write waits for it
+            mLastEvent = mEvent + 1;
+            mEvent += 2;
+            mEventPackets = 0;
+        }
+
+        receive(value);
+    }
+
+    /**
+     * Returns the link time the writes so far took, from the first connection event to the
+     * last one that carried a packet or a response.
+     */
+    public long getElapsedUs() {
+        return (mLastEvent + 1) * mConnectionIntervalUs;
+    }
+
+    public int getWriteCount() {
+        return mWrites;
+    }
+
+    public int getPacketCount() {
+        return mPackets;
+    }
+
+    /**
+     * Returns the writes that failed: the one whose response was lost, if it could not be sent
+     * again, and every write made after it.
+     */
+    public int getFailedWriteCount() {
+        return mFailedWrites;
+    }
+
+    /**
+     * Returns the stream frames dropped for being out of sequence.
+     */
+    public int getRejectedFrameCount() {
+        return mRejectedFrames;
+    }
+
+    /**
+     * Returns the messages the clock has applied, oldest first.
+     */
+    public List<ClockMessage> getReceived() {
+        return mReceived;
+    }
+
+    /**
+     * Clears the link time, the counters, the lost response, the failure and the receive state,
+     * keeping the link parameters.
+     */
+    public void reset() {
+        mEvent = 0;
+        mEventPackets = 0;
+        mLastEvent = -1;
+        mWrites = 0;
+        mPackets = 0;
+        mLostResponse = -1;
+        mFailed = false;
+        mFailedWrites = 0;
+        mRxLen = 0;
+        mNextSeq = 0;
+        mRejectedFrames = 0;
+        mReceived.clear();
+    }
+
+    // The firmware's stream handling: a single byte is the next character, anything longer is
+    // a [seq][characters...] frame.
+    private void receive(byte[] value) {
+        if (value.length == 1) {
+            receiveBytes(value, 0);
+            return;
+        }
+
+        final int seq = value[0] & 0xFF;
+        if (seq == 0 && mNextSeq != 0) {
+            mNextSeq = 0;
+            mRxLen = 0;
+        }
+        if (seq != mNextSeq) {
+            mRejectedFrames++;
+            return;
+        }
+        mNextSeq = (mNextSeq + 1) & 0xFF;
+        receiveBytes(value, 1);
+    }
+
+    private void receiveBytes(byte[] value, int offset) {
+        for (int i = offset; i < value.length; i++) {
+            mRxBuf[mRxLen++] = value[i];
+            if (mRxLen == ClockMessage.LENGTH) {
+                mRxLen = 0;
+                try {
+                    mReceived.add(ClockMessage.decode(mRxBuf.clone()));
+                } catch (IllegalArgumentException e) {
+                    // The firmware parses whatever arrived; a garbled message sets nothing useful
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+/**
+ * Requests of the clock's mailbox service: [seq][opcode][parameters...], written to the
+ * request characteristic and answered by a notification that repeats seq and opcode.
+ */
+public final class Mailbox {
+    public static final int MAX_LEN = 20;
+
+    public static final int OP_ADD_ALARM = 0x02;
+    public static final int OP_DEL_ALARM = 0x03;
+
+    // Alarm slots; slot 0 belongs to the text protocol and cannot be added to
+    public static final int ALARM_SLOTS = 4;
+    public static final int FIRST_MAILBOX_SLOT = 1;
+
+    private Mailbox() {
+    }
+
+    /**
+     * Adds an alarm in the first free slot from {@link #FIRST_MAILBOX_SLOT}.
+     */
+    public static byte[] addAlarm(int seq, ClockAlarm alarm) {
+        return new byte[] {(byte) seq, OP_ADD_ALARM, (byte) alarm.getHour(),
+                (byte) alarm.getMinute(), (byte) alarm.getDays()};
+    }
+
+    /**
+     * Frees an alarm slot.
+     */
+    public static byte[] deleteAlarm(int seq, int slot) {
+        return new byte[] {(byte) seq, OP_DEL_ALARM, (byte) slot};
+    }
+}
@@ -0,0 +1,69 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+/**
+ * Bounds a clock's offset from the phone using only the minutes it advertises. The clock
+ * updates the advertised minute as its minute rolls over, so minute M seen at phone time t
+ * puts the offset in [60 M - t, 60 M + 60 - t) seconds. Every further sighting narrows the
+ * range, down to about {@link #SLACK_S} once two are seen on either side of a rollover.
+ */
+public final class SkewEstimate {
+    // Allowed for the delay between the rollover and the advertisement that carries it
+    public static final double SLACK_S = 1.0;
+
+    private double mLow = Double.NEGATIVE_INFINITY;
+    private double mHigh = Double.POSITIVE_INFINITY;
+    private int mSamples;
+
+    /**
+     * Adds a sighting.
+     *
+     * @param epochMinutes   minute the clock advertised.
+     * @param phoneLocalSecs phone's local time when it was received, in seconds since 1970.
+     */
+    public void add(long epochMinutes, double phoneLocalSecs) {
+        final double low = epochMinutes * 60.0 - phoneLocalSecs - SLACK_S;
+        mLow = Math.max(mLow, low);
+        mHigh = Math.min(mHigh, low + 60.0 + 2 * SLACK_S);
+        mSamples++;
+    }
+
+    public int getSamples() {
+        return mSamples;
+    }
+
+    /**
+     * Returns the lowest possible offset in seconds, clock minus phone.
+     */
+    public double getLow() {
+        return mLow;
+    }
+
+    /**
+     * Returns the highest possible offset in seconds.
+     */
+    public double getHigh() {
+        return mHigh;
+    }
+
+    /**
+     * Returns true if the sightings contradict each other, as when the clock's minute does
+     * not roll over at second 0.
+     */
+    public boolean isInconsistent() {
+        return mLow > mHigh;
+    }
+
+    /**
+     * Returns true if the offset is certainly within +-threshold seconds.
+     */
+    public boolean isWithin(double threshold) {
+        return mSamples > 0 && !isInconsistent() && mLow >= -threshold && mHigh <= threshold;
+    }
+
+    /**
+     * Returns true if the offset is certainly beyond +-threshold seconds.
+     */
+    public boolean isBeyond(double threshold) {
+        return mSamples > 0 && !isInconsistent() && (mLow > threshold || mHigh < -threshold);
+    }
+}
@@ -0,0 +1,52 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+
+/**
+ * Cost of building the writes for one time-set: encoding the message and framing it, at the
+ * default MTU and at the MTU the app asks for.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+public class ClockProtocolBenchmark {
+    @Param({"23", "517"})
+    public int mtu;
+
+    private ClockMessage mMessage;
+
+    @Setup
+    public void setUp() {
+        mMessage = new ClockMessage(2024, 3, 9, 7, 5, 6, 30);
+    }
+
+    @Benchmark
+    public byte[] encode() {
+        return mMessage.encode();
+    }
+
+    @Benchmark
+    public ClockMessage decode() {
+        return ClockMessage.decode(mMessage.encode());
+    }
+
+    @Benchmark
+    public List<byte[]> frameBytes() {
+        return ClockProtocol.frame(mMessage, ClockProtocol.Framing.BYTES, mtu);
+    }
+
+    @Benchmark
+    public List<byte[]> frameStream() {
+        return ClockProtocol.frame(mMessage, ClockProtocol.Framing.STREAM, mtu);
+    }
+}
@@ -0,0 +1,96 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+
+import java.nio.charset.Charset;
+import java.util.Calendar;
+import java.util.GregorianCalendar;
+
+import org.junit.Test;
+
+public class ClockMessageTest {
+    private static final Charset ASCII = Charset.forName("US-ASCII");
+
+    @Test
+    public void encodesTheFirmwareText() {
+        final byte[] text = new ClockMessage(2024, 3, 9, 7, 5, 6, 30).encode();
+
+        assertEquals(ClockMessage.LENGTH, text.length);
+        assertArrayEquals("2024/03/09 07:05 06:30".getBytes(ASCII), text);
+    }
+
+    @Test
+    public void decodesWhatItEncodes() {
+        final int[][] fields = {
+                {0, 1, 1, 0, 0, 0, 0},
+                {1970, 1, 1, 0, 0, 23, 59},
+                {2024, 2, 29, 12, 30, 6, 45},
+                {2038, 1, 19, 3, 14, 7, 0},
+                {9999, 12, 31, 23, 59, 23, 59},
+        };
+        for (int[] f : fields) {
+            final ClockMessage message = new ClockMessage(f[0], f[1], f[2], f[3], f[4], f[5],
+                    f[6]);
+            final ClockMessage decoded = ClockMessage.decode(message.encode());
+
+            assertEquals(message, decoded);
+            assertEquals(message.hashCode(), decoded.hashCode());
+            assertEquals(f[0], decoded.getYear());
+            assertEquals(f[1], decoded.getMonth());
+            assertEquals(f[2], decoded.getDay());
+            assertEquals(f[3], decoded.getHour());
+            assertEquals(f[4], decoded.getMinute());
+            assertEquals(f[5], decoded.getAlarmHour());
+            assertEquals(f[6], decoded.getAlarmMinute());
+        }
+    }
+
+    @Test
+    public void decodesEveryTimeOfDay() {
+        for (int minute = 0; minute < 24 * 60; minute++) {
+            final ClockMessage message = new ClockMessage(2024, 6, 15, minute / 60, minute % 60,
+                    (minute + 1) / 60 % 24, (minute + 1) % 60);
+
+            assertEquals(message, ClockMessage.decode(message.encode()));
+        }
+    }
+
+    @Test
+    public void takesTheCalendarTimeToTheMinute() {
+        final Calendar now = new GregorianCalendar(2024, Calendar.DECEMBER, 31, 23, 59, 58);
+
+        assertEquals(new ClockMessage(2024, 12, 31, 23, 59, 7, 15),
+                ClockMessage.of(now, 7, 15));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void decodeRejectsShortText() {
+        ClockMessage.decode("2024/03/09 07:05 06:3".getBytes(ASCII));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void decodeRejectsLongText() {
+        ClockMessage.decode("2024/03/09 07:05 06:300".getBytes(ASCII));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void decodeRejectsMisplacedSeparator() {
+        ClockMessage.decode("2024-03/09 07:05 06:30".getBytes(ASCII));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void decodeRejectsNonDigit() {
+        ClockMessage.decode("2024/03/09 07:05 06:3x".getBytes(ASCII));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void decodeRejectsFieldOutOfRange() {
+        ClockMessage.decode("2024/13/09 07:05 06:30".getBytes(ASCII));
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void rejectsAlarmOutOfRange() {
+        new ClockMessage(2024, 3, 9, 7, 5, 24, 0);
+    }
+}
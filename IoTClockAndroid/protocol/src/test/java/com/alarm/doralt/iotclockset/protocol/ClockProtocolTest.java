@@ -0,0 +1,127 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import java.io.ByteArrayOutputStream;
+import java.util.List;
+
+import org.junit.Test;
+
+public class ClockProtocolTest {
+    private static final ClockMessage MESSAGE = new ClockMessage(2024, 3, 9, 7, 5, 6, 30);
+
+    @Test
+    public void bytesFramingWritesOneCharacterEach() {
+        final List<byte[]> writes = ClockProtocol.frame(MESSAGE, ClockProtocol.Framing.BYTES,
+                23);
+
+        assertEquals(ClockMessage.LENGTH, writes.size());
+        for (byte[] write : writes) {
+            assertEquals(1, write.length);
+        }
+        assertArrayEquals(MESSAGE.encode(), concat(writes, 0));
+    }
+
+    @Test
+    public void streamFramesFillTheDefaultMtu() {
+        // 23 - 3 ATT header bytes leave 19 characters after the sequence number
+        final List<byte[]> writes = stream(23);
+
+        assertEquals(2, writes.size());
+        assertEquals(20, writes.get(0).length);
+        assertEquals(4, writes.get(1).length);
+    }
+
+    @Test
+    public void streamFramesStopAtTheCharacteristicLengthAtTheLargestMtu() {
+        // The app asks for an MTU of 517, but the clock refuses values over 20 bytes
+        final List<byte[]> writes = stream(517);
+
+        assertEquals(2, writes.size());
+        assertEquals(ClockProtocol.MAX_FRAME_LEN, writes.get(0).length);
+        assertEquals(4, writes.get(1).length);
+        assertArrayEquals(MESSAGE.encode(), concat(writes, 1));
+    }
+
+    @Test
+    public void lastStreamFrameCarriesOneCharacterWhenTheMessageLeavesOne() {
+        // 7 characters a frame take 21 of the 22
+        final List<byte[]> writes = stream(ClockProtocol.ATT_WRITE_OVERHEAD + 8);
+
+        assertEquals(4, writes.size());
+        // Never a single byte, which the clock would take as a character
+        assertEquals(2, writes.get(3).length);
+    }
+
+    @Test
+    public void streamFramesOfOneCharacterAtTheSmallestMtu() {
+        final List<byte[]> writes = stream(ClockProtocol.ATT_WRITE_OVERHEAD + 2);
+
+        assertEquals(ClockMessage.LENGTH, writes.size());
+        for (byte[] write : writes) {
+            assertEquals(2, write.length);
+        }
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void streamRejectsMtuWithoutRoomForData() {
+        stream(ClockProtocol.ATT_WRITE_OVERHEAD + 1);
+    }
+
+    @Test
+    public void streamFramesAreNumberedFromZeroAndReassemble() {
+        for (int mtu = ClockProtocol.ATT_WRITE_OVERHEAD + 2; mtu <= 517; mtu++) {
+            final List<byte[]> writes = stream(mtu);
+
+            for (int seq = 0; seq < writes.size(); seq++) {
+                final byte[] write = writes.get(seq);
+                assertEquals(seq, write[0] & 0xFF);
+                assertTrue(write.length > 1);
+                assertTrue(write.length <= mtu - ClockProtocol.ATT_WRITE_OVERHEAD);
+                assertTrue(write.length <= ClockProtocol.MAX_FRAME_LEN);
+            }
+            if (mtu >= 23) {
+                // Sent without waiting for an acknowledgement
+                assertTrue(writes.size() <= ClockProtocol.STREAM_WINDOW);
+            }
+            assertArrayEquals(MESSAGE.encode(), concat(writes, 1));
+        }
+    }
+
+    @Test
+    public void sendDeliversTheMessage() {
+        final FakeClockTransport transport = new FakeClockTransport(7500, 23, 4);
+
+        assertEquals(2, ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.STREAM));
+        assertEquals(ClockMessage.LENGTH, ClockProtocol.send(transport, MESSAGE,
+                ClockProtocol.Framing.BYTES));
+
+        assertEquals(2, transport.getReceived().size());
+        assertEquals(MESSAGE, transport.getReceived().get(0));
+        assertEquals(MESSAGE, transport.getReceived().get(1));
+        assertEquals(0, transport.getRejectedFrameCount());
+    }
+
+    @Test
+    public void onlyIdempotentWritesAreSentAgainAfterATimeout() {
+        assertTrue(ClockProtocol.maySendAgain(true, true));
+        assertFalse(ClockProtocol.maySendAgain(false, true));
+        // Refused by the clock, so it did not take it
+        assertTrue(ClockProtocol.maySendAgain(false, false));
+    }
+
+    private static List<byte[]> stream(int mtu) {
+        return ClockProtocol.frame(MESSAGE, ClockProtocol.Framing.STREAM, mtu);
+    }
+
+    private static byte[] concat(List<byte[]> writes, int skip) {
+        final ByteArrayOutputStream out = new ByteArrayOutputStream();
+        for (byte[] write : writes) {
+            out.write(write, skip, write.length - skip);
+        }
+        return out.toByteArray();
+    }
+}
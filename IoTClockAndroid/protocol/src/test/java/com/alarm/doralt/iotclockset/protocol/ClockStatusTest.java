@@ -0,0 +1,87 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+
+import java.util.Calendar;
+import java.util.GregorianCalendar;
+import java.util.TimeZone;
+
+import org.junit.Test;
+
+public class ClockStatusTest {
+    // Manufacturer specific data of a clock at 2024-03-09 07:05 with an alarm at 06:30,
+    // firmware 1.0 and 3 V, as the firmware advertises it after the company identifier
+    private static final byte[] ADVERTISED = {
+            0x02,
+            0x09, (byte) 0xDE, (byte) 0xB2, 0x01,
+            (byte) 0x86, 0x01,
+            0x03,
+            0x00, 0x01,
+            0x60,
+    };
+
+    @Test
+    public void decodesTheAdvertisedPayload() {
+        final ClockStatus status = ClockStatus.decode(ADVERTISED);
+
+        assertEquals(localSeconds(2024, Calendar.MARCH, 9, 7, 5, 0) / 60,
+                status.getEpochMinutes());
+        assertEquals(6 * 60 + 30, status.getNextAlarm());
+        assertTrue(status.isTimeSet());
+        assertEquals(ClockStatus.FLAG_TIME_SET | ClockStatus.FLAG_ALARM_ARMED,
+                status.getFlags());
+        assertEquals(0x0100, status.getFirmwareVersion());
+        assertEquals(0x60, status.getBatteryVoltage());
+    }
+
+    @Test
+    public void clockOnTimeIsWithinTheThreshold() {
+        final SkewEstimate estimate = new SkewEstimate();
+
+        // Seen 30 s into the advertised minute by a phone on the same local time
+        estimate.add(ClockStatus.decode(ADVERTISED).getEpochMinutes(),
+                localSeconds(2024, Calendar.MARCH, 9, 7, 5, 30));
+
+        assertTrue(estimate.isWithin(60));
+        assertFalse(estimate.isBeyond(60));
+    }
+
+    @Test
+    public void clockTwoMinutesSlowIsBeyondTheThreshold() {
+        final SkewEstimate estimate = new SkewEstimate();
+
+        estimate.add(ClockStatus.decode(ADVERTISED).getEpochMinutes(),
+                localSeconds(2024, Calendar.MARCH, 9, 7, 7, 30));
+
+        assertTrue(estimate.isBeyond(60));
+    }
+
+    @Test
+    public void ignoresTheVersionOneLayout() {
+        final byte[] data = ADVERTISED.clone();
+        data[0] = 1;
+
+        assertNull(ClockStatus.decode(data));
+    }
+
+    @Test
+    public void ignoresShortData() {
+        final byte[] data = new byte[ClockStatus.LENGTH - 1];
+        System.arraycopy(ADVERTISED, 0, data, 0, data.length);
+
+        assertNull(ClockStatus.decode(data));
+        assertNull(ClockStatus.decode(null));
+    }
+
+    // Local wall clock time in seconds since 1970, counted as if it were UTC
+    private static long localSeconds(int year, int month, int day, int hour, int minute,
+                                     int second) {
+        final Calendar calendar = new GregorianCalendar(TimeZone.getTimeZone("UTC"));
+        calendar.clear();
+        calendar.set(year, month, day, hour, minute, second);
+        return calendar.getTimeInMillis() / 1000;
+    }
+}
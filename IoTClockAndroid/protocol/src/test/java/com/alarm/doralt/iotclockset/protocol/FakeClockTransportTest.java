@@ -0,0 +1,155 @@
+package com.alarm.doralt.iotclockset.protocol;
+
+import static org.junit.Assert.assertEquals;
+
+import org.junit.Test;
+
+public class FakeClockTransportTest {
+    private static final long INTERVAL_US = 7500;
+    private static final ClockMessage MESSAGE = new ClockMessage(2024, 3, 9, 7, 5, 6, 30);
+
+    @Test
+    public void writeRequestTakesTwoEvents() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+
+        transport.write(new byte[] {'2'}, true);
+
+        // Sent in event 0, answered in event 1
+        assertEquals(2 * INTERVAL_US, transport.getElapsedUs());
+        assertEquals(1, transport.getPacketCount());
+    }
+
+    @Test
+    public void bytesFramingWaitsForEveryResponse() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.BYTES);
+
+        // Write n goes out in event 2n and is answered in event 2n + 1
+        assertEquals(2 * ClockMessage.LENGTH * INTERVAL_US, transport.getElapsedUs());
+        assertEquals(ClockMessage.LENGTH, transport.getWriteCount());
+        assertEquals(ClockMessage.LENGTH, transport.getPacketCount());
+    }
+
+    @Test
+    public void writeCommandsShareAnEvent() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.STREAM);
+
+        assertEquals(INTERVAL_US, transport.getElapsedUs());
+        assertEquals(2, transport.getPacketCount());
+    }
+
+    @Test
+    public void writeCommandsSpillIntoTheNextEvent() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 1);
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.STREAM);
+
+        assertEquals(2 * INTERVAL_US, transport.getElapsedUs());
+    }
+
+    @Test
+    public void largeMtuSendsTheSameFrames() {
+        // Frames stop at 20 bytes, which with 3 ATT + 4 L2CAP header bytes fill one packet
+        final FakeClockTransport onePerEvent = new FakeClockTransport(INTERVAL_US, 517, 1);
+        final FakeClockTransport twoPerEvent = new FakeClockTransport(INTERVAL_US, 517, 2);
+
+        ClockProtocol.send(onePerEvent, MESSAGE, ClockProtocol.Framing.STREAM);
+        ClockProtocol.send(twoPerEvent, MESSAGE, ClockProtocol.Framing.STREAM);
+
+        assertEquals(2, onePerEvent.getWriteCount());
+        assertEquals(2, onePerEvent.getPacketCount());
+        assertEquals(2 * INTERVAL_US, onePerEvent.getElapsedUs());
+        assertEquals(INTERVAL_US, twoPerEvent.getElapsedUs());
+        assertEquals(MESSAGE, twoPerEvent.getReceived().get(0));
+    }
+
+    @Test
+    public void elapsedScalesWithTheInterval() {
+        final FakeClockTransport fast = new FakeClockTransport(INTERVAL_US, 23, 4);
+        final FakeClockTransport slow = new FakeClockTransport(1000000, 23, 4);
+
+        ClockProtocol.send(fast, MESSAGE, ClockProtocol.Framing.BYTES);
+        ClockProtocol.send(slow, MESSAGE, ClockProtocol.Framing.BYTES);
+
+        assertEquals(fast.getElapsedUs() * 1000000 / INTERVAL_US, slow.getElapsedUs());
+    }
+
+    @Test
+    public void resetClearsTimeAndCounters() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.BYTES);
+        transport.reset();
+
+        assertEquals(0, transport.getElapsedUs());
+        assertEquals(0, transport.getWriteCount());
+        assertEquals(0, transport.getPacketCount());
+        assertEquals(0, transport.getReceived().size());
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.STREAM);
+        assertEquals(INTERVAL_US, transport.getElapsedUs());
+    }
+
+    @Test
+    public void lostResponseFailsTheRestOfABytesMessage() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+        transport.loseResponse(5);
+
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.BYTES);
+
+        // The sixth character reached the clock; sent again it would shift the rest
+        assertEquals(6, transport.getWriteCount());
+        assertEquals(ClockMessage.LENGTH - 5, transport.getFailedWriteCount());
+        assertEquals(0, transport.getReceived().size());
+
+        transport.reset();
+        ClockProtocol.send(transport, MESSAGE, ClockProtocol.Framing.BYTES);
+        assertEquals(0, transport.getFailedWriteCount());
+        assertEquals(MESSAGE, transport.getReceived().get(0));
+    }
+
+    @Test
+    public void idempotentWriteIsSentAgainAfterALostResponse() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+        transport.setIdempotent(true);
+        transport.loseResponse(0);
+
+        transport.write(new byte[] {'2'}, true);
+
+        // Sent in event 0, timed out, sent again in the event after the timeout and answered
+        assertEquals(2, transport.getWriteCount());
+        assertEquals(0, transport.getFailedWriteCount());
+        assertEquals((FakeClockTransport.RESPONSE_TIMEOUT_US / INTERVAL_US + 3) * INTERVAL_US,
+                transport.getElapsedUs());
+    }
+
+    @Test
+    public void outOfSequenceFrameIsRejected() {
+        final FakeClockTransport transport = new FakeClockTransport(INTERVAL_US, 23, 4);
+        final byte[] frame = ClockProtocol.frame(MESSAGE, ClockProtocol.Framing.STREAM, 23)
+                .get(1);
+
+        transport.write(frame, false);
+
+        assertEquals(1, transport.getRejectedFrameCount());
+        assertEquals(0, transport.getReceived().size());
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void rejectsValueLongerThanTheMtu() {
+        new FakeClockTransport(INTERVAL_US, 23, 4).write(new byte[21], false);
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void rejectsValueLongerThanTheCharacteristic() {
+        new FakeClockTransport(INTERVAL_US, 517, 4).write(new byte[21], false);
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void rejectsMtuBelowTheMinimum() {
+        new FakeClockTransport(INTERVAL_US, 22, 4);
+    }
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+
+ @file  clock_status.c
+
+ @brief This file contains the encoding of the clock status shared by the
+        advertising data and Characteristic 7.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "clock_status.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define CLOCK_STATUS_EPOCH_YEAR               1970
+
+// Leap years before CLOCK_STATUS_EPOCH_YEAR
+#define CLOCK_STATUS_EPOCH_LEAPS              (1969 / 4 - 1969 / 100 + \
+                                               1969 / 400)
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      ClockStatus_epochMinutes
+ *
+ * @brief   Local time in minutes since 1 January 1970.
+ *
+ * @param   pLocal - local time.
+ *
+ * @return  Minutes, 0 before 1970.
+ */
+uint32_t ClockStatus_epochMinutes(const struct tm *pLocal)
+{
+  uint32_t year = pLocal->tm_year + 1900;
+  uint32_t days;
+
+  if (pLocal->tm_year < CLOCK_STATUS_EPOCH_YEAR - 1900)
+  {
+    return (0);
+  }
+
+  // Days before this year, then into it
+  days = (year - CLOCK_STATUS_EPOCH_YEAR) * 365 +
+         ((year - 1) / 4 - (year - 1) / 100 + (year - 1) / 400) -
+         CLOCK_STATUS_EPOCH_LEAPS +
+         pLocal->tm_yday;
+
+  return (days * 24 * 60 + pLocal->tm_hour * 60 + pLocal->tm_min);
+}
+
+/*********************************************************************
+ * @fn      ClockStatus_build
+ *
+ * @brief   Fill in the status: minutes since the epoch, the next alarm
+ *          as minute of the day and the flags, all little endian.
+ *
+ * @param   pStatus      - CLOCK_STATUS_LEN bytes to fill in.
+ * @param   epochMinutes - local time in minutes since 1970.
+ * @param   nextAlarm    - next alarm, 0xFFFF if none.
+ * @param   flags        - status flags.
+ *
+ * @return  None.
+ */
+void ClockStatus_build(uint8_t *pStatus, uint32_t epochMinutes,
+                       uint16_t nextAlarm, uint8_t flags)
+{
+  pStatus[0] = (uint8_t)(epochMinutes);
+  pStatus[1] = (uint8_t)(epochMinutes >> 8);
+  pStatus[2] = (uint8_t)(epochMinutes >> 16);
+  pStatus[3] = (uint8_t)(epochMinutes >> 24);
+  pStatus[4] = (uint8_t)(nextAlarm);
+  pStatus[5] = (uint8_t)(nextAlarm >> 8);
+  pStatus[6] = flags;
+}
+
+/*********************************************************************
+*********************************************************************/
@@ -0,0 +1,77 @@
+/******************************************************************************
+
+ @file  clock_status.h
+
+ @brief This file contains the encoding of the clock status shared by the
+        advertising data and Characteristic 7. It has no target
+        dependencies, so it is also built and tested on the host.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+#ifndef CLOCK_STATUS_H
+#define CLOCK_STATUS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+#include <time.h>
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Length of the encoded status:
+// [epoch minutes (4)][next alarm (2)][flags]
+#define CLOCK_STATUS_LEN                      7
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*
+ * ClockStatus_epochMinutes - Local time in minutes since 1 January 1970,
+ *          counted from the calendar fields so that neither the run-time
+ *          library's time_t epoch (1900 on the TI compiler) nor its time
+ *          zone matter. 0 before 1970.
+ *
+ *    pLocal - local time, tm_year, tm_yday, tm_hour and tm_min are used
+ */
+extern uint32_t ClockStatus_epochMinutes(const struct tm *pLocal);
+
+/*
+ * ClockStatus_build - Fill in CLOCK_STATUS_LEN bytes of status, all
+ *          little endian.
+ *
+ *    pStatus      - buffer to fill in
+ *    epochMinutes - from ClockStatus_epochMinutes(), 0 if the time is not
+ *                   set
+ *    nextAlarm    - minute of the day of the next alarm, 0xFFFF if none
+ *    flags        - status flags
+ */
+extern void ClockStatus_build(uint8_t *pStatus, uint32_t epochMinutes,
+                              uint16_t nextAlarm, uint8_t flags);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_STATUS_H */
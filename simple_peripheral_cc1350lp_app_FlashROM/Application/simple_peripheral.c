@@ -51,13 +51,14 @@
 
 #include <stdint.h>
 #include <ti/sysbios/hal/Seconds.h>
+#include <ti/sysbios/hal/Hwi.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <ti/sysbios/knl/Task.h>
 #include <ti/sysbios/knl/Clock.h>
-#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Event.h>
 #include <ti/sysbios/knl/Queue.h>
 /* Driver Header files */
 #include <ti/drivers/Power.h>
@@ -65,6 +66,7 @@
 #include <ti/drivers/PIN.h>
 #include <ti/drivers/pin/PINCC26XX.h>
 #include <ti/drivers/PWM.h>
+#include <driverlib/aon_batmon.h>
 /* Example/Board Header files */
 #include "Board.h"
 #include "hci_tl.h"
@@ -74,6 +76,9 @@
 #include "gattservapp.h"
 #include "devinfoservice.h"
 #include "simple_gatt_profile.h"
+#include "mailbox_profile.h"
+#include "cts_profile.h"
+#include "diag_profile.h"
 #include "sysctl.h"
 
 #if defined(FEATURE_OAD) || defined(IMAGE_INVALIDATE)
@@ -103,6 +108,8 @@
 #include "board.h"
 
 #include "simple_peripheral.h"
+#include "timebase.h"
+#include "clock_status.h"
 
 #if defined( USE_FPGA ) || defined( DEBUG_SW_TRACE )
 #include <driverlib/ioc.h>
@@ -111,38 +118,40 @@
 /*********************************************************************
  * CONSTANTS
  */
-// Advertising interval when device is discoverable (units of 625us, 160=100ms)
-#define DEFAULT_ADVERTISING_INTERVAL          160
+// Number of advertising interval steps, see advSteps
+#define SBP_ADV_NUM_STEPS                     4
 
 // Limited discoverable mode advertises for 30.72s, and then stops
 // General discoverable mode advertises indefinitely
 #define DEFAULT_DISCOVERABLE_MODE             GAP_ADTYPE_FLAGS_GENERAL
 
-#ifndef FEATURE_OAD
-// Minimum connection interval (units of 1.25ms, 80=100ms) if automatic
-// parameter update request is enabled
-#define DEFAULT_DESIRED_MIN_CONN_INTERVAL     80
+// Minimum connection interval (units of 1.25ms, 400=500ms) if automatic
+// parameter update request is enabled. This is the idle setting; see
+// SBP_FAST_CONN_* for the interval used while data is being transferred.
+#define DEFAULT_DESIRED_MIN_CONN_INTERVAL     400
 
 // Maximum connection interval (units of 1.25ms, 800=1000ms) if automatic
 // parameter update request is enabled
 #define DEFAULT_DESIRED_MAX_CONN_INTERVAL     800
-#else //!FEATURE_OAD
-// Minimum connection interval (units of 1.25ms, 8=10ms) if automatic
-// parameter update request is enabled
-#define DEFAULT_DESIRED_MIN_CONN_INTERVAL     8
-
-// Maximum connection interval (units of 1.25ms, 8=10ms) if automatic
-// parameter update request is enabled
-#define DEFAULT_DESIRED_MAX_CONN_INTERVAL     8
-#endif // FEATURE_OAD
 
 // Slave latency to use if automatic parameter update request is enabled
-#define DEFAULT_DESIRED_SLAVE_LATENCY         0
+#define DEFAULT_DESIRED_SLAVE_LATENCY         3
 
 // Supervision timeout value (units of 10ms, 1000=10s) if automatic parameter
-// update request is enabled
+// update request is enabled. Must exceed 2 * (1 + latency) * max interval.
 #define DEFAULT_DESIRED_CONN_TIMEOUT          1000
 
+// Connection parameters requested while a time-set, alarm sync or OAD
+// session is in progress (units of 1.25ms, 6=7.5ms, 12=15ms)
+#define SBP_FAST_CONN_MIN_INTERVAL            6
+#define SBP_FAST_CONN_MAX_INTERVAL            12
+#define SBP_FAST_CONN_SLAVE_LATENCY           0
+#define SBP_FAST_CONN_TIMEOUT                 500
+
+// Time without transfer activity before the idle parameters are
+// requested again (in msec)
+#define SBP_CONN_IDLE_TIMEOUT                 5000
+
 // Whether to enable automatic parameter update request when a connection is
 // formed
 #define DEFAULT_ENABLE_UPDATE_REQUEST         GAPROLE_LINK_PARAM_UPDATE_INITIATE_BOTH_PARAMS
@@ -150,9 +159,6 @@
 // Connection Pause Peripheral time value (in seconds)
 #define DEFAULT_CONN_PAUSE_PERIPHERAL         6
 
-// How often to perform periodic event (in msec)
-#define SBP_PERIODIC_EVT_PERIOD               5000
-
 // Type of Display to open
 #if !defined(Display_DISABLE_ALL)
   #ifdef USE_CORE_SDK
@@ -185,15 +191,212 @@
 #define SBP_TASK_PRIORITY                     1
 
 
+// The deepest path, a time write through ManageTime() down to
+// localtime() in nextAlarm(), takes about 570 bytes plus the exception
+// and context switch frames; the diagnostics characteristic reports the
+// high water from Task_stat()
 #ifndef SBP_TASK_STACK_SIZE
-#define SBP_TASK_STACK_SIZE                   644
+#define SBP_TASK_STACK_SIZE                   800
 #endif
 
-// Internal Events for RTOS application
+// How often the clock display and alarm are refreshed (in msec)
+#define SBP_MINUTE_EVT_PERIOD                 60000
+
+// Company identifier used in the manufacturer specific advertising data
+// (0x000D = Texas Instruments)
+#define SBP_ADV_COMPANY_ID                    0x000D
+
+// Layout version of the status carried in the advertising data. Version 1
+// counted the time from 1900, the TI run-time library's time_t epoch.
+#define SBP_ADV_STATUS_VERSION                2
+
+// Length of the status payload following the company identifier
+#define SBP_ADV_STATUS_LEN                    11
+
+// Firmware version reported in the advertising data (major.minor)
+#define SBP_FW_VERSION                        0x0100
+
+// Status flags reported in the advertising data
+#define SBP_ADV_FLAG_TIME_SET                 0x01
+#define SBP_ADV_FLAG_ALARM_ARMED              0x02
+#define SBP_ADV_FLAG_RINGING                  0x04
+#define SBP_ADV_FLAG_DISMISSED                0x08
+
+// Number of ATT responses of one connection that can wait for an HCI
+// buffer at once
+#define SBP_ATT_RSP_QUEUE_SIZE                4
+
+// Number of Prepare Write requests the GATT server queues per connection;
+// enough for a full SIMPLEPROFILE_CHAR6_MAX_LEN value at the default MTU
+#define SBP_NUM_PREPARE_WRITES                12
+
+// Length of the "YYYY/MM/DD hh:mm hh:mm" time/alarm string
+#define SBP_TIME_STR_LEN                      22
+
+// Most CHAR3 stream frames a client may send ahead of the last
+// acknowledgement; fewer are granted while the application queue or the
+// heap is short
+#define SBP_STREAM_WINDOW                     8
+
+// Heap (in bytes) kept back from stream credits for the stack and the
+// other services
+#define SBP_STREAM_HEAP_RESERVE               1024
+
+// Heap taken by one queued stream frame of the largest size, including
+// the heap manager's block header
+#define SBP_STREAM_FRAME_COST                 (sizeof(sbpDataEvt_t) + \
+                                               SIMPLEPROFILE_CHAR3_MAX_LEN + 8)
+
+// Delay before retrying a stream acknowledgement or mailbox response that
+// found no buffer (in msec)
+#define SBP_TX_RETRY_PERIOD                   20
+
+// Number of log2 buckets in the statistics histograms
+#define SBP_HIST_BINS                         8
+
+// Latency classes: the application events, SBP_STATE_CHANGE_EVT to
+// SBP_CONN_PARAM_EVT, by event - 1, then OAD write requests and button
+// presses
+#define SBP_LAT_OAD                           7
+#define SBP_LAT_BUTTON                        8
+#define SBP_LAT_CLASSES                       9
+
+// Number of log2 buckets in the latency histograms, and the unit they
+// count in as a shift of microseconds (64 us, about two RTC ticks)
+#define SBP_LAT_BINS                          12
+#define SBP_LAT_UNIT_SHIFT                    6
+
+// Period of the diagnostics characteristic refresh while a client is
+// connected (in msec)
+#define SBP_DIAG_PERIOD                       60000
+
+// Layout version of the diagnostics characteristic, see
+// SimpleBLEPeripheral_buildDiag
+#define SBP_DIAG_VERSION                      1
+
+// Length of the clock status shared by the advertising data and
+// Characteristic 7: [epoch minutes (4)][next alarm (2)][flags]
+#define SBP_STATUS_LEN                        CLOCK_STATUS_LEN
+
+// Number of alarms the clock keeps
+#define SBP_MAX_ALARMS                        4
+
+// Hour of an unused alarm slot
+#define SBP_ALARM_FREE                        0xFF
+
+// SNV item holding the drift fit
+#define SBP_NVID_DRIFT                        BLE_NVID_CUST_START
+
+// SNV item holding the time and alarms
+#define SBP_NVID_CLOCK                        (BLE_NVID_CUST_START + 1)
+
+// Delay, in ms, gathering clock state changes into one SNV write
+#define SBP_SAVE_DELAY                        2000
+
+// Seconds after which the running time is written again
+#define SBP_SAVE_EPOCH_PERIOD                 600
+
+// Shortest sync interval, in seconds, added to the drift fit. With 1 s
+// resolution one interval resolves the drift to about 50 ppm.
+#define SBP_DRIFT_MIN_INTERVAL                21600
+
+// Seconds the drift fit must span before the clock is corrected
+#define SBP_DRIFT_MIN_SPAN                    86400
+
+// Largest drift, in ppm, believed; bigger errors mean the clock was wrong
+#define SBP_DRIFT_MAX_PPM                     500
+
+// 1.0 in the Q8 fixed point of the drift fit
+#define SBP_DRIFT_ONE                         256
+
+// Seconds the drift fit may span (2^23 minutes, about 16 years) before
+// it starts again, keeping its 64-bit sums in range
+#define SBP_DRIFT_MAX_FIT_SPAN                (0x7FFFFFUL * 60)
+
+// Layout version of the drift fit in SNV
+#define SBP_DRIFT_FIT_VERSION                 1
+
+// Mailbox request:  [seq][opcode][parameters...]
+// Mailbox response: [seq][opcode][status][data...]
+#define SBP_MBOX_REQ_HDR_LEN                  2
+#define SBP_MBOX_RSP_HDR_LEN                  3
+
+// Mailbox opcodes
+#define SBP_MBOX_OP_SET_TIME                  0x01
+#define SBP_MBOX_OP_ADD_ALARM                 0x02
+#define SBP_MBOX_OP_DEL_ALARM                 0x03
+#define SBP_MBOX_OP_LIST_ALARMS               0x04
+#define SBP_MBOX_OP_READ_STATS                0x05
+#define SBP_MBOX_OP_DISPLAY_TEXT              0x06
+#define SBP_MBOX_OP_DUMP                      0x07
+#define SBP_MBOX_OP_DRIFT                     0x08
+
+// Mailbox response status
+#define SBP_MBOX_SUCCESS                      0x00
+#define SBP_MBOX_ERR_OPCODE                   0x01
+#define SBP_MBOX_ERR_LENGTH                   0x02
+#define SBP_MBOX_ERR_PARAM                    0x03
+#define SBP_MBOX_ERR_NO_RESOURCES             0x04
+#define SBP_MBOX_ERR_BUSY                     0x05
+#define SBP_MBOX_MORE                         0x80  // A record, more follow
+
+// Handler status for requests answered later by the TX engine; never sent
+#define SBP_MBOX_PENDING                      0xFF
+
+// Transfer record: [seq][opcode][SBP_MBOX_MORE][index][data...]
+#define SBP_TX_HDR_LEN                        4
+#define SBP_TX_RECORD_LEN                     (MAILBOX_MAX_LEN - SBP_TX_HDR_LEN)
+
+// Transfer sources
+#define SBP_TX_SRC_ALARMS                     0x00
+#define SBP_TX_SRC_STATS                      0x01
+#define SBP_TX_SRC_LATENCY                    0x02
+
+// Number of mailbox responses held while notification buffers are out
+#define SBP_MBOX_RSP_QUEUE_SIZE               4
+
+// Number of mailbox requests, lost for want of heap, that are remembered
+// to be refused
+#define SBP_MBOX_DROP_QUEUE_SIZE              2
+
+// Characters shown by writeTime()
+#define SBP_DISPLAY_LEN                       14
+
+// Application message types passed from profiles
 #define SBP_STATE_CHANGE_EVT                  0x0001
 #define SBP_CHAR_CHANGE_EVT                   0x0002
-#define SBP_PERIODIC_EVT                      0x0004
-#define SBP_CONN_EVT_END_EVT                  0x0008
+#define SBP_BLOB_EVT                          0x0003
+#define SBP_STREAM_EVT                        0x0004
+#define SBP_MAILBOX_EVT                       0x0005
+#define SBP_CTS_EVT                           0x0006
+#define SBP_CONN_PARAM_EVT                    0x0007
+
+// Internal Events for RTOS application
+#define SBP_ICALL_EVT                         ICALL_MSG_EVENT_ID // Event_Id_31
+#define SBP_QUEUE_EVT                         UTIL_QUEUE_EVENT_ID // Event_Id_30
+#define SBP_CONN_EVT_END_EVT                  Event_Id_01
+#define SBP_MINUTE_EVT                        Event_Id_02
+#define SBP_OAD_QUEUE_EVT                     Event_Id_03
+#define SBP_CONN_IDLE_EVT                     Event_Id_04
+#define SBP_ADV_STEP_EVT                      Event_Id_05
+#define SBP_BUTTON_EVT                        Event_Id_06
+#define SBP_TX_RETRY_EVT                      Event_Id_07
+#define SBP_DIAG_EVT                          Event_Id_08
+#define SBP_MBOX_DROP_EVT                     Event_Id_09
+#define SBP_SAVE_EVT                          Event_Id_00
+
+#define SBP_ALL_EVENTS                        (SBP_ICALL_EVT        | \
+                                               SBP_QUEUE_EVT        | \
+                                               SBP_CONN_EVT_END_EVT | \
+                                               SBP_MINUTE_EVT       | \
+                                               SBP_OAD_QUEUE_EVT    | \
+                                               SBP_CONN_IDLE_EVT    | \
+                                               SBP_ADV_STEP_EVT     | \
+                                               SBP_BUTTON_EVT       | \
+                                               SBP_TX_RETRY_EVT     | \
+                                               SBP_DIAG_EVT         | \
+                                               SBP_MBOX_DROP_EVT    | \
+                                               SBP_SAVE_EVT)
 
 /*********************************************************************
  * TYPEDEFS
@@ -203,8 +406,203 @@
 typedef struct
 {
   appEvtHdr_t hdr;  // event header.
+  uint32_t queued;  // Timebase_now() when queued, low 32 bits
 } sbpEvt_t;
 
+// Characteristic 6 value or Characteristic 3 stream frame passed from
+// the profile.
+typedef struct
+{
+  appEvtHdr_t hdr;      // event header.
+  uint32_t queued;      // Timebase_now() when queued, low 32 bits
+  uint16_t connHandle;  // Connection the value was written on
+  uint16_t len;         // Length of pData
+  uint8_t *pData;       // Value, stored right after this structure
+} sbpDataEvt_t;
+
+// Receive state of one connection, for both the byte-by-byte protocol
+// and the Characteristic 3 stream.
+typedef struct
+{
+  uint16_t connHandle;  // Connection the state belongs to, or
+                        // INVALID_CONNHANDLE if the slot is free
+  uint8_t nextSeq;      // Stream sequence number expected next
+  uint8_t ackedSeq;     // Last stream sequence number acknowledged
+  uint8_t credits;      // Frames granted past ackedSeq by that acknowledgement
+  bool ackPending;      // An acknowledgement is waiting for a buffer
+  uint8_t rxLen;        // Bytes of the time/alarm string received
+  char rxBuf[SBP_TIME_STR_LEN + 1];  // Time/alarm string being received
+  uint8_t lastRspLen;   // Length of lastRsp, 0 if there is none
+  uint8_t lastRsp[MAILBOX_MAX_LEN];  // Final response to the last mailbox
+                                     // request that ran
+} sbpConnRx_t;
+
+// Event loop counters, one set for the lifetime of the task.
+typedef struct
+{
+  uint32_t wakeups;     // Number of times Event_pend returned
+  uint32_t stackMsgs;   // ICall stack messages processed
+  uint32_t appMsgs;     // Profile/application messages processed
+  uint32_t oadMsgs;     // OAD write requests processed
+  uint16_t maxBatch;    // Most messages handled in a single wakeup
+  uint32_t maxWakeUs;   // Longest time spent on a single wakeup
+} sbpLoopStats_t;
+
+// One step of the advertising interval back-off.
+typedef struct
+{
+  uint16_t minInt;    // Minimum advertising interval (units of 625us)
+  uint16_t maxInt;    // Maximum advertising interval (units of 625us)
+  uint32_t duration;  // Time spent in this step (in msec), 0 = forever
+} sbpAdvStep_t;
+
+// ATT response waiting for an HCI buffer.
+typedef struct
+{
+  gattMsgEvent_t *pMsg;  // Response message to retransmit
+  uint8_t retries;       // Retransmission attempts so far
+} sbpAttRsp_t;
+
+// ATT responses of one connection, oldest first.
+typedef struct
+{
+  uint16_t connHandle;   // INVALID_CONNHANDLE if the slot is free
+  uint8_t head;
+  uint8_t count;
+  sbpAttRsp_t rsp[SBP_ATT_RSP_QUEUE_SIZE];
+} sbpAttRspQueue_t;
+
+// One alarm. The alarm rings on the weekdays set in days, bit 0 being
+// Sunday; with no day set it rings once and frees its slot.
+typedef struct
+{
+  uint8_t hour;    // Hour, or SBP_ALARM_FREE
+  uint8_t minute;  // Minute
+  uint8_t days;    // Weekday mask, 0 = once
+} sbpAlarm_t;
+
+// Mailbox command handler. Parameters follow the request header; data
+// written to pRsp follows the response header.
+typedef uint8_t (*sbpMboxHandler_t)(uint8_t *pParams, uint8_t len,
+                                    uint8_t *pRsp, uint8_t *pRspLen);
+
+// Mailbox opcode table entry.
+typedef struct
+{
+  uint8_t opcode;               // Request opcode
+  uint8_t minLen;               // Fewest parameter bytes accepted
+  uint8_t maxLen;               // Most parameter bytes accepted
+  sbpMboxHandler_t pfnHandler;  // Command handler
+} sbpMboxCmd_t;
+
+// Mailbox response waiting for a notification buffer.
+typedef struct
+{
+  uint16_t connHandle;              // Connection the request came from
+  uint8_t len;                      // Length of data
+  uint8_t data[MAILBOX_MAX_LEN];    // Response
+} sbpMboxRsp_t;
+
+// Mailbox request the application queue could not take.
+typedef struct
+{
+  uint16_t connHandle;  // Connection the request came from
+  uint8_t seq;          // Sequence number of the request
+  uint8_t opcode;       // Opcode of the request
+} sbpMboxDrop_t;
+
+// Transfer source: fills in record index and returns its length, at most
+// SBP_TX_RECORD_LEN, or 0 past the last record. Records are fetched again
+// when the controller had no buffer for them.
+typedef uint8_t (*sbpTxSource_t)(uint16_t index, uint8_t *pBuf);
+
+// Bulk transfer in progress.
+typedef struct
+{
+  uint16_t connHandle;       // Client, or INVALID_CONNHANDLE when idle
+  uint8_t seq;               // Sequence number of the request
+  uint8_t opcode;            // Opcode of the request
+  sbpTxSource_t pfnSource;   // Records to send
+  uint16_t index;            // Next record
+} sbpTx_t;
+
+// Least squares fit of the clock error against time, in fixed point as
+// the Cortex-M3 has no FPU. The points are the cumulative minutes between
+// syncs and the seconds of error the uncorrected clock built up over
+// them, starting from (0, 0); the slope is the drift.
+typedef struct
+{
+  uint16_t samples;  // Sync intervals in the fit
+  uint8_t version;   // SBP_DRIFT_FIT_VERSION; 0 in the old double layout
+  uint32_t spanX;    // Seconds covered by the intervals
+  int32_t errY;      // Error built up over them, seconds
+  int64_t meanX;     // Mean of the points, minutes and seconds, Q8
+  int64_t meanY;
+  int64_t cxx;       // Sum of squared x deviations, minutes^2
+  int64_t cxy;       // Sum of products of x and y deviations, Q8
+} sbpDriftFit_t;
+
+// Clock state kept in SNV to recover from a reset.
+typedef struct
+{
+  UInt32 epoch;                       // Seconds_get() when saved, 0 if
+                                      // the time was not set
+  uint32_t rtcSecs;                   // Timebase seconds when saved, only
+                                      // meaningful until the next reset
+  sbpAlarm_t alarms[SBP_MAX_ALARMS];  // Alarm table
+  bool ringing;                       // An alarm rings until dismissed
+} sbpClockState_t;
+
+// Bulk transfer statistics.
+typedef struct
+{
+  uint32_t records;     // Records handed to the controller
+  uint32_t bufferFull;  // Times a transfer waited for buffers
+} sbpTxStats_t;
+
+// ATT response retransmission statistics. Bucket n of each histogram
+// counts responses that took between 2^(n-1) and 2^n - 1 retries.
+typedef struct
+{
+  uint16_t sentHist[SBP_HIST_BINS];    // Responses eventually sent
+  uint16_t failedHist[SBP_HIST_BINS];  // Responses given up on
+  uint16_t dropped;                    // Responses that found the queue full
+  uint32_t retries;                    // Retransmissions of all responses
+} sbpAttRspStats_t;
+
+#ifdef FEATURE_OAD
+// OAD write request passed from the profile.
+typedef struct
+{
+  oadTargetWrite_t write;  // Request; its data is stored right after this
+  uint32_t queued;         // Timebase_now() when queued, low 32 bits
+} sbpOadEvt_t;
+#endif //FEATURE_OAD
+
+// Latency histograms of one class of events. Bucket n of each histogram
+// counts events that took between 2^(n-1) and 2^n - 1 units of
+// 2^SBP_LAT_UNIT_SHIFT microseconds.
+typedef struct
+{
+  uint16_t queuedHist[SBP_LAT_BINS];   // From enqueue to dispatch
+  uint16_t handledHist[SBP_LAT_BINS];  // Time in the handler
+} sbpLatHist_t;
+
+// Resource and latency counters shown by the diagnostics characteristic.
+typedef struct
+{
+  uint16_t appQueueDepth;   // Messages in the application queue
+  uint16_t appQueueMax;     // Most messages the application queue held
+  uint32_t heapMinFree;     // Least free ICall heap seen by sampleHeap()
+  uint16_t allocFailures;   // Messages lost to a full ICall heap
+  uint16_t fcViolations;    // ATT flow control violations
+  uint16_t oadIdentify;     // OAD image identify requests
+  uint16_t oadDropped;      // OAD write requests lost to a full heap
+  uint32_t lcdWrites;       // Calls to writeTime()
+  uint32_t lcdUs;           // Time spent in writeTime(), microseconds
+  uint32_t lcdMaxUs;        // Longest writeTime(), microseconds
+} sbpDiagStats_t;
+
 /*********************************************************************
  * GLOBAL VARIABLES
  */
@@ -212,6 +610,13 @@ typedef struct
 // Display Interface
 Display_Handle dispHandle = NULL;
 
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+// GAPRole task, for its stack usage
+extern Task_Struct gapRoleTask;
+
 /*********************************************************************
  * LOCAL VARIABLES
  */
@@ -219,11 +624,48 @@ Display_Handle dispHandle = NULL;
 // Entity ID globally used to check for source and/or destination of messages
 static ICall_EntityID selfEntity;
 
-// Semaphore globally used to post events to the application thread
-static ICall_Semaphore sem;
+// Event globally used to post local events and pend on system and
+// local events.
+static ICall_SyncHandle syncEvent;
 
 // Clock instances for internal periodic events.
-static Clock_Struct periodicClock;
+static Clock_Struct minuteClock;
+static Clock_Struct connIdleClock;
+static Clock_Struct advStepClock;
+static Clock_Struct txRetryClock;
+static Clock_Struct saveClock;
+static Clock_Struct diagClock;
+
+// Per-connection receive state, linkDBNumConns slots
+static sbpConnRx_t *connRx = NULL;
+
+// Advertising interval back-off: a fast burst after boot, disconnect,
+// button press or alarm, then stepwise slower down to 1-2 s.
+static const sbpAdvStep_t advSteps[SBP_ADV_NUM_STEPS] =
+{
+  {   32,   48, 30000 },  // 20-30 ms for 30 s
+  {  160,  240, 30000 },  // 100-150 ms for 30 s
+  {  800, 1200, 60000 },  // 500-750 ms for 1 min
+  { 1600, 3200,     0 }   // 1-2 s until the next acceleration
+};
+
+// Current step in advSteps
+static uint8_t advStep = 0;
+
+// TRUE while advertising is stopped only to pick up a new interval
+static bool advRestartPending = FALSE;
+
+// TRUE while the link runs at a fast connection interval, as last
+// reported by the controller
+static bool fastConnActive = FALSE;
+
+// TRUE from a request for the fast parameters until the link reports
+// new parameters or goes idle, so that activity does not repeat it
+static bool fastConnRequested = FALSE;
+
+// The clock status changed and goes out at the end of the next connection
+// event; changes until then share the one notification
+static bool statusPending = FALSE;
 
 // Queue object used for app messages
 static Queue_Struct appMsg;
@@ -235,11 +677,37 @@ static Queue_Struct oadQ;
 static Queue_Handle hOadQ;
 #endif //FEATURE_OAD
 
-// events flag for internal application events.
-static uint16_t events;
+// Event loop counters
+static sbpLoopStats_t sbpLoopStats;
+
+// Diagnostics counters; the heap minimum starts above any heap size
+static sbpDiagStats_t diagStats = { 0, 0, 0xFFFFFFFF };
+
+// Event latency histograms, indexed by SBP_LAT_*
+static sbpLatHist_t latHist[SBP_LAT_CLASSES];
+
+// Timebase_now() of the last button press, low 32 bits
+static volatile uint32_t buttonPressed;
+
 struct tm ltm;
 static int timeToSet[5];
 static int wantedTime[2];
+
+// Alarm table. Slot 0 belongs to the text configuration.
+static sbpAlarm_t alarms[SBP_MAX_ALARMS];
+
+// Clock state last written to SNV
+static sbpClockState_t savedClock;
+
+// Drift fit, kept in SNV, and the correction made from it
+static sbpDriftFit_t driftFit;
+static int32_t driftPpb = 0;         // Drift corrected, parts per billion
+static int32_t driftAccNs = 0;       // Correction due, nanoseconds
+
+// Sync interval being measured
+static bool driftAnchorValid = FALSE;
+static UInt32 driftAnchor;           // Reference time the interval started
+static int32_t driftRemoved = 0;     // Seconds taken off the clock in it
 static PIN_Handle buttonPinHandle;
 static PIN_Handle ledPinHandle;
 static PIN_State buttonPinState;
@@ -252,7 +720,7 @@ Task_Struct sbpTask;
 Char sbpTaskStack[SBP_TASK_STACK_SIZE];
 
 // Profile state and parameters
-//static gaprole_States_t gapProfileState = GAPROLE_INIT;
+static gaprole_States_t gapProfileState = GAPROLE_INIT;
 
 // GAP - SCAN RSP data (max size = 31 bytes)
 static uint8_t scanRspData[] =
@@ -283,7 +751,7 @@ static uint8_t scanRspData[] =
   // connection interval range
   0x05,   // length of this data
   GAP_ADTYPE_SLAVE_CONN_INTERVAL_RANGE,
-  LO_UINT16(DEFAULT_DESIRED_MIN_CONN_INTERVAL),   // 100ms
+  LO_UINT16(DEFAULT_DESIRED_MIN_CONN_INTERVAL),   // 500ms
   HI_UINT16(DEFAULT_DESIRED_MIN_CONN_INTERVAL),
   LO_UINT16(DEFAULT_DESIRED_MAX_CONN_INTERVAL),   // 1s
   HI_UINT16(DEFAULT_DESIRED_MAX_CONN_INTERVAL),
@@ -319,21 +787,54 @@ static uint8_t advertData[] =
 #endif //FEATURE_OAD
 #ifndef FEATURE_OAD_ONCHIP
   LO_UINT16(SIMPLEPROFILE_SERV_UUID),
-  HI_UINT16(SIMPLEPROFILE_SERV_UUID)
+  HI_UINT16(SIMPLEPROFILE_SERV_UUID),
 #endif //FEATURE_OAD_ONCHIP
+
+  // clock status, refreshed on every minute tick so that it can be
+  // monitored with a passive scan. Must stay the last field; see
+  // SimpleBLEPeripheral_updateAdvertData.
+  SBP_ADV_STATUS_LEN + 3,   // length of this data
+  GAP_ADTYPE_MANUFACTURER_SPECIFIC,
+  LO_UINT16(SBP_ADV_COMPANY_ID),
+  HI_UINT16(SBP_ADV_COMPANY_ID),
+  SBP_ADV_STATUS_VERSION,
+  0x00, 0x00, 0x00, 0x00,   // local time, minutes since 1970 (LSB first),
+                            // see ClockStatus_epochMinutes
+  0xFF, 0xFF,               // next alarm, minute of the day (0xFFFF = none)
+  0x00,                     // SBP_ADV_FLAG_* status flags
+  LO_UINT16(SBP_FW_VERSION),
+  HI_UINT16(SBP_FW_VERSION),
+  0x00                      // battery voltage (units of 1/32 V)
 };
 static int firstPress = 1;
 // GAP GATT Attributes
 static uint8_t attDeviceName[GAP_DEVICE_NAME_LEN] = "Simple BLE Peripheral";
 
-// Globals used for ATT Response retransmission
-static gattMsgEvent_t *pAttRsp = NULL;
-static uint8_t rspTxRetry = 0;
+// Globals used for ATT Response retransmission, linkDBNumConns queues
+static sbpAttRspQueue_t *attRspQueues = NULL;
+static sbpAttRspStats_t attRspStats;
+
+#ifndef FEATURE_OAD_ONCHIP
+// Mailbox responses waiting for a notification buffer
+static sbpMboxRsp_t mboxRspQueue[SBP_MBOX_RSP_QUEUE_SIZE];
+static uint8_t mboxRspHead = 0;
+static uint8_t mboxRspCount = 0;
+
+// Mailbox requests lost in the stack context, to be refused by the task
+static sbpMboxDrop_t mboxDrops[SBP_MBOX_DROP_QUEUE_SIZE];
+static uint8_t mboxDropCount = 0;
+
+// Bulk transfer state, one transfer at a time
+static sbpTx_t tx = { INVALID_CONNHANDLE };
+static sbpTxStats_t txStats;
+#endif //!FEATURE_OAD_ONCHIP
 
 /*********************************************************************
  * LOCAL FUNCTIONS
  */
 static void writeTime(char time[]);
+static void ManageTime(char *timeStr);
+static void setTime(int year, int month, int day, int hour, int min);
 static void resetScreen(void);
 static void chooseScreen2x16(void);
 static void writeSpaces(void);
@@ -348,16 +849,117 @@ static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg);
 static void SimpleBLEPeripheral_processAppMsg(sbpEvt_t *pMsg);
 static void SimpleBLEPeripheral_processStateChangeEvt(gaprole_States_t newState);
 static void SimpleBLEPeripheral_processCharValueChangeEvt(uint8_t paramID);
-static void SimpleBLEPeripheral_performPeriodicTask(void);
+static void SimpleBLEPeripheral_performMinuteTask(void);
+static void SimpleBLEPeripheral_updateAdvertData(void);
+static void SimpleBLEPeripheral_buildStatus(uint8_t *pStatus);
+static void SimpleBLEPeripheral_statusChanged(void);
+static void SimpleBLEPeripheral_sendStatus(void);
+static void SimpleBLEPeripheral_updateConnEvtNotice(uint16_t connHandle);
+static void SimpleBLEPeripheral_timeChanged(uint8_t adjustReason);
+static void SimpleBLEPeripheral_driftSync(UInt32 localSecs, UInt32 refSecs,
+                                          bool precise);
+static void SimpleBLEPeripheral_driftShift(UInt32 localSecs, UInt32 newSecs);
+static void SimpleBLEPeripheral_driftForget(void);
+static void SimpleBLEPeripheral_driftUpdate(void);
+static int8_t SimpleBLEPeripheral_driftCorrect(void);
+static void SimpleBLEPeripheral_buildClockState(sbpClockState_t *pState);
+static bool SimpleBLEPeripheral_clockStateDirty(void);
+static void SimpleBLEPeripheral_scheduleSave(void);
+static void SimpleBLEPeripheral_saveClockState(void);
+static void SimpleBLEPeripheral_flushClockState(void);
+static void SimpleBLEPeripheral_restoreClockState(void);
+static uint16_t SimpleBLEPeripheral_nextAlarm(void);
+static bool SimpleBLEPeripheral_alarmOnDay(const sbpAlarm_t *pAlarm,
+                                           uint8_t wday);
+static void SimpleBLEPeripheral_requestFastConn(void);
+static void SimpleBLEPeripheral_requestIdleConn(void);
+static void SimpleBLEPeripheral_setAdvStep(uint8_t step);
+static void SimpleBLEPeripheral_setAdvInterval(uint8_t step);
+static void SimpleBLEPeripheral_accelerateAdv(void);
+static uint16_t SimpleBLEPeripheral_drainStackMsgs(void);
+static uint16_t SimpleBLEPeripheral_drainAppMsgs(void);
+#ifdef FEATURE_OAD
+static uint16_t SimpleBLEPeripheral_drainOadMsgs(void);
+#endif //FEATURE_OAD
 static void SimpleBLEPeripheral_clockHandler(UArg arg);
 
+static sbpAttRspQueue_t *SimpleBLEPeripheral_findAttRspQueue(
+                                        uint16_t connHandle, bool alloc);
+static bStatus_t SimpleBLEPeripheral_queueAttRsp(gattMsgEvent_t *pMsg);
 static void SimpleBLEPeripheral_sendAttRsp(void);
+static void SimpleBLEPeripheral_completeAttRsp(sbpAttRsp_t *pRsp,
+                                               uint8_t status);
 static void SimpleBLEPeripheral_freeAttRsp(uint8_t status);
+static uint8_t SimpleBLEPeripheral_histBin(uint32_t value, uint8_t bins);
+static void SimpleBLEPeripheral_recordLatency(uint8_t latClass, uint32_t queued,
+                                              uint32_t dispatched);
 
 static void SimpleBLEPeripheral_stateChangeCB(gaprole_States_t newState);
+static void SimpleBLEPeripheral_connParamCB(uint16_t connInterval,
+                                            uint16_t connSlaveLatency,
+                                            uint16_t connTimeout);
+static void SimpleBLEPeripheral_processConnParamEvt(bool fast);
 #ifndef FEATURE_OAD_ONCHIP
 static void SimpleBLEPeripheral_charValueChangeCB(uint8_t paramID);
+static void SimpleBLEPeripheral_blobCB(uint16_t connHandle, uint8_t *pValue,
+                                       uint16_t len);
+static void SimpleBLEPeripheral_processBlobEvt(sbpDataEvt_t *pMsg);
+static void SimpleBLEPeripheral_streamCB(uint16_t connHandle, uint8_t *pValue,
+                                         uint16_t len);
+static void SimpleBLEPeripheral_processStreamEvt(sbpDataEvt_t *pMsg);
+static void SimpleBLEPeripheral_sendStreamAck(sbpConnRx_t *pRx);
+static uint8_t SimpleBLEPeripheral_streamCredits(void);
+static bool SimpleBLEPeripheral_enqueueData(uint8_t event, uint16_t connHandle,
+                                            uint8_t *pValue, uint16_t len);
+static bool SimpleBLEPeripheral_receiveTimeBytes(sbpConnRx_t *pRx,
+                                                 uint8_t *pData, uint16_t len);
+static sbpConnRx_t *SimpleBLEPeripheral_findConnRx(uint16_t connHandle,
+                                                   bool alloc);
+static void SimpleBLEPeripheral_releaseConnRx(void);
+static void SimpleBLEPeripheral_mailboxCB(uint16_t connHandle, uint8_t *pValue,
+                                          uint16_t len);
+static void SimpleBLEPeripheral_processMailboxEvt(sbpDataEvt_t *pMsg);
+static void SimpleBLEPeripheral_ctsTimeWriteCB(uint16_t connHandle,
+                                               uint8_t *pValue, uint16_t len);
+static void SimpleBLEPeripheral_processCtsEvt(sbpDataEvt_t *pMsg);
+static void SimpleBLEPeripheral_sendMailboxRsp(uint16_t connHandle,
+                                               uint8_t *pRsp, uint8_t len);
+static void SimpleBLEPeripheral_flushMailboxRsp(void);
+static void SimpleBLEPeripheral_refuseMailboxReq(uint16_t connHandle,
+                                                 uint8_t seq, uint8_t opcode);
+static void SimpleBLEPeripheral_refuseDroppedMailboxReqs(void);
+static uint8_t SimpleBLEPeripheral_mboxSetTime(uint8_t *pParams, uint8_t len,
+                                               uint8_t *pRsp, uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxAddAlarm(uint8_t *pParams, uint8_t len,
+                                                uint8_t *pRsp, uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxDelAlarm(uint8_t *pParams, uint8_t len,
+                                                uint8_t *pRsp, uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxListAlarms(uint8_t *pParams,
+                                                  uint8_t len, uint8_t *pRsp,
+                                                  uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxReadStats(uint8_t *pParams, uint8_t len,
+                                                 uint8_t *pRsp,
+                                                 uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxDisplayText(uint8_t *pParams,
+                                                   uint8_t len, uint8_t *pRsp,
+                                                   uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxDump(uint8_t *pParams, uint8_t len,
+                                            uint8_t *pRsp, uint8_t *pRspLen);
+static uint8_t SimpleBLEPeripheral_mboxDrift(uint8_t *pParams, uint8_t len,
+                                             uint8_t *pRsp, uint8_t *pRspLen);
+static void SimpleBLEPeripheral_startTx(uint16_t connHandle, uint8_t seq,
+                                        uint8_t opcode);
+static void SimpleBLEPeripheral_pumpTx(void);
+static void SimpleBLEPeripheral_endTx(void);
+static uint8_t SimpleBLEPeripheral_alarmRecord(uint16_t index, uint8_t *pBuf);
+static uint8_t SimpleBLEPeripheral_statsRecord(uint16_t index, uint8_t *pBuf);
+static uint8_t SimpleBLEPeripheral_latencyRecord(uint16_t index,
+                                                 uint8_t *pBuf);
+static uint8_t SimpleBLEPeripheral_buildDiag(uint8_t *pBuf);
+static void SimpleBLEPeripheral_updateDiag(void);
 #endif //!FEATURE_OAD_ONCHIP
+static void SimpleBLEPeripheral_countEnqueue(void);
+static void SimpleBLEPeripheral_sampleHeap(void);
 static void SimpleBLEPeripheral_enqueueMsg(uint8_t event, uint8_t state);
 
 #ifdef FEATURE_OAD
@@ -376,6 +978,10 @@ static gapRolesCBs_t SimpleBLEPeripheral_gapRoleCBs =
   SimpleBLEPeripheral_stateChangeCB     // Profile State Change Callbacks
 };
 
+// GAP Role connection parameter update callback
+static gapRolesParamUpdateCB_t SimpleBLEPeripheral_paramUpdateCB =
+  SimpleBLEPeripheral_connParamCB;
+
 // GAP Bond Manager Callbacks
 static gapBondCBs_t simpleBLEPeripheral_BondMgrCBs =
 {
@@ -387,7 +993,43 @@ static gapBondCBs_t simpleBLEPeripheral_BondMgrCBs =
 #ifndef FEATURE_OAD_ONCHIP
 static simpleProfileCBs_t SimpleBLEPeripheral_simpleProfileCBs =
 {
-  SimpleBLEPeripheral_charValueChangeCB // Characteristic value change callback
+  SimpleBLEPeripheral_charValueChangeCB, // Characteristic value change callback
+  SimpleBLEPeripheral_blobCB,            // Characteristic 6 write callback
+  SimpleBLEPeripheral_streamCB           // Characteristic 3 stream callback
+};
+
+// Mailbox Profile Callbacks
+static mailboxCBs_t SimpleBLEPeripheral_mailboxCBs =
+{
+  SimpleBLEPeripheral_mailboxCB          // Request callback
+};
+
+// Current Time Service Callbacks
+static ctsCBs_t SimpleBLEPeripheral_ctsCBs =
+{
+  SimpleBLEPeripheral_ctsTimeWriteCB     // Current Time write callback
+};
+
+// Mailbox commands
+static const sbpMboxCmd_t mboxCmds[] =
+{
+  { SBP_MBOX_OP_SET_TIME,     6, 6, SimpleBLEPeripheral_mboxSetTime },
+  { SBP_MBOX_OP_ADD_ALARM,    3, 3, SimpleBLEPeripheral_mboxAddAlarm },
+  { SBP_MBOX_OP_DEL_ALARM,    1, 1, SimpleBLEPeripheral_mboxDelAlarm },
+  { SBP_MBOX_OP_LIST_ALARMS,  0, 0, SimpleBLEPeripheral_mboxListAlarms },
+  { SBP_MBOX_OP_READ_STATS,   0, 0, SimpleBLEPeripheral_mboxReadStats },
+  { SBP_MBOX_OP_DISPLAY_TEXT, 0, SBP_DISPLAY_LEN,
+    SimpleBLEPeripheral_mboxDisplayText },
+  { SBP_MBOX_OP_DUMP,         1, 1, SimpleBLEPeripheral_mboxDump },
+  { SBP_MBOX_OP_DRIFT,        0, 1, SimpleBLEPeripheral_mboxDrift },
+};
+
+// Transfer sources, indexed by SBP_TX_SRC_*
+static const sbpTxSource_t txSources[] =
+{
+  SimpleBLEPeripheral_alarmRecord,
+  SimpleBLEPeripheral_statsRecord,
+  SimpleBLEPeripheral_latencyRecord,
 };
 #endif //!FEATURE_OAD_ONCHIP
 
@@ -465,12 +1107,17 @@ void SimpleBLEPeripheral_createTask(void)
 
   Task_construct(&sbpTask, SimpleBLEPeripheral_taskFxn, &taskParams, NULL);
 }
-static int bytesRecieved = 0;
-static char buf[80];
 static int code[5];
 static int dateInBinary[5] = {0,1,1,1,0};
 static int codeIndex = 0;
 static int prevDate = 0;
+static bool timeIsSet = FALSE;
+// The clock runs from a time restored after a reset, which no client has
+// confirmed yet
+static bool timeRestored = FALSE;
+static bool alarmRinging = FALSE;
+// Set from the button callback when the correct code is entered
+static volatile bool alarmDismissed = FALSE;
 static void int_to_bin_digit(unsigned int in)
 {
     /* assert: count <= sizeof(int)*CHAR_BIT */
@@ -486,6 +1133,10 @@ static void buttonCallbackFxn(PIN_Handle handle, PIN_Id pinId) {
     CPUdelay(8000*50);
 
         if (!PIN_getInputValue(pinId)) {
+            // Let the application task react to user presence
+            buttonPressed = (uint32_t)Timebase_now();
+            Event_post(syncEvent, SBP_BUTTON_EVT);
+
             if(firstPress == 1){
                 cursorToSecond();
                 firstPress = 0;
@@ -540,6 +1191,7 @@ static void buttonCallbackFxn(PIN_Handle handle, PIN_Id pinId) {
                 PIN_setOutputValue(ledPinHandle, Board_PIN_LED0, 0);
                 PIN_setOutputValue(ledPinHandle, Board_PIN_LED1, 1);
                 PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, 0);//PIN_GPIO_HIGH
+                alarmDismissed = TRUE;
 
             }
         }
@@ -563,7 +1215,7 @@ static void SimpleBLEPeripheral_init(void)
   // ******************************************************************
   // Register the current thread as an ICall dispatcher application
   // so that the application can send and receive messages.
-  ICall_registerApp(&selfEntity, &sem);
+  ICall_registerApp(&selfEntity, &syncEvent);
 
 #ifdef USE_RCOSC
   RCOSC_enableCalibration();
@@ -621,9 +1273,59 @@ static void SimpleBLEPeripheral_init(void)
   // Create an RTOS queue for message from profile to be sent to app.
   appMsgQueue = Util_constructQueue(&appMsg);
 
-  // Create one-shot clocks for internal periodic events.
-  Util_constructClock(&periodicClock, SimpleBLEPeripheral_clockHandler,
-                      SBP_PERIODIC_EVT_PERIOD, 0, false, SBP_PERIODIC_EVT);
+  // ATT response queue for every connection the stack can hold
+  attRspQueues = ICall_malloc(sizeof(sbpAttRspQueue_t) * linkDBNumConns);
+  if (attRspQueues == NULL)
+  {
+    /* Error allocating the response queues */
+    while(1);
+  }
+
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
+  {
+    attRspQueues[i].connHandle = INVALID_CONNHANDLE;
+  }
+
+#ifndef FEATURE_OAD_ONCHIP
+  // Receive state for every connection the stack can hold
+  connRx = ICall_malloc(sizeof(sbpConnRx_t) * linkDBNumConns);
+  if (connRx == NULL)
+  {
+    /* Error allocating the receive state */
+    while(1);
+  }
+
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
+  {
+    connRx[i].connHandle = INVALID_CONNHANDLE;
+  }
+#endif //!FEATURE_OAD_ONCHIP
+
+  // Minute tick, started once the time has been set.
+  Util_constructClock(&minuteClock, SimpleBLEPeripheral_clockHandler,
+                      SBP_MINUTE_EVT_PERIOD, SBP_MINUTE_EVT_PERIOD, false,
+                      SBP_MINUTE_EVT);
+
+  // Advertising interval back-off.
+  Util_constructClock(&advStepClock, SimpleBLEPeripheral_clockHandler,
+                      advSteps[0].duration, 0, false, SBP_ADV_STEP_EVT);
+
+  // Retry of stream acknowledgements and mailbox responses.
+  Util_constructClock(&txRetryClock, SimpleBLEPeripheral_clockHandler,
+                      SBP_TX_RETRY_PERIOD, 0, false,
+                      SBP_TX_RETRY_EVT);
+
+  // Coalesced writes of the clock state to SNV.
+  Util_constructClock(&saveClock, SimpleBLEPeripheral_clockHandler,
+                      SBP_SAVE_DELAY, 0, false, SBP_SAVE_EVT);
+
+  // Idle timeout for the fast connection parameters.
+  Util_constructClock(&connIdleClock, SimpleBLEPeripheral_clockHandler,
+                      SBP_CONN_IDLE_TIMEOUT, 0, false, SBP_CONN_IDLE_EVT);
+
+  // Refresh of the diagnostics characteristic.
+  Util_constructClock(&diagClock, SimpleBLEPeripheral_clockHandler,
+                      SBP_DIAG_PERIOD, SBP_DIAG_PERIOD, false, SBP_DIAG_EVT);
 
   dispHandle = Display_open(SBP_DISPLAY_TYPE, NULL);
 
@@ -654,7 +1356,9 @@ static void SimpleBLEPeripheral_init(void)
 
     GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, sizeof(scanRspData),
                          scanRspData);
-    GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
+    // Fills in the status and sets GAPROLE_ADVERT_DATA
+    AONBatMonEnable();
+    SimpleBLEPeripheral_updateAdvertData();
 
     GAPRole_SetParameter(GAPROLE_PARAM_UPDATE_ENABLE, sizeof(uint8_t),
                          &enableUpdateRequest);
@@ -671,15 +1375,8 @@ static void SimpleBLEPeripheral_init(void)
   // Set the GAP Characteristics
   GGS_SetParameter(GGS_DEVICE_NAME_ATT, GAP_DEVICE_NAME_LEN, attDeviceName);
 
-  // Set advertising interval
-  {
-    uint16_t advInt = DEFAULT_ADVERTISING_INTERVAL;
-
-    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MIN, advInt);
-    GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MAX, advInt);
-    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MIN, advInt);
-    GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MAX, advInt);
-  }
+  // Set advertising interval, starting with the fast burst
+  SimpleBLEPeripheral_setAdvStep(0);
 
   // Setup the GAP Bond Manager
   {
@@ -697,6 +1394,10 @@ static void SimpleBLEPeripheral_init(void)
     GAPBondMgr_SetParameter(GAPBOND_BONDING_ENABLED, sizeof(uint8_t), &bonding);
   }
 
+  // Allow long writes to Characteristic 6
+  GATTServApp_SetParamValue(GATT_PARAM_NUM_PREPARE_WRITES,
+                            SBP_NUM_PREPARE_WRITES);
+
    // Initialize GATT attributes
   GGS_AddService(GATT_ALL_SERVICES);           // GAP
   GATTServApp_AddService(GATT_ALL_SERVICES);   // GATT attributes
@@ -704,6 +1405,9 @@ static void SimpleBLEPeripheral_init(void)
 
 #ifndef FEATURE_OAD_ONCHIP
   SimpleProfile_AddService(GATT_ALL_SERVICES); // Simple GATT Profile
+  Mailbox_AddService(GATT_ALL_SERVICES);       // Mailbox Profile
+  Cts_AddService(GATT_ALL_SERVICES);           // Current Time Service
+  Diag_AddService(GATT_ALL_SERVICES);          // Diagnostics Profile
 #endif //!FEATURE_OAD_ONCHIP
 
 #ifdef FEATURE_OAD
@@ -740,11 +1444,39 @@ static void SimpleBLEPeripheral_init(void)
 
   // Register callback with SimpleGATTprofile
   SimpleProfile_RegisterAppCBs(&SimpleBLEPeripheral_simpleProfileCBs);
+
+  // Register callback with the Mailbox Profile
+  Mailbox_RegisterAppCBs(&SimpleBLEPeripheral_mailboxCBs);
+
+  // Register callback with the Current Time Service
+  Cts_RegisterAppCBs(&SimpleBLEPeripheral_ctsCBs);
+
+  // First diagnostics snapshot; refreshed while a client is connected
+  SimpleBLEPeripheral_updateDiag();
 #endif //!FEATURE_OAD_ONCHIP
 
+  for (uint8_t i = 0; i < SBP_MAX_ALARMS; i++)
+  {
+    alarms[i].hour = SBP_ALARM_FREE;
+  }
+
+  // Pick up the drift learned before the reset
+  if (osal_snv_read(SBP_NVID_DRIFT, sizeof(driftFit), &driftFit) != SUCCESS ||
+      driftFit.version != SBP_DRIFT_FIT_VERSION)
+  {
+    SimpleBLEPeripheral_driftForget();
+  }
+  SimpleBLEPeripheral_driftUpdate();
+
+  // Show the time and alarms from before the reset before advertising
+  SimpleBLEPeripheral_restoreClockState();
+
   // Start the Device
   VOID GAPRole_StartDevice(&SimpleBLEPeripheral_gapRoleCBs);
 
+  // Follow the connection parameters the central settles on
+  GAPRole_RegisterAppCBs(&SimpleBLEPeripheral_paramUpdateCB);
+
   // Start Bond Manager
   VOID GAPBondMgr_Register(&simpleBLEPeripheral_BondMgrCBs);
 
@@ -784,147 +1516,337 @@ static void SimpleBLEPeripheral_taskFxn(UArg a0, UArg a1)
   // Application main loop
   for (;;)
   {
-    // Waits for a signal to the semaphore associated with the calling thread.
-    // Note that the semaphore associated with a thread is signaled when a
-    // message is queued to the message receive queue of the thread or when
-    // ICall_signal() function is called onto the semaphore.
-    ICall_Errno errno = ICall_wait(ICALL_TIMEOUT_FOREVER);
+    uint32_t events;
+    uint16_t batch = 0;
+    uint64_t wakeStart;
+    uint32_t wakeUs;
+
+    // Waits for an event to be posted associated with the calling thread.
+    // Note that an event associated with a thread is posted when a
+    // message is queued to the message receive queue of the thread.
+    // Event_pend returns and clears every pending bit atomically, so
+    // several posts of the same event collapse into one wakeup and each
+    // source must be drained completely below.
+    events = Event_pend(syncEvent, Event_Id_NONE, SBP_ALL_EVENTS,
+                        ICALL_TIMEOUT_FOREVER);
+
+    sbpLoopStats.wakeups++;
+    wakeStart = Timebase_now();
+
+    if (events & SBP_ICALL_EVT)
+    {
+      // Before the drain, while the stack's messages still hold the heap
+      SimpleBLEPeripheral_sampleHeap();
+      batch += SimpleBLEPeripheral_drainStackMsgs();
+    }
+
+    if (events & SBP_QUEUE_EVT)
+    {
+      batch += SimpleBLEPeripheral_drainAppMsgs();
+    }
 
-    if (errno == ICALL_ERRNO_SUCCESS)
+    if (events & SBP_MINUTE_EVT)
     {
-      ICall_EntityID dest;
-      ICall_ServiceEnum src;
-      ICall_HciExtEvt *pMsg = NULL;
+      int8_t step;
 
-      if (ICall_fetchServiceMsg(&src, &dest,
-                                (void **)&pMsg) == ICALL_ERRNO_SUCCESS)
+      SimpleBLEPeripheral_performMinuteTask();
+
+      // Keep the next tick on the minute boundary of the corrected clock
+      step = SimpleBLEPeripheral_driftCorrect();
+      if (step != 0)
       {
-        uint8 safeToDealloc = TRUE;
+        Util_restartClock(&minuteClock, SBP_MINUTE_EVT_PERIOD - step * 1000);
+      }
+    }
 
-        if ((src == ICALL_SERVICE_CLASS_BLE) && (dest == selfEntity))
-        {
-          ICall_Stack_Event *pEvt = (ICall_Stack_Event *)pMsg;
+    if (events & SBP_CONN_IDLE_EVT)
+    {
+      SimpleBLEPeripheral_requestIdleConn();
+    }
 
-          // Check for BLE stack events first
-          if (pEvt->signature == 0xffff)
-          {
-            if (pEvt->event_flag & SBP_CONN_EVT_END_EVT)
-            {
-              // Try to retransmit pending ATT Response (if any)
-              SimpleBLEPeripheral_sendAttRsp();
-            }
-          }
-          else
-          {
-            // Process inter-task message
-            safeToDealloc = SimpleBLEPeripheral_processStackMsg((ICall_Hdr *)pMsg);
-          }
-        }
+    if (events & SBP_ADV_STEP_EVT)
+    {
+      if (advStep < SBP_ADV_NUM_STEPS - 1)
+      {
+        SimpleBLEPeripheral_setAdvStep(advStep + 1);
+      }
+    }
 
-        if (pMsg && safeToDealloc)
-        {
-          ICall_freeMsg(pMsg);
-        }
+    if (events & SBP_SAVE_EVT)
+    {
+      SimpleBLEPeripheral_saveClockState();
+    }
+
+    if (events & SBP_BUTTON_EVT)
+    {
+      uint32_t dispatched = (uint32_t)Timebase_now();
+
+      SimpleBLEPeripheral_accelerateAdv();
+
+      // A code digit was entered, and maybe the alarm dismissed
+      if (alarmDismissed)
+      {
+        alarmRinging = FALSE;
       }
+      SimpleBLEPeripheral_statusChanged();
+
+      SimpleBLEPeripheral_recordLatency(SBP_LAT_BUTTON, buttonPressed,
+                                        dispatched);
+    }
 
-      // If RTOS queue is not empty, process app message.
-      while (!Queue_empty(appMsgQueue))
+#ifndef FEATURE_OAD_ONCHIP
+    if (events & SBP_TX_RETRY_EVT)
+    {
+      for (uint8_t i = 0; i < linkDBNumConns; i++)
       {
-        sbpEvt_t *pMsg = (sbpEvt_t *)Util_dequeueMsg(appMsgQueue);
-        if (pMsg)
+        if (connRx[i].connHandle != INVALID_CONNHANDLE && connRx[i].ackPending)
         {
-          // Process message.
-          SimpleBLEPeripheral_processAppMsg(pMsg);
-
-          // Free the space from the message.
-          ICall_free(pMsg);
+          SimpleBLEPeripheral_sendStreamAck(&connRx[i]);
         }
       }
+
+      SimpleBLEPeripheral_flushMailboxRsp();
     }
 
-    if (events & SBP_PERIODIC_EVT)
+    if (events & SBP_DIAG_EVT)
     {
-      events &= ~SBP_PERIODIC_EVT;
-
-      Util_startClock(&periodicClock);
+      SimpleBLEPeripheral_updateDiag();
+    }
 
-      // Perform periodic application task
-      SimpleBLEPeripheral_performPeriodicTask();
+    if (events & SBP_MBOX_DROP_EVT)
+    {
+      SimpleBLEPeripheral_refuseDroppedMailboxReqs();
     }
+#endif //!FEATURE_OAD_ONCHIP
 
 #ifdef FEATURE_OAD
-    while (!Queue_empty(hOadQ))
+    if (events & SBP_OAD_QUEUE_EVT)
     {
-      oadTargetWrite_t *oadWriteEvt = Queue_get(hOadQ);
+      batch += SimpleBLEPeripheral_drainOadMsgs();
+    }
+#endif //FEATURE_OAD
 
-      // Identify new image.
-      if (oadWriteEvt->event == OAD_WRITE_IDENTIFY_REQ)
-      {
-        OAD_imgIdentifyWrite(oadWriteEvt->connHandle, oadWriteEvt->pData);
-      }
-      // Write a next block request.
-      else if (oadWriteEvt->event == OAD_WRITE_BLOCK_REQ)
-      {
-        OAD_imgBlockWrite(oadWriteEvt->connHandle, oadWriteEvt->pData);
-      }
+    if (batch > sbpLoopStats.maxBatch)
+    {
+      sbpLoopStats.maxBatch = batch;
+    }
 
-      // Free buffer.
-      ICall_free(oadWriteEvt);
+    wakeUs = Timebase_elapsed(wakeStart);
+    if (wakeUs > sbpLoopStats.maxWakeUs)
+    {
+      sbpLoopStats.maxWakeUs = wakeUs;
     }
-#endif //FEATURE_OAD
   }
 }
 
 /*********************************************************************
- * @fn      SimpleBLEPeripheral_processStackMsg
+ * @fn      SimpleBLEPeripheral_drainStackMsgs
  *
- * @brief   Process an incoming stack message.
+ * @brief   Process every message waiting in the ICall receive queue.
  *
- * @param   pMsg - message to process
+ * @param   None.
  *
- * @return  TRUE if safe to deallocate incoming message, FALSE otherwise.
+ * @return  Number of messages processed.
  */
-static uint8_t SimpleBLEPeripheral_processStackMsg(ICall_Hdr *pMsg)
+static uint16_t SimpleBLEPeripheral_drainStackMsgs(void)
 {
-  uint8_t safeToDealloc = TRUE;
+  ICall_EntityID dest;
+  ICall_ServiceEnum src;
+  ICall_HciExtEvt *pMsg = NULL;
+  uint16_t count = 0;
 
-  switch (pMsg->event)
+  while (ICall_fetchServiceMsg(&src, &dest,
+                               (void **)&pMsg) == ICALL_ERRNO_SUCCESS)
   {
-    case GATT_MSG_EVENT:
-      // Process GATT message
-      safeToDealloc = SimpleBLEPeripheral_processGATTMsg((gattMsgEvent_t *)pMsg);
-      break;
+    uint8 safeToDealloc = TRUE;
 
-    case HCI_GAP_EVENT_EVENT:
+    if ((src == ICALL_SERVICE_CLASS_BLE) && (dest == selfEntity))
+    {
+      ICall_Stack_Event *pEvt = (ICall_Stack_Event *)pMsg;
+
+      // Check for BLE stack events first
+      if (pEvt->signature == 0xffff)
       {
-        // Process HCI message
-        switch(pMsg->status)
+        if (pEvt->event_flag & SBP_CONN_EVT_END_EVT)
         {
-          case HCI_COMMAND_COMPLETE_EVENT_CODE:
-            // Process HCI Command Complete Event
-            break;
+          // Try to retransmit pending ATT Responses (if any)
+          SimpleBLEPeripheral_sendAttRsp();
 
-          default:
-            break;
+          // Notify the status changes of this event in one go
+          if (statusPending)
+          {
+            SimpleBLEPeripheral_sendStatus();
+          }
+
+#ifndef FEATURE_OAD_ONCHIP
+          // Refill the controller with transfer records
+          SimpleBLEPeripheral_pumpTx();
+#endif //!FEATURE_OAD_ONCHIP
         }
       }
-      break;
+      else
+      {
+        // Process inter-task message
+        safeToDealloc = SimpleBLEPeripheral_processStackMsg((ICall_Hdr *)pMsg);
+      }
+    }
 
-    default:
-      // do nothing
-      break;
+    if (pMsg && safeToDealloc)
+    {
+      ICall_freeMsg(pMsg);
+    }
+
+    pMsg = NULL;
+    count++;
   }
 
-  return (safeToDealloc);
+  sbpLoopStats.stackMsgs += count;
+
+  return (count);
 }
 
 /*********************************************************************
- * @fn      SimpleBLEPeripheral_processGATTMsg
+ * @fn      SimpleBLEPeripheral_drainAppMsgs
  *
- * @brief   Process GATT messages and events.
+ * @brief   Process every message waiting in the application queue.
  *
- * @return  TRUE if safe to deallocate incoming message, FALSE otherwise.
- */
+ * @param   None.
+ *
+ * @return  Number of messages processed.
+ */
+static uint16_t SimpleBLEPeripheral_drainAppMsgs(void)
+{
+  uint16_t count = 0;
+
+  while (!Queue_empty(appMsgQueue))
+  {
+    sbpEvt_t *pMsg = (sbpEvt_t *)Util_dequeueMsg(appMsgQueue);
+    if (pMsg)
+    {
+      uint32_t dispatched = (uint32_t)Timebase_now();
+      UInt key = Hwi_disable();
+
+      // Out of the queue; stream credits count it as free from here on
+      diagStats.appQueueDepth--;
+      Hwi_restore(key);
+
+      // Process message.
+      SimpleBLEPeripheral_processAppMsg(pMsg);
+
+      SimpleBLEPeripheral_recordLatency(pMsg->hdr.event - 1, pMsg->queued,
+                                        dispatched);
+
+      // Free the space from the message.
+      ICall_free(pMsg);
+
+      count++;
+    }
+  }
+
+  sbpLoopStats.appMsgs += count;
+
+  return (count);
+}
+
+#ifdef FEATURE_OAD
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_drainOadMsgs
+ *
+ * @brief   Process every OAD write request waiting in the OAD queue.
+ *
+ * @param   None.
+ *
+ * @return  Number of requests processed.
+ */
+static uint16_t SimpleBLEPeripheral_drainOadMsgs(void)
+{
+  uint16_t count = 0;
+
+  while (!Queue_empty(hOadQ))
+  {
+    sbpOadEvt_t *pEvt = Queue_get(hOadQ);
+    oadTargetWrite_t *oadWriteEvt = &pEvt->write;
+    uint32_t dispatched = (uint32_t)Timebase_now();
+
+    // Keep the link fast for as long as image blocks keep coming.
+    SimpleBLEPeripheral_requestFastConn();
+
+    // Identify new image.
+    if (oadWriteEvt->event == OAD_WRITE_IDENTIFY_REQ)
+    {
+      diagStats.oadIdentify++;
+      OAD_imgIdentifyWrite(oadWriteEvt->connHandle, oadWriteEvt->pData);
+    }
+    // Write a next block request.
+    else if (oadWriteEvt->event == OAD_WRITE_BLOCK_REQ)
+    {
+      OAD_imgBlockWrite(oadWriteEvt->connHandle, oadWriteEvt->pData);
+    }
+
+    SimpleBLEPeripheral_recordLatency(SBP_LAT_OAD, pEvt->queued, dispatched);
+
+    // Free buffer.
+    ICall_free(pEvt);
+
+    count++;
+  }
+
+  sbpLoopStats.oadMsgs += count;
+
+  return (count);
+}
+#endif //FEATURE_OAD
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processStackMsg
+ *
+ * @brief   Process an incoming stack message.
+ *
+ * @param   pMsg - message to process
+ *
+ * @return  TRUE if safe to deallocate incoming message, FALSE otherwise.
+ */
+static uint8_t SimpleBLEPeripheral_processStackMsg(ICall_Hdr *pMsg)
+{
+  uint8_t safeToDealloc = TRUE;
+
+  switch (pMsg->event)
+  {
+    case GATT_MSG_EVENT:
+      // Process GATT message
+      safeToDealloc = SimpleBLEPeripheral_processGATTMsg((gattMsgEvent_t *)pMsg);
+      break;
+
+    case HCI_GAP_EVENT_EVENT:
+      {
+        // Process HCI message
+        switch(pMsg->status)
+        {
+          case HCI_COMMAND_COMPLETE_EVENT_CODE:
+            // Process HCI Command Complete Event
+            break;
+
+          default:
+            break;
+        }
+      }
+      break;
+
+    default:
+      // do nothing
+      break;
+  }
+
+  return (safeToDealloc);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processGATTMsg
+ *
+ * @brief   Process GATT messages and events.
+ *
+ * @return  TRUE if safe to deallocate incoming message, FALSE otherwise.
+ */
 static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg)
 {
   // See if GATT server was unable to transmit an ATT response
@@ -932,15 +1854,8 @@ static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg)
   {
     // No HCI buffer was available. Let's try to retransmit the response
     // on the next connection event.
-    if (HCI_EXT_ConnEventNoticeCmd(pMsg->connHandle, selfEntity,
-                                   SBP_CONN_EVT_END_EVT) == SUCCESS)
+    if (SimpleBLEPeripheral_queueAttRsp(pMsg) == SUCCESS)
     {
-      // First free any pending response
-      SimpleBLEPeripheral_freeAttRsp(FAILURE);
-
-      // Hold on to the response message for retransmission
-      pAttRsp = pMsg;
-
       // Don't free the response message yet
       return (FALSE);
     }
@@ -952,6 +1867,7 @@ static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg)
     // The app is informed in case it wants to drop the connection.
 
     // Display the opcode of the message that caused the violation.
+    diagStats.fcViolations++;
     Display_print1(dispHandle, 5, 0, "FC Violated: %d", pMsg->msg.flowCtrlEvt.opcode);
   }
   else if (pMsg->method == ATT_MTU_UPDATED_EVENT)
@@ -967,10 +1883,100 @@ static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg)
   return (TRUE);
 }
 
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_findAttRspQueue
+ *
+ * @brief   Find the ATT response queue of a connection.
+ *
+ * @param   connHandle - connection handle.
+ * @param   alloc      - TRUE to claim a free queue if none is found.
+ *
+ * @return  Pointer to the queue, or NULL.
+ */
+static sbpAttRspQueue_t *SimpleBLEPeripheral_findAttRspQueue(
+                                        uint16_t connHandle, bool alloc)
+{
+  sbpAttRspQueue_t *pFree = NULL;
+
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
+  {
+    if (attRspQueues[i].connHandle == connHandle)
+    {
+      return (&attRspQueues[i]);
+    }
+
+    if (pFree == NULL && attRspQueues[i].connHandle == INVALID_CONNHANDLE)
+    {
+      pFree = &attRspQueues[i];
+    }
+  }
+
+  if (alloc && pFree != NULL)
+  {
+    pFree->connHandle = connHandle;
+    pFree->head = 0;
+    pFree->count = 0;
+  }
+  else
+  {
+    pFree = NULL;
+  }
+
+  return (pFree);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_queueAttRsp
+ *
+ * @brief   Hold on to an ATT response the stack could not transmit in
+ *          its connection's queue. Connection event notices are asked
+ *          for when the first response of the connection is queued.
+ *
+ * @param   pMsg - GATT message carrying the pending response
+ *
+ * @return  SUCCESS if the response was queued, otherwise the caller
+ *          still owns the message.
+ */
+static bStatus_t SimpleBLEPeripheral_queueAttRsp(gattMsgEvent_t *pMsg)
+{
+  sbpAttRspQueue_t *pQueue;
+  sbpAttRsp_t *pRsp;
+
+  pQueue = SimpleBLEPeripheral_findAttRspQueue(pMsg->connHandle, TRUE);
+  if (pQueue == NULL || pQueue->count == SBP_ATT_RSP_QUEUE_SIZE)
+  {
+    attRspStats.dropped++;
+
+    return (bleNoResources);
+  }
+
+  if (pQueue->count == 0)
+  {
+    if (HCI_EXT_ConnEventNoticeCmd(pMsg->connHandle, selfEntity,
+                                   SBP_CONN_EVT_END_EVT) != SUCCESS)
+    {
+      pQueue->connHandle = INVALID_CONNHANDLE;
+
+      return (FAILURE);
+    }
+  }
+
+  pRsp = &pQueue->rsp[(pQueue->head + pQueue->count) %
+                      SBP_ATT_RSP_QUEUE_SIZE];
+  pRsp->pMsg = pMsg;
+  pRsp->retries = 0;
+  pQueue->count++;
+
+  return (SUCCESS);
+}
+
 /*********************************************************************
  * @fn      SimpleBLEPeripheral_sendAttRsp
  *
- * @brief   Send a pending ATT response message.
+ * @brief   Retransmit pending ATT response messages, each connection's
+ *          in order. A connection whose oldest response still finds no
+ *          buffer keeps the rest of its queue; other connections are
+ *          not held up by it.
  *
  * @param   none
  *
@@ -978,37 +1984,123 @@ static uint8_t SimpleBLEPeripheral_processGATTMsg(gattMsgEvent_t *pMsg)
  */
 static void SimpleBLEPeripheral_sendAttRsp(void)
 {
-  // See if there's a pending ATT Response to be transmitted
-  if (pAttRsp != NULL)
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
   {
-    uint8_t status;
+    sbpAttRspQueue_t *pQueue = &attRspQueues[i];
+    uint16_t connHandle = pQueue->connHandle;
 
-    // Increment retransmission count
-    rspTxRetry++;
+    if (connHandle == INVALID_CONNHANDLE)
+    {
+      continue;
+    }
 
-    // Try to retransmit ATT response till either we're successful or
-    // the ATT Client times out (after 30s) and drops the connection.
-    status = GATT_SendRsp(pAttRsp->connHandle, pAttRsp->method, &(pAttRsp->msg));
-    if ((status != blePending) && (status != MSG_BUFFER_NOT_AVAIL))
+    while (pQueue->count > 0)
     {
-      // Disable connection event end notice
-      HCI_EXT_ConnEventNoticeCmd(pAttRsp->connHandle, selfEntity, 0);
+      sbpAttRsp_t *pRsp = &pQueue->rsp[pQueue->head];
+      uint8_t status;
+
+      // Increment retransmission count
+      if (pRsp->retries < 0xFF)
+      {
+        pRsp->retries++;
+      }
+      attRspStats.retries++;
+
+      // Try to retransmit ATT response till either we're successful or
+      // the ATT Client times out (after 30s) and drops the connection.
+      status = GATT_SendRsp(connHandle, pRsp->pMsg->method,
+                            &(pRsp->pMsg->msg));
+      if ((status == blePending) || (status == MSG_BUFFER_NOT_AVAIL))
+      {
+        // Continue retrying on the next connection event
+        break;
+      }
 
       // We're done with the response message
-      SimpleBLEPeripheral_freeAttRsp(status);
+      SimpleBLEPeripheral_completeAttRsp(pRsp, status);
+      pQueue->head = (pQueue->head + 1) % SBP_ATT_RSP_QUEUE_SIZE;
+      pQueue->count--;
     }
-    else
+
+    if (pQueue->count == 0)
     {
-      // Continue retrying
-      Display_print1(dispHandle, 5, 0, "Rsp send retry: %d", rspTxRetry);
+      pQueue->connHandle = INVALID_CONNHANDLE;
+
+      // Disable connection event end notice if nothing else needs it
+      SimpleBLEPeripheral_updateConnEvtNotice(connHandle);
     }
   }
 }
 
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_updateConnEvtNotice
+ *
+ * @brief   Keep connection event end notices on for a connection only
+ *          while there is work for the end of its events: ATT responses
+ *          waiting for a buffer, a pending status notification or a
+ *          bulk transfer.
+ *
+ * @param   connHandle - connection to update
+ *
+ * @return  none
+ */
+static void SimpleBLEPeripheral_updateConnEvtNotice(uint16_t connHandle)
+{
+  uint16_t taskEvent = statusPending ? SBP_CONN_EVT_END_EVT : 0;
+
+#ifndef FEATURE_OAD_ONCHIP
+  if (tx.connHandle == connHandle)
+  {
+    taskEvent = SBP_CONN_EVT_END_EVT;
+  }
+#endif //!FEATURE_OAD_ONCHIP
+
+  if (SimpleBLEPeripheral_findAttRspQueue(connHandle, FALSE) != NULL)
+  {
+    taskEvent = SBP_CONN_EVT_END_EVT;
+  }
+
+  HCI_EXT_ConnEventNoticeCmd(connHandle, selfEntity, taskEvent);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_completeAttRsp
+ *
+ * @brief   Account for and free a response that has left the queue.
+ *
+ * @param   pRsp   - queued response
+ * @param   status - response transmit status
+ *
+ * @return  none
+ */
+static void SimpleBLEPeripheral_completeAttRsp(sbpAttRsp_t *pRsp,
+                                               uint8_t status)
+{
+  uint8_t bin = SimpleBLEPeripheral_histBin(pRsp->retries, SBP_HIST_BINS);
+
+  // See if the response was sent out successfully
+  if (status == SUCCESS)
+  {
+    attRspStats.sentHist[bin]++;
+  }
+  else
+  {
+    // Free response payload
+    GATT_bm_free(&pRsp->pMsg->msg, pRsp->pMsg->method);
+
+    attRspStats.failedHist[bin]++;
+  }
+
+  // Free response message
+  ICall_freeMsg(pRsp->pMsg);
+  pRsp->pMsg = NULL;
+}
+
 /*********************************************************************
  * @fn      SimpleBLEPeripheral_freeAttRsp
  *
- * @brief   Free ATT response message.
+ * @brief   Free the pending ATT response messages of the links that
+ *          have gone down. The queues of the other links are kept.
  *
  * @param   status - response transmit status
  *
@@ -1016,29 +2108,82 @@ static void SimpleBLEPeripheral_sendAttRsp(void)
  */
 static void SimpleBLEPeripheral_freeAttRsp(uint8_t status)
 {
-  // See if there's a pending ATT response message
-  if (pAttRsp != NULL)
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
   {
-    // See if the response was sent out successfully
-    if (status == SUCCESS)
+    sbpAttRspQueue_t *pQueue = &attRspQueues[i];
+
+    if (pQueue->connHandle == INVALID_CONNHANDLE ||
+        linkDB_Up(pQueue->connHandle))
     {
-      Display_print1(dispHandle, 5, 0, "Rsp sent retry: %d", rspTxRetry);
+      continue;
     }
-    else
-    {
-      // Free response payload
-      GATT_bm_free(&pAttRsp->msg, pAttRsp->method);
 
-      Display_print1(dispHandle, 5, 0, "Rsp retry failed: %d", rspTxRetry);
+    while (pQueue->count > 0)
+    {
+      SimpleBLEPeripheral_completeAttRsp(&pQueue->rsp[pQueue->head], status);
+      pQueue->head = (pQueue->head + 1) % SBP_ATT_RSP_QUEUE_SIZE;
+      pQueue->count--;
     }
 
-    // Free response message
-    ICall_freeMsg(pAttRsp);
+    pQueue->connHandle = INVALID_CONNHANDLE;
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_histBin
+ *
+ * @brief   Map a count onto a log2 histogram bucket: 0 -> 0, 1 -> 1,
+ *          2..3 -> 2, 4..7 -> 3 and so on, saturating at the last bucket.
+ *
+ * @param   value - value to classify
+ * @param   bins  - number of buckets
+ *
+ * @return  Bucket index below bins.
+ */
+static uint8_t SimpleBLEPeripheral_histBin(uint32_t value, uint8_t bins)
+{
+  uint8_t bin = 0;
+
+  while ((value != 0) && (bin < (bins - 1)))
+  {
+    value >>= 1;
+    bin++;
+  }
+
+  return (bin);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_recordLatency
+ *
+ * @brief   Account for an event that has just been handled: the time it
+ *          waited to be dispatched and the time its handler took.
+ *
+ * @param   latClass   - SBP_LAT_* class of the event; others are ignored
+ * @param   queued     - Timebase_now() when the event was queued, low
+ *                       32 bits
+ * @param   dispatched - Timebase_now() when its handler started, low
+ *                       32 bits
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_recordLatency(uint8_t latClass, uint32_t queued,
+                                              uint32_t dispatched)
+{
+  uint32_t now = (uint32_t)Timebase_now();
+  sbpLatHist_t *pHist;
 
-    // Reset our globals
-    pAttRsp = NULL;
-    rspTxRetry = 0;
+  if (latClass >= SBP_LAT_CLASSES)
+  {
+    return;
   }
+
+  // Unsigned differences stay right across the 32 bit wrap
+  pHist = &latHist[latClass];
+  pHist->queuedHist[SimpleBLEPeripheral_histBin(
+      (dispatched - queued) >> SBP_LAT_UNIT_SHIFT, SBP_LAT_BINS)]++;
+  pHist->handledHist[SimpleBLEPeripheral_histBin(
+      (now - dispatched) >> SBP_LAT_UNIT_SHIFT, SBP_LAT_BINS)]++;
 }
 
 /*********************************************************************
@@ -1063,6 +2208,28 @@ static void SimpleBLEPeripheral_processAppMsg(sbpEvt_t *pMsg)
       SimpleBLEPeripheral_processCharValueChangeEvt(pMsg->hdr.state);
       break;
 
+    case SBP_CONN_PARAM_EVT:
+      SimpleBLEPeripheral_processConnParamEvt(pMsg->hdr.state);
+      break;
+
+#ifndef FEATURE_OAD_ONCHIP
+    case SBP_BLOB_EVT:
+      SimpleBLEPeripheral_processBlobEvt((sbpDataEvt_t *)pMsg);
+      break;
+
+    case SBP_STREAM_EVT:
+      SimpleBLEPeripheral_processStreamEvt((sbpDataEvt_t *)pMsg);
+      break;
+
+    case SBP_MAILBOX_EVT:
+      SimpleBLEPeripheral_processMailboxEvt((sbpDataEvt_t *)pMsg);
+      break;
+
+    case SBP_CTS_EVT:
+      SimpleBLEPeripheral_processCtsEvt((sbpDataEvt_t *)pMsg);
+      break;
+#endif //!FEATURE_OAD_ONCHIP
+
     default:
       // Do nothing.
       break;
@@ -1083,6 +2250,48 @@ static void SimpleBLEPeripheral_stateChangeCB(gaprole_States_t newState)
   SimpleBLEPeripheral_enqueueMsg(SBP_STATE_CHANGE_EVT, newState);
 }
 
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_connParamCB
+ *
+ * @brief   Callback from GAP Role with the parameters of the link after
+ *          a successful update.
+ *
+ * @param   connInterval     - connection interval (units of 1.25ms)
+ * @param   connSlaveLatency - slave latency
+ * @param   connTimeout      - supervision timeout (units of 10ms)
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_connParamCB(uint16_t connInterval,
+                                            uint16_t connSlaveLatency,
+                                            uint16_t connTimeout)
+{
+  SimpleBLEPeripheral_enqueueMsg(SBP_CONN_PARAM_EVT,
+                                 connInterval <= SBP_FAST_CONN_MAX_INTERVAL);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processConnParamEvt
+ *
+ * @brief   Take the fast or idle state from the parameters the link now
+ *          runs with, whichever was requested.
+ *
+ * @param   fast - TRUE if the interval is a fast one
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processConnParamEvt(bool fast)
+{
+  fastConnActive = fast;
+  fastConnRequested = FALSE;
+
+  // The idle timeout only runs to relax a fast link
+  if (!fast)
+  {
+    Util_stopClock(&connIdleClock);
+  }
+}
+
 /*********************************************************************
  * @fn      SimpleBLEPeripheral_processStateChangeEvt
  *
@@ -1165,17 +2374,48 @@ static void SimpleBLEPeripheral_processStateChangeEvt(gaprole_States_t newState)
       {
         linkDBInfo_t linkInfo;
         uint8_t numActive = 0;
+        uint16_t connInterval = 0;
 
-        Util_startClock(&periodicClock);
+        // Start from the interval the central connected with
+        GAPRole_GetParameter(GAPROLE_CONN_INTERVAL, &connInterval);
+        fastConnActive = (connInterval != 0 &&
+                          connInterval <= SBP_FAST_CONN_MAX_INTERVAL);
 
-        numActive = linkDB_NumActive();
+        // Give the new client the current status at its first events
+        statusPending = FALSE;
+        SimpleBLEPeripheral_statusChanged();
 
-        // Use numActive to determine the connection handle of the last
-        // connection
-        if ( linkDB_GetInfo( numActive - 1, &linkInfo ) == SUCCESS )
-        {
-          Display_print1(dispHandle, 2, 0, "Num Conns: %d", (uint16_t)numActive);
-          Display_print0(dispHandle, 3, 0, Util_convertBdAddr2Str(linkInfo.addr));
+#ifndef FEATURE_OAD_ONCHIP
+        // Current diagnostics, then one every SBP_DIAG_PERIOD
+        SimpleBLEPeripheral_updateDiag();
+        Util_startClock(&diagClock);
+#endif //!FEATURE_OAD_ONCHIP
+
+        // Advertising restarts right after a disconnect; have the fast
+        // interval in place by then.
+        Util_stopClock(&advStepClock);
+        advStep = 0;
+        SimpleBLEPeripheral_setAdvInterval(0);
+
+        // A connection may have beaten an interval change; make sure
+        // advertising is still enabled for after the disconnect.
+        if (advRestartPending)
+        {
+          uint8_t advertEnabled = TRUE;
+
+          advRestartPending = FALSE;
+          GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                               &advertEnabled);
+        }
+
+        numActive = linkDB_NumActive();
+
+        // Use numActive to determine the connection handle of the last
+        // connection
+        if ( linkDB_GetInfo( numActive - 1, &linkInfo ) == SUCCESS )
+        {
+          Display_print1(dispHandle, 2, 0, "Num Conns: %d", (uint16_t)numActive);
+          Display_print0(dispHandle, 3, 0, Util_convertBdAddr2Str(linkInfo.addr));
         }
         else
         {
@@ -1216,8 +2456,33 @@ static void SimpleBLEPeripheral_processStateChangeEvt(gaprole_States_t newState)
       break;
 
     case GAPROLE_WAITING:
-      Util_stopClock(&periodicClock);
+      if (advRestartPending)
+      {
+        uint8_t advertEnabled = TRUE;
+
+        // Advertising was only stopped to change the interval.
+        advRestartPending = FALSE;
+        GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                             &advertEnabled);
+        break;
+      }
+
+      SimpleBLEPeripheral_setAdvStep(0);
+      Util_stopClock(&connIdleClock);
+      statusPending = FALSE;
+      fastConnActive = FALSE;
+      fastConnRequested = FALSE;
       SimpleBLEPeripheral_freeAttRsp(bleNotConnected);
+#ifndef FEATURE_OAD_ONCHIP
+      SimpleProfile_ReleaseConns();
+      SimpleBLEPeripheral_releaseConnRx();
+
+      // Nobody left to read the diagnostics
+      if (linkDB_NumActive() == 0)
+      {
+        Util_stopClock(&diagClock);
+      }
+#endif //!FEATURE_OAD_ONCHIP
 
       Display_print0(dispHandle, 2, 0, "Disconnected");
 
@@ -1226,7 +2491,21 @@ static void SimpleBLEPeripheral_processStateChangeEvt(gaprole_States_t newState)
       break;
 
     case GAPROLE_WAITING_AFTER_TIMEOUT:
+      SimpleBLEPeripheral_setAdvStep(0);
+      Util_stopClock(&connIdleClock);
+      fastConnActive = FALSE;
+      fastConnRequested = FALSE;
       SimpleBLEPeripheral_freeAttRsp(bleNotConnected);
+#ifndef FEATURE_OAD_ONCHIP
+      SimpleProfile_ReleaseConns();
+      SimpleBLEPeripheral_releaseConnRx();
+
+      // Nobody left to read the diagnostics
+      if (linkDB_NumActive() == 0)
+      {
+        Util_stopClock(&diagClock);
+      }
+#endif //!FEATURE_OAD_ONCHIP
 
       Display_print0(dispHandle, 2, 0, "Timed Out");
 
@@ -1249,7 +2528,7 @@ static void SimpleBLEPeripheral_processStateChangeEvt(gaprole_States_t newState)
   }
 
   // Update the state
-  //gapProfileState = newState;
+  gapProfileState = newState;
 }
 
 #ifndef FEATURE_OAD_ONCHIP
@@ -1267,119 +2546,1513 @@ static void SimpleBLEPeripheral_charValueChangeCB(uint8_t paramID)
 {
   SimpleBLEPeripheral_enqueueMsg(SBP_CHAR_CHANGE_EVT, paramID);
 }
-#endif //!FEATURE_OAD_ONCHIP
 
-static void setTime(int year, int month, int day, int hour, int min){
-    memset(&ltm, 0, sizeof(struct tm));
-    // Set the struct date / time to 2016 / 5 / 21 18:00:00
-    ltm.tm_year = year - 1900;
-    ltm.tm_mon = month - 1;
-    ltm.tm_mday = day;
-    ltm.tm_hour = hour;
-    ltm.tm_min = min;
-    ltm.tm_sec = 0;
-    prevDate = day;
-    int_to_bin_digit(day);
-    // Convert to number of seconds, this will also fill up tm_wday and tm_yday
-    time_t seconds = mktime(&ltm);
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_blobCB
+ *
+ * @brief   Callback from Simple Profile with a complete Characteristic 6
+ *          value.
+ *
+ * @param   connHandle - connection the value was written on.
+ * @param   pValue     - the value.
+ * @param   len        - length of the value.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_blobCB(uint16_t connHandle, uint8_t *pValue,
+                                       uint16_t len)
+{
+  SimpleBLEPeripheral_enqueueData(SBP_BLOB_EVT, connHandle, pValue, len);
+}
 
-    // Convert the struct date to string
-    //char* currTime = asctime(&ltm);
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_streamCB
+ *
+ * @brief   Callback from Simple Profile with a Characteristic 3 write.
+ *          Called for every write, so several frames may arrive in one
+ *          connection event.
+ *
+ * @param   connHandle - connection the value was written on.
+ * @param   pValue     - legacy byte, or sequence number followed by data.
+ * @param   len        - length of the value.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_streamCB(uint16_t connHandle, uint8_t *pValue,
+                                         uint16_t len)
+{
+  SimpleBLEPeripheral_enqueueData(SBP_STREAM_EVT, connHandle, pValue, len);
+}
 
-    // Convert the number of seconds to string, just to check
-    //currTime = ctime(&seconds);
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processBlobEvt
+ *
+ * @brief   Apply a time/alarm configuration written to Characteristic 6
+ *          in one operation. It uses the same "YYYY/MM/DD hh:mm hh:mm"
+ *          text as the CHAR3 paths.
+ *
+ * @param   pMsg - the value and the connection it came from.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processBlobEvt(sbpDataEvt_t *pMsg)
+{
+  char timeStr[SBP_TIME_STR_LEN + 1];
 
-    // Set the date into the system
-    Seconds_set(seconds);
+  if (pMsg->len != SBP_TIME_STR_LEN)
+  {
+    return;
+  }
+
+  memcpy(timeStr, pMsg->pData, pMsg->len);
+  timeStr[pMsg->len] = '\0';
+
+  writeTime(timeStr);
+  ManageTime(timeStr);
+
+  // Let clients read back the configuration in effect
+  SimpleProfile_SetParameter(SIMPLEPROFILE_CHAR6, (uint8_t)pMsg->len,
+                             pMsg->pData);
 }
 
-static void getCurrentDateAndTime(){
-    UInt32 seconds = Seconds_get();
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processStreamEvt
+ *
+ * @brief   Process a Characteristic 3 write. A single byte is the next
+ *          character of the byte-by-byte protocol. Anything longer is a
+ *          stream frame: [seq][data...]. Frames must arrive in sequence;
+ *          a gap or repeat is answered with the last acknowledgement so
+ *          the client resends from there. So is a frame past the credits
+ *          of the last acknowledgement, which the client should not have
+ *          sent. Sequence number 0 mid-stream restarts the stream. Both
+ *          feed the connection's own time/alarm string.
+ *
+ * @param   pMsg - the write and the connection it came from.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processStreamEvt(sbpDataEvt_t *pMsg)
+{
+  sbpConnRx_t *pRx = SimpleBLEPeripheral_findConnRx(pMsg->connHandle, TRUE);
+  uint8_t seq = pMsg->pData[0];
+  bool complete;
 
-    ltm = *localtime(&seconds);
+  // A time-set is a burst of writes; speed the link up.
+  SimpleBLEPeripheral_requestFastConn();
 
-    char buffer [15];
-    strftime (buffer, 15, "%d/%m/%y %H:%M", &ltm);
-    writeTime(buffer);
-    if(ltm.tm_mday != prevDate){
-        prevDate = ltm.tm_mday;
-        int_to_bin_digit(ltm.tm_mday);
-    }
+  if (pRx == NULL)
+  {
+    return;
+  }
+
+  if (pMsg->len == 1)
+  {
+    char b[2];
+    b[0] = (char)pMsg->pData[0];
+    b[1]  = '\0';
+    writeTime(b);
+    SimpleBLEPeripheral_receiveTimeBytes(pRx, pMsg->pData, 1);
+
+    Display_print1(dispHandle, 4, 0, "Char 3: %d", (uint16_t)pMsg->pData[0]);
+    return;
+  }
+
+  if (seq == 0 && pRx->nextSeq != 0)
+  {
+    pRx->nextSeq = 0;
+    pRx->ackedSeq = 0xFF;
+    pRx->credits = SBP_STREAM_WINDOW;
+    pRx->ackPending = FALSE;
+    pRx->rxLen = 0;
+  }
+
+  if (seq != pRx->nextSeq ||
+      (uint8_t)(seq - pRx->ackedSeq) > pRx->credits)
+  {
+    SimpleBLEPeripheral_sendStreamAck(pRx);
+    return;
+  }
+
+  pRx->nextSeq++;
+
+  complete = SimpleBLEPeripheral_receiveTimeBytes(pRx, pMsg->pData + 1,
+                                                  pMsg->len - 1);
+
+  // Acknowledge at half the granted window so the client never stalls,
+  // and at the end of a message so it knows the message was taken.
+  if (complete ||
+      (uint8_t)(seq - pRx->ackedSeq) >= pRx->credits / 2)
+  {
+    SimpleBLEPeripheral_sendStreamAck(pRx);
+  }
 }
 
-static int startRing(){
-    UInt32 seconds = Seconds_get();
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_sendStreamAck
+ *
+ * @brief   Notify [last seq accepted][credits] on Characteristic 4 to
+ *          the stream's client. If no buffer is available the
+ *          acknowledgement is retried after SBP_TX_RETRY_PERIOD, and so
+ *          is one that granted no credits, to reopen the window once
+ *          the queue has drained.
+ *
+ * @param   pRx - receive state of the stream to acknowledge.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_sendStreamAck(sbpConnRx_t *pRx)
+{
+  uint8_t ack[SIMPLEPROFILE_CHAR4_LEN];
+  bStatus_t status;
 
-    ltm = *localtime(&seconds);
-    char currTime [6];
-    strftime (currTime, 6, "%H", &ltm);
-    int hours = atoi(currTime);
-    strftime (currTime, 6, "%M", &ltm);
-    int minutes = atoi(currTime);
-    if(hours == wantedTime[0] && minutes == wantedTime[1]){
-        PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, PIN_GPIO_HIGH);//PIN_GPIO_HIGH
-        return 0;
+  ack[0] = pRx->nextSeq - 1;
+  ack[1] = SimpleBLEPeripheral_streamCredits();
+
+  // Still nothing to grant; the client has heard that already
+  if (ack[1] == 0 && pRx->credits == 0 && ack[0] == pRx->ackedSeq)
+  {
+    Util_startClock(&txRetryClock);
+    return;
+  }
+
+  status = SimpleProfile_NotifyChar4(pRx->connHandle, sizeof(ack), ack);
+
+  if (status == bleMemAllocError || status == MSG_BUFFER_NOT_AVAIL)
+  {
+    pRx->ackPending = TRUE;
+    Util_startClock(&txRetryClock);
+  }
+  else
+  {
+    // Sent, or the client does not listen for acknowledgements.
+    pRx->ackedSeq = ack[0];
+    pRx->credits = ack[1];
+    pRx->ackPending = (ack[1] == 0);
+
+    if (pRx->ackPending)
+    {
+      Util_startClock(&txRetryClock);
     }
-    return -1;
+  }
 }
-char* split(char* line, char delimiter){ //for parsing config file
-    char* start = strchr(line,delimiter);
-    start++;
-    return start;
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_streamCredits
+ *
+ * @brief   Number of stream frames that can be taken now: what is left
+ *          of SBP_STREAM_WINDOW after the messages still in the
+ *          application queue, and no more than the heap past
+ *          SBP_STREAM_HEAP_RESERVE can hold.
+ *
+ * @param   None.
+ *
+ * @return  Credits to grant.
+ */
+static uint8_t SimpleBLEPeripheral_streamCredits(void)
+{
+  ICall_heapStats_t heap;
+  uint16_t queued = diagStats.appQueueDepth;
+  uint32_t credits;
+  uint32_t fit;
+
+  credits = (queued < SBP_STREAM_WINDOW) ? SBP_STREAM_WINDOW - queued : 0;
+
+  ICall_getHeapStats(&heap);
+  fit = (heap.totalFreeSize > SBP_STREAM_HEAP_RESERVE) ?
+        (heap.totalFreeSize - SBP_STREAM_HEAP_RESERVE) /
+        SBP_STREAM_FRAME_COST : 0;
+
+  return ((uint8_t)MIN(credits, fit));
 }
-static void parseTime(char* timeStr){
-    char buffer[5];
-    snprintf(buffer, 5, "%s", timeStr);
-    timeToSet[0] = atoi(buffer);
-    timeStr = split(timeStr, '/');
-    char buf[3];
-    snprintf(buf, 3, "%s", timeStr);
-    timeToSet[1] = atoi(buf);
-    timeStr = split(timeStr, '/');
-    snprintf(buf, 3, "%s", timeStr);
-    timeToSet[2] = atoi(buf);
-    timeStr = split(timeStr, ' ');
-    snprintf(buf, 3, "%s", timeStr);
-    timeToSet[3] = atoi(buf);
-    timeStr = split(timeStr, ':');
-    snprintf(buf, 3, "%s", timeStr);
-    timeToSet[4] = atoi(buf);
-    timeStr = split(timeStr, ' ');
-    snprintf(buf, 3, "%s", timeStr);
-    wantedTime[0] = atoi(buf);
-    timeStr = split(timeStr, ':');
-    snprintf(buf, 3, "%s", timeStr);
-    wantedTime[1] = atoi(buf);
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_receiveTimeBytes
+ *
+ * @brief   Append received bytes to a connection's time/alarm string and
+ *          apply it once SBP_TIME_STR_LEN bytes have arrived.
+ *
+ * @param   pRx   - receive state of the connection.
+ * @param   pData - received bytes.
+ * @param   len   - number of bytes.
+ *
+ * @return  TRUE if a complete string was applied.
+ */
+static bool SimpleBLEPeripheral_receiveTimeBytes(sbpConnRx_t *pRx,
+                                                 uint8_t *pData, uint16_t len)
+{
+  bool complete = FALSE;
+
+  while (len--)
+  {
+    pRx->rxBuf[pRx->rxLen++] = (char)*pData++;
+    pRx->rxBuf[pRx->rxLen] = '\0';
+
+    if (pRx->rxLen == SBP_TIME_STR_LEN)
+    {
+      ManageTime(pRx->rxBuf);
+      pRx->rxLen = 0;
+      complete = TRUE;
+    }
+  }
+
+  return (complete);
 }
-static void ManageTime(){
-    parseTime(buf);
-    setTime(timeToSet[0], timeToSet[1], timeToSet[2], timeToSet[3], timeToSet[4]);
-    int startRingFlag = 1;
-    while(1){
-        getCurrentDateAndTime();
-        if(startRingFlag){
-            if(startRing() == 0){
-                startRingFlag = 0;
-            }
-        }
-        sleep(60);
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_findConnRx
+ *
+ * @brief   Find the receive state of a connection.
+ *
+ * @param   connHandle - connection handle.
+ * @param   alloc      - TRUE to claim a free slot if none is found.
+ *
+ * @return  Pointer to the receive state, or NULL.
+ */
+static sbpConnRx_t *SimpleBLEPeripheral_findConnRx(uint16_t connHandle,
+                                                   bool alloc)
+{
+  sbpConnRx_t *pFree = NULL;
+
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
+  {
+    if (connRx[i].connHandle == connHandle)
+    {
+      return (&connRx[i]);
+    }
+
+    if (pFree == NULL && connRx[i].connHandle == INVALID_CONNHANDLE)
+    {
+      pFree = &connRx[i];
     }
+  }
+
+  if (alloc && pFree != NULL)
+  {
+    memset(pFree, 0, sizeof(sbpConnRx_t));
+    pFree->connHandle = connHandle;
+    pFree->ackedSeq = 0xFF;
+    pFree->credits = SBP_STREAM_WINDOW;
+  }
+  else
+  {
+    pFree = NULL;
+  }
+
+  return (pFree);
 }
-static void resetScreen(){
-    //reset screen
-    PIN_setOutputValue(lcdHandle, Board_DIO25_ANALOG, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO22, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO21, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO15, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO12, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO29_ANALOG, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO28_ANALOG, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO24_ANALOG, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO23_ANALOG, 0);
-    PIN_setOutputValue(lcdHandle, Board_DIO26_ANALOG, PIN_GPIO_HIGH);
-    usleep(2000);
-    PIN_setOutputValue(lcdHandle, Board_DIO26_ANALOG, 0);
-    usleep(200);
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_releaseConnRx
+ *
+ * @brief   Return the receive state of connections that have gone down
+ *          to the pool and drop their queued mailbox responses and
+ *          transfer.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_releaseConnRx(void)
+{
+  bool ackPending = FALSE;
+  uint8_t count = mboxRspCount;
+
+  if (tx.connHandle != INVALID_CONNHANDLE && !linkDB_Up(tx.connHandle))
+  {
+    tx.connHandle = INVALID_CONNHANDLE;
+  }
+
+  // Drop mailbox responses for links that have gone down, keeping order
+  mboxRspCount = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    sbpMboxRsp_t *pRsp = &mboxRspQueue[(mboxRspHead + i) %
+                                       SBP_MBOX_RSP_QUEUE_SIZE];
+
+    if (linkDB_Up(pRsp->connHandle))
+    {
+      mboxRspQueue[(mboxRspHead + mboxRspCount) %
+                   SBP_MBOX_RSP_QUEUE_SIZE] = *pRsp;
+      mboxRspCount++;
+    }
+  }
+
+  for (uint8_t i = 0; i < linkDBNumConns; i++)
+  {
+    if (connRx[i].connHandle != INVALID_CONNHANDLE &&
+        !linkDB_Up(connRx[i].connHandle))
+    {
+      connRx[i].connHandle = INVALID_CONNHANDLE;
+    }
+
+    if (connRx[i].connHandle != INVALID_CONNHANDLE && connRx[i].ackPending)
+    {
+      ackPending = TRUE;
+    }
+  }
+
+  if (!ackPending && mboxRspCount == 0)
+  {
+    Util_stopClock(&txRetryClock);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mailboxCB
+ *
+ * @brief   Callback from the Mailbox Profile with a request. Called for
+ *          every write, so several requests may arrive in one
+ *          connection event. A request that cannot be queued is noted
+ *          so the task can refuse it; otherwise the client would never
+ *          hear of it.
+ *
+ * @param   connHandle - connection the request was written on.
+ * @param   pValue     - the request.
+ * @param   len        - length of the request.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_mailboxCB(uint16_t connHandle, uint8_t *pValue,
+                                          uint16_t len)
+{
+  if (!SimpleBLEPeripheral_enqueueData(SBP_MAILBOX_EVT, connHandle, pValue,
+                                       len) &&
+      len >= SBP_MBOX_REQ_HDR_LEN)
+  {
+    UInt key = Hwi_disable();
+
+    if (mboxDropCount < SBP_MBOX_DROP_QUEUE_SIZE)
+    {
+      mboxDrops[mboxDropCount].connHandle = connHandle;
+      mboxDrops[mboxDropCount].seq = pValue[0];
+      mboxDrops[mboxDropCount].opcode = pValue[1];
+      mboxDropCount++;
+    }
+    Hwi_restore(key);
+
+    Event_post(syncEvent, SBP_MBOX_DROP_EVT);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_ctsTimeWriteCB
+ *
+ * @brief   Callback from the Current Time Service with a validated
+ *          Current Time written by a client.
+ *
+ * @param   connHandle - connection the value was written on.
+ * @param   pValue     - the Current Time value.
+ * @param   len        - length of the value.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_ctsTimeWriteCB(uint16_t connHandle,
+                                               uint8_t *pValue, uint16_t len)
+{
+  SimpleBLEPeripheral_enqueueData(SBP_CTS_EVT, connHandle, pValue, len);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processCtsEvt
+ *
+ * @brief   Set the clock from a Current Time written by a client:
+ *          [year lo][year hi][month][day][hours][minutes][seconds]
+ *          [day of week][fractions][adjust reason].
+ *
+ * @param   pMsg - the value and the connection it came from.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processCtsEvt(sbpDataEvt_t *pMsg)
+{
+  uint8_t *pTime = pMsg->pData;
+  UInt32 localSecs = Seconds_get();
+
+  setTime(BUILD_UINT16(pTime[0], pTime[1]), pTime[2], pTime[3], pTime[4],
+          pTime[5]);
+
+  // setTime() starts the minute at 0 seconds
+  Seconds_set(Seconds_get() + pTime[6]);
+
+  // Only a time from an external reference measures the drift. Time
+  // zone and DST changes move the clock by more than its drift.
+  if (pTime[9] & (CTS_ADJUST_TIME_ZONE | CTS_ADJUST_DST))
+  {
+    SimpleBLEPeripheral_driftSync(localSecs, Seconds_get(), FALSE);
+  }
+  else if (pTime[9] & CTS_ADJUST_EXTERNAL_REF)
+  {
+    SimpleBLEPeripheral_driftSync(localSecs, Seconds_get(), TRUE);
+  }
+  else
+  {
+    SimpleBLEPeripheral_driftShift(localSecs, Seconds_get());
+  }
+
+  SimpleBLEPeripheral_timeChanged(pTime[9] ? pTime[9] : CTS_ADJUST_MANUAL);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processMailboxEvt
+ *
+ * @brief   Run a mailbox request through the opcode table and answer
+ *          it. Every request with a header gets exactly one final
+ *          response, carrying the request's sequence number and opcode;
+ *          a dump sends its records ahead of it.
+ *
+ *          A request is only run when its response has room in the
+ *          queue; otherwise it is refused with SBP_MBOX_ERR_BUSY. A
+ *          repeat of the last request that ran on the connection (same
+ *          sequence number and opcode, as a client resends it when the
+ *          response is lost) gets the same response without running
+ *          again.
+ *
+ * @param   pMsg - the request and the connection it came from.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processMailboxEvt(sbpDataEvt_t *pMsg)
+{
+  sbpConnRx_t *pRx;
+  uint8_t rsp[MAILBOX_MAX_LEN];
+  uint8_t rspLen = 0;
+  uint8_t paramLen;
+
+  // Without a header there is no sequence number to answer with
+  if (pMsg->len < SBP_MBOX_REQ_HDR_LEN)
+  {
+    return;
+  }
+
+  // Commands tend to come in bursts; speed the link up.
+  SimpleBLEPeripheral_requestFastConn();
+
+  pRx = SimpleBLEPeripheral_findConnRx(pMsg->connHandle, TRUE);
+  if (pRx != NULL && pRx->lastRspLen > 0 &&
+      pRx->lastRsp[0] == pMsg->pData[0] && pRx->lastRsp[1] == pMsg->pData[1])
+  {
+    SimpleBLEPeripheral_sendMailboxRsp(pMsg->connHandle, pRx->lastRsp,
+                                       pRx->lastRspLen);
+    return;
+  }
+
+  // Reserve the response's place before the request changes anything
+  SimpleBLEPeripheral_flushMailboxRsp();
+  if (mboxRspCount == SBP_MBOX_RSP_QUEUE_SIZE)
+  {
+    SimpleBLEPeripheral_refuseMailboxReq(pMsg->connHandle, pMsg->pData[0],
+                                         pMsg->pData[1]);
+    return;
+  }
+
+  paramLen = (uint8_t)(pMsg->len - SBP_MBOX_REQ_HDR_LEN);
+
+  rsp[0] = pMsg->pData[0];
+  rsp[1] = pMsg->pData[1];
+  rsp[2] = SBP_MBOX_ERR_OPCODE;
+
+  for (uint8_t i = 0; i < sizeof(mboxCmds) / sizeof(mboxCmds[0]); i++)
+  {
+    if (mboxCmds[i].opcode == rsp[1])
+    {
+      if (paramLen < mboxCmds[i].minLen || paramLen > mboxCmds[i].maxLen)
+      {
+        rsp[2] = SBP_MBOX_ERR_LENGTH;
+      }
+      else
+      {
+        rsp[2] = mboxCmds[i].pfnHandler(pMsg->pData + SBP_MBOX_REQ_HDR_LEN,
+                                        paramLen, rsp + SBP_MBOX_RSP_HDR_LEN,
+                                        &rspLen);
+      }
+      break;
+    }
+  }
+
+  if (rsp[2] == SBP_MBOX_PENDING)
+  {
+    // The TX engine sends the records and the final response. A dump
+    // only reads, so a repeat of it simply runs again.
+    if (pRx != NULL)
+    {
+      pRx->lastRspLen = 0;
+    }
+
+    SimpleBLEPeripheral_startTx(pMsg->connHandle, rsp[0], rsp[1]);
+    return;
+  }
+
+  if (pRx != NULL)
+  {
+    pRx->lastRspLen = SBP_MBOX_RSP_HDR_LEN + rspLen;
+    memcpy(pRx->lastRsp, rsp, pRx->lastRspLen);
+  }
+
+  SimpleBLEPeripheral_sendMailboxRsp(pMsg->connHandle, rsp,
+                                     SBP_MBOX_RSP_HDR_LEN + rspLen);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_refuseMailboxReq
+ *
+ * @brief   Answer a request that was not run with SBP_MBOX_ERR_BUSY, so
+ *          the client sends it again later. With the response queue
+ *          full the answer is sent ahead of the queued responses, which
+ *          is harmless as nothing was done; if that finds no buffer
+ *          either, the client's own timeout has to serve.
+ *
+ * @param   connHandle - connection the request came from.
+ * @param   seq        - sequence number of the request.
+ * @param   opcode     - opcode of the request.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_refuseMailboxReq(uint16_t connHandle,
+                                                 uint8_t seq, uint8_t opcode)
+{
+  uint8_t rsp[SBP_MBOX_RSP_HDR_LEN];
+
+  rsp[0] = seq;
+  rsp[1] = opcode;
+  rsp[2] = SBP_MBOX_ERR_BUSY;
+
+  if (mboxRspCount < SBP_MBOX_RSP_QUEUE_SIZE)
+  {
+    SimpleBLEPeripheral_sendMailboxRsp(connHandle, rsp, sizeof(rsp));
+  }
+  else
+  {
+    VOID Mailbox_Notify(connHandle, rsp, sizeof(rsp));
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_refuseDroppedMailboxReqs
+ *
+ * @brief   Refuse the mailbox requests that the application queue could
+ *          not take.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_refuseDroppedMailboxReqs(void)
+{
+  sbpMboxDrop_t drops[SBP_MBOX_DROP_QUEUE_SIZE];
+  uint8_t count;
+  UInt key = Hwi_disable();
+
+  count = mboxDropCount;
+  memcpy(drops, mboxDrops, sizeof(sbpMboxDrop_t) * count);
+  mboxDropCount = 0;
+  Hwi_restore(key);
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    SimpleBLEPeripheral_refuseMailboxReq(drops[i].connHandle, drops[i].seq,
+                                         drops[i].opcode);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_sendMailboxRsp
+ *
+ * @brief   Notify a mailbox response to the client that sent the
+ *          request. Responses that find no buffer are queued, in order,
+ *          and retried after SBP_TX_RETRY_PERIOD. Requests are only run
+ *          with room in the queue, so a final response always has its
+ *          place.
+ *
+ * @param   connHandle - connection to answer on.
+ * @param   pRsp       - the response.
+ * @param   len        - length of the response.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_sendMailboxRsp(uint16_t connHandle,
+                                               uint8_t *pRsp, uint8_t len)
+{
+  // Responses must not overtake the ones already waiting
+  if (mboxRspCount == 0)
+  {
+    bStatus_t status = Mailbox_Notify(connHandle, pRsp, len);
+
+    if (status != bleMemAllocError && status != MSG_BUFFER_NOT_AVAIL)
+    {
+      // Sent, or the client does not listen for responses.
+      return;
+    }
+  }
+
+  if (mboxRspCount < SBP_MBOX_RSP_QUEUE_SIZE)
+  {
+    sbpMboxRsp_t *pQueued = &mboxRspQueue[(mboxRspHead + mboxRspCount) %
+                                          SBP_MBOX_RSP_QUEUE_SIZE];
+
+    pQueued->connHandle = connHandle;
+    pQueued->len = len;
+    memcpy(pQueued->data, pRsp, len);
+    mboxRspCount++;
+
+    Util_startClock(&txRetryClock);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_flushMailboxRsp
+ *
+ * @brief   Send queued mailbox responses until the queue is empty or
+ *          buffers run out again.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_flushMailboxRsp(void)
+{
+  while (mboxRspCount > 0)
+  {
+    sbpMboxRsp_t *pRsp = &mboxRspQueue[mboxRspHead];
+    bStatus_t status = Mailbox_Notify(pRsp->connHandle, pRsp->data,
+                                      pRsp->len);
+
+    if (status == bleMemAllocError || status == MSG_BUFFER_NOT_AVAIL)
+    {
+      Util_startClock(&txRetryClock);
+      break;
+    }
+
+    mboxRspHead = (mboxRspHead + 1) % SBP_MBOX_RSP_QUEUE_SIZE;
+    mboxRspCount--;
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxSetTime
+ *
+ * @brief   SBP_MBOX_OP_SET_TIME: set the clock.
+ *          Parameters: [year lo][year hi][month][day][hour][minute].
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data (none).
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxSetTime(uint8_t *pParams, uint8_t len,
+                                               uint8_t *pRsp, uint8_t *pRspLen)
+{
+  uint16_t year = BUILD_UINT16(pParams[0], pParams[1]);
+  UInt32 localSecs = Seconds_get();
+
+  if (year < 1970 || pParams[2] < 1 || pParams[2] > 12 ||
+      pParams[3] < 1 || pParams[3] > 31 || pParams[4] > 23 || pParams[5] > 59)
+  {
+    return (SBP_MBOX_ERR_PARAM);
+  }
+
+  setTime(year, pParams[2], pParams[3], pParams[4], pParams[5]);
+  SimpleBLEPeripheral_driftShift(localSecs, Seconds_get());
+  SimpleBLEPeripheral_timeChanged(CTS_ADJUST_MANUAL);
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxAddAlarm
+ *
+ * @brief   SBP_MBOX_OP_ADD_ALARM: add an alarm.
+ *          Parameters: [hour][minute][weekday mask, 0 = once].
+ *          Response: [index].
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data.
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxAddAlarm(uint8_t *pParams, uint8_t len,
+                                                uint8_t *pRsp, uint8_t *pRspLen)
+{
+  if (pParams[0] > 23 || pParams[1] > 59 || pParams[2] > 0x7F)
+  {
+    return (SBP_MBOX_ERR_PARAM);
+  }
+
+  // Slot 0 is left to the text configuration
+  for (uint8_t i = 1; i < SBP_MAX_ALARMS; i++)
+  {
+    if (alarms[i].hour == SBP_ALARM_FREE)
+    {
+      alarms[i].hour = pParams[0];
+      alarms[i].minute = pParams[1];
+      alarms[i].days = pParams[2];
+
+      SimpleBLEPeripheral_statusChanged();
+
+      pRsp[0] = i;
+      *pRspLen = 1;
+
+      return (SBP_MBOX_SUCCESS);
+    }
+  }
+
+  return (SBP_MBOX_ERR_NO_RESOURCES);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxDelAlarm
+ *
+ * @brief   SBP_MBOX_OP_DEL_ALARM: delete an alarm.
+ *          Parameters: [index].
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data (none).
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxDelAlarm(uint8_t *pParams, uint8_t len,
+                                                uint8_t *pRsp, uint8_t *pRspLen)
+{
+  if (pParams[0] >= SBP_MAX_ALARMS)
+  {
+    return (SBP_MBOX_ERR_PARAM);
+  }
+
+  alarms[pParams[0]].hour = SBP_ALARM_FREE;
+  SimpleBLEPeripheral_statusChanged();
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxListAlarms
+ *
+ * @brief   SBP_MBOX_OP_LIST_ALARMS: list the alarms.
+ *          Response: [count] then [index][hour][minute][weekday mask]
+ *          for each alarm in use.
+ *
+ * @param   pParams - request parameters (none).
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data.
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxListAlarms(uint8_t *pParams,
+                                                  uint8_t len, uint8_t *pRsp,
+                                                  uint8_t *pRspLen)
+{
+  uint8_t *p = pRsp + 1;
+
+  pRsp[0] = 0;
+
+  for (uint8_t i = 0; i < SBP_MAX_ALARMS; i++)
+  {
+    if (alarms[i].hour != SBP_ALARM_FREE)
+    {
+      *p++ = i;
+      *p++ = alarms[i].hour;
+      *p++ = alarms[i].minute;
+      *p++ = alarms[i].days;
+      pRsp[0]++;
+    }
+  }
+
+  *pRspLen = (uint8_t)(p - pRsp);
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxReadStats
+ *
+ * @brief   SBP_MBOX_OP_READ_STATS: read the event loop counters.
+ *          Response: [wakeups][stack msgs][app msgs] (4 bytes each),
+ *          [max batch][ATT responses dropped] (2 bytes each), all
+ *          little endian.
+ *
+ * @param   pParams - request parameters (none).
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data.
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxReadStats(uint8_t *pParams, uint8_t len,
+                                                 uint8_t *pRsp,
+                                                 uint8_t *pRspLen)
+{
+  uint32_t counters[3];
+  uint8_t *p = pRsp;
+
+  counters[0] = sbpLoopStats.wakeups;
+  counters[1] = sbpLoopStats.stackMsgs;
+  counters[2] = sbpLoopStats.appMsgs;
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    *p++ = BREAK_UINT32(counters[i], 0);
+    *p++ = BREAK_UINT32(counters[i], 1);
+    *p++ = BREAK_UINT32(counters[i], 2);
+    *p++ = BREAK_UINT32(counters[i], 3);
+  }
+
+  *p++ = LO_UINT16(sbpLoopStats.maxBatch);
+  *p++ = HI_UINT16(sbpLoopStats.maxBatch);
+  *p++ = LO_UINT16(attRspStats.dropped);
+  *p++ = HI_UINT16(attRspStats.dropped);
+
+  *pRspLen = (uint8_t)(p - pRsp);
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxDisplayText
+ *
+ * @brief   SBP_MBOX_OP_DISPLAY_TEXT: show text on the LCD until the
+ *          next clock refresh. Parameters: up to SBP_DISPLAY_LEN
+ *          characters.
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data (none).
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxDisplayText(uint8_t *pParams,
+                                                   uint8_t len, uint8_t *pRsp,
+                                                   uint8_t *pRspLen)
+{
+  char text[SBP_DISPLAY_LEN + 1];
+
+  // writeTime() always writes SBP_DISPLAY_LEN characters
+  memset(text, ' ', SBP_DISPLAY_LEN);
+  memcpy(text, pParams, len);
+  text[SBP_DISPLAY_LEN] = '\0';
+
+  writeTime(text);
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxDump
+ *
+ * @brief   SBP_MBOX_OP_DUMP: stream all records of a source.
+ *          Parameters: [source]. The records follow as responses with
+ *          status SBP_MBOX_MORE, then a final response with the record
+ *          count; see SimpleBLEPeripheral_pumpTx.
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data (none).
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  SBP_MBOX_PENDING if the transfer was set up, else the
+ *          response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxDump(uint8_t *pParams, uint8_t len,
+                                            uint8_t *pRsp, uint8_t *pRspLen)
+{
+  if (pParams[0] >= sizeof(txSources) / sizeof(txSources[0]))
+  {
+    return (SBP_MBOX_ERR_PARAM);
+  }
+
+  if (tx.connHandle != INVALID_CONNHANDLE)
+  {
+    return (SBP_MBOX_ERR_BUSY);
+  }
+
+  tx.pfnSource = txSources[pParams[0]];
+
+  return (SBP_MBOX_PENDING);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_mboxDrift
+ *
+ * @brief   SBP_MBOX_OP_DRIFT: read the clock drift estimate.
+ *          Parameters: optional [1] to forget the estimate first.
+ *          Response: [drift corrected, ppb (4)][sync intervals (2)]
+ *          [hours covered (2)], little endian; the drift is positive
+ *          when the clock runs fast and 0 until enough is known.
+ *
+ * @param   pParams - request parameters.
+ * @param   len     - length of the parameters.
+ * @param   pRsp    - response data.
+ * @param   pRspLen - length of the response data.
+ *
+ * @return  Response status.
+ */
+static uint8_t SimpleBLEPeripheral_mboxDrift(uint8_t *pParams, uint8_t len,
+                                             uint8_t *pRsp, uint8_t *pRspLen)
+{
+  uint16_t hours;
+
+  if (len == 1)
+  {
+    if (pParams[0] != 1)
+    {
+      return (SBP_MBOX_ERR_PARAM);
+    }
+
+    SimpleBLEPeripheral_driftForget();
+    VOID osal_snv_write(SBP_NVID_DRIFT, sizeof(driftFit), &driftFit);
+    SimpleBLEPeripheral_driftUpdate();
+  }
+
+  hours = (driftFit.spanX / 3600 < 0xFFFF) ?
+          (uint16_t)(driftFit.spanX / 3600) : 0xFFFF;
+
+  pRsp[0] = BREAK_UINT32(driftPpb, 0);
+  pRsp[1] = BREAK_UINT32(driftPpb, 1);
+  pRsp[2] = BREAK_UINT32(driftPpb, 2);
+  pRsp[3] = BREAK_UINT32(driftPpb, 3);
+  pRsp[4] = LO_UINT16(driftFit.samples);
+  pRsp[5] = HI_UINT16(driftFit.samples);
+  pRsp[6] = LO_UINT16(hours);
+  pRsp[7] = HI_UINT16(hours);
+  *pRspLen = 8;
+
+  return (SBP_MBOX_SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_startTx
+ *
+ * @brief   Start the transfer set up by SimpleBLEPeripheral_mboxDump.
+ *
+ * @param   connHandle - connection the request came from.
+ * @param   seq        - sequence number of the request.
+ * @param   opcode     - opcode of the request.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_startTx(uint16_t connHandle, uint8_t seq,
+                                        uint8_t opcode)
+{
+  tx.connHandle = connHandle;
+  tx.seq = seq;
+  tx.opcode = opcode;
+  tx.index = 0;
+
+  // Refill at the end of every connection event from now on
+  SimpleBLEPeripheral_updateConnEvtNotice(connHandle);
+
+  SimpleBLEPeripheral_pumpTx();
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_pumpTx
+ *
+ * @brief   Hand the controller as many records of the transfer as it has
+ *          buffers for: [seq][opcode][SBP_MBOX_MORE][index][data...],
+ *          index counting modulo 256. Called when the transfer starts and
+ *          at the end of each connection event, so the link carries
+ *          records in every event until the source is exhausted. Then
+ *          [seq][opcode][SBP_MBOX_SUCCESS][count lo][count hi] ends it.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_pumpTx(void)
+{
+  uint8_t frame[MAILBOX_MAX_LEN];
+  uint16_t connHandle = tx.connHandle;
+  uint16_t sent = 0;
+  uint8_t len;
+
+  if (connHandle == INVALID_CONNHANDLE)
+  {
+    return;
+  }
+
+  // Responses queued before the records go out first
+  SimpleBLEPeripheral_flushMailboxRsp();
+  if (mboxRspCount > 0)
+  {
+    txStats.bufferFull++;
+    return;
+  }
+
+  frame[0] = tx.seq;
+  frame[1] = tx.opcode;
+  frame[2] = SBP_MBOX_MORE;
+
+  while ((len = tx.pfnSource(tx.index, &frame[SBP_TX_HDR_LEN])) > 0)
+  {
+    bStatus_t status;
+
+    frame[3] = (uint8_t)tx.index;
+
+    status = Mailbox_Notify(connHandle, frame, SBP_TX_HDR_LEN + len);
+    if (status == bleMemAllocError || status == MSG_BUFFER_NOT_AVAIL)
+    {
+      // Controller full; go on at the end of the next event
+      txStats.bufferFull++;
+      break;
+    }
+    else if (status != SUCCESS)
+    {
+      // The client went away or stopped listening
+      SimpleBLEPeripheral_endTx();
+      return;
+    }
+
+    tx.index++;
+    sent++;
+    txStats.records++;
+  }
+
+  if (sent > 0)
+  {
+    // Keep the fast connection parameters for the whole transfer
+    SimpleBLEPeripheral_requestFastConn();
+  }
+
+  if (len == 0)
+  {
+    frame[2] = SBP_MBOX_SUCCESS;
+    frame[3] = LO_UINT16(tx.index);
+    frame[4] = HI_UINT16(tx.index);
+
+    SimpleBLEPeripheral_endTx();
+    SimpleBLEPeripheral_sendMailboxRsp(connHandle, frame,
+                                       SBP_MBOX_RSP_HDR_LEN + 2);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_endTx
+ *
+ * @brief   Finish or abandon the transfer.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_endTx(void)
+{
+  uint16_t connHandle = tx.connHandle;
+
+  tx.connHandle = INVALID_CONNHANDLE;
+
+  if (linkDB_Up(connHandle))
+  {
+    SimpleBLEPeripheral_updateConnEvtNotice(connHandle);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_alarmRecord
+ *
+ * @brief   Transfer source SBP_TX_SRC_ALARMS: one record per alarm slot,
+ *          [hour][minute][weekday mask], hour SBP_ALARM_FREE for an
+ *          unused slot.
+ *
+ * @param   index - record to fetch.
+ * @param   pBuf  - SBP_TX_RECORD_LEN bytes for the record.
+ *
+ * @return  Length of the record, 0 past the last one.
+ */
+static uint8_t SimpleBLEPeripheral_alarmRecord(uint16_t index, uint8_t *pBuf)
+{
+  if (index >= SBP_MAX_ALARMS)
+  {
+    return (0);
+  }
+
+  pBuf[0] = alarms[index].hour;
+  pBuf[1] = alarms[index].minute;
+  pBuf[2] = alarms[index].days;
+
+  return (3);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_statsRecord
+ *
+ * @brief   Transfer source SBP_TX_SRC_STATS, all little endian:
+ *          0: wakeups, stack, app and OAD messages (4 bytes each)
+ *          1: max batch, ATT responses dropped (2 bytes each), records
+ *             sent, transfer stalls on full buffers, longest wakeup in
+ *             microseconds (4 bytes each)
+ *          2: ATT response retries histogram of sent responses
+ *          3: ATT response retries histogram of failed responses
+ *
+ * @param   index - record to fetch.
+ * @param   pBuf  - SBP_TX_RECORD_LEN bytes for the record.
+ *
+ * @return  Length of the record, 0 past the last one.
+ */
+static uint8_t SimpleBLEPeripheral_statsRecord(uint16_t index, uint8_t *pBuf)
+{
+  uint32_t counters[4];
+  uint16_t *pHist;
+  uint8_t numCounters = 0;
+  uint8_t *p = pBuf;
+
+  switch (index)
+  {
+    case 0:
+      counters[0] = sbpLoopStats.wakeups;
+      counters[1] = sbpLoopStats.stackMsgs;
+      counters[2] = sbpLoopStats.appMsgs;
+      counters[3] = sbpLoopStats.oadMsgs;
+      numCounters = 4;
+      break;
+
+    case 1:
+      *p++ = LO_UINT16(sbpLoopStats.maxBatch);
+      *p++ = HI_UINT16(sbpLoopStats.maxBatch);
+      *p++ = LO_UINT16(attRspStats.dropped);
+      *p++ = HI_UINT16(attRspStats.dropped);
+      counters[0] = txStats.records;
+      counters[1] = txStats.bufferFull;
+      counters[2] = sbpLoopStats.maxWakeUs;
+      numCounters = 3;
+      break;
+
+    case 2:
+    case 3:
+      pHist = (index == 2) ? attRspStats.sentHist : attRspStats.failedHist;
+
+      for (uint8_t i = 0; i < SBP_HIST_BINS; i++)
+      {
+        *p++ = LO_UINT16(pHist[i]);
+        *p++ = HI_UINT16(pHist[i]);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  for (uint8_t i = 0; i < numCounters; i++)
+  {
+    *p++ = BREAK_UINT32(counters[i], 0);
+    *p++ = BREAK_UINT32(counters[i], 1);
+    *p++ = BREAK_UINT32(counters[i], 2);
+    *p++ = BREAK_UINT32(counters[i], 3);
+  }
+
+  return ((uint8_t)(p - pBuf));
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_latencyRecord
+ *
+ * @brief   Transfer source SBP_TX_SRC_LATENCY: the latency histograms
+ *          of each SBP_LAT_* class in turn, queueing delay then handler
+ *          time, each split over as many records as it needs. Record
+ *          index is [class][histogram][part]; a record holds up to
+ *          SBP_TX_RECORD_LEN / 2 buckets from bucket part *
+ *          (SBP_TX_RECORD_LEN / 2), 2 bytes each, little endian.
+ *
+ * @param   index - record to fetch.
+ * @param   pBuf  - SBP_TX_RECORD_LEN bytes for the record.
+ *
+ * @return  Length of the record, 0 past the last one.
+ */
+static uint8_t SimpleBLEPeripheral_latencyRecord(uint16_t index, uint8_t *pBuf)
+{
+  const uint8_t binsPerRecord = SBP_TX_RECORD_LEN / 2;
+  const uint8_t parts = (SBP_LAT_BINS + binsPerRecord - 1) / binsPerRecord;
+  uint8_t latClass = index / (2 * parts);
+  uint8_t first = (index % parts) * binsPerRecord;
+  uint16_t *pHist;
+  uint8_t *p = pBuf;
+
+  if (latClass >= SBP_LAT_CLASSES)
+  {
+    return (0);
+  }
+
+  pHist = ((index / parts) % 2 == 0) ? latHist[latClass].queuedHist :
+                                       latHist[latClass].handledHist;
+
+  for (uint8_t i = first; i < SBP_LAT_BINS && i < first + binsPerRecord; i++)
+  {
+    *p++ = LO_UINT16(pHist[i]);
+    *p++ = HI_UINT16(pHist[i]);
+  }
+
+  return ((uint8_t)(p - pBuf));
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_buildDiag
+ *
+ * @brief   Build the diagnostics characteristic value, all little
+ *          endian:
+ *          0:  SBP_DIAG_VERSION
+ *          1:  uptime in seconds, wakeups, longest wakeup in
+ *              microseconds (4 bytes each)
+ *          13: application queue high water, ICall alloc failures,
+ *              ICall heap size, ICall heap high water (2 bytes each)
+ *          21: stack used and stack size of the application task, then
+ *              of the GAPRole task (2 bytes each)
+ *          29: ATT response retries (4 bytes), responses given up on,
+ *              responses dropped, flow control violations (2 bytes each)
+ *          39: OAD requests processed (4 bytes), identify requests,
+ *              requests dropped (2 bytes each)
+ *          47: writeTime() calls, total and longest writeTime() time in
+ *              microseconds (4 bytes each)
+ *          The heap high water is the heap manager's own when it is
+ *          built with HEAPMGR_METRICS. Otherwise it is the most seen by
+ *          SimpleBLEPeripheral_sampleHeap(), which runs on every stack
+ *          event, every allocation failure and here.
+ *
+ * @param   pBuf - DIAG_MAX_LEN bytes for the value.
+ *
+ * @return  Length of the value.
+ */
+static uint8_t SimpleBLEPeripheral_buildDiag(uint8_t *pBuf)
+{
+  ICall_heapStats_t heap;
+  Task_Stat taskStat;
+  uint32_t counters[4];
+  uint16_t shorts[4];
+  uint16_t failed = 0;
+  uint32_t heapMaxUsed;
+  uint8_t *p = pBuf;
+#ifdef HEAPMGR_METRICS
+  uint32_t blkMax, blkCnt, blkFree, memAlo, memUB;
+
+  ICall_getHeapStats(&heap);
+  ICall_getHeapMgrGetMetrics(&blkMax, &blkCnt, &blkFree, &memAlo,
+                             &heapMaxUsed, &memUB);
+#else
+  SimpleBLEPeripheral_sampleHeap();
+  ICall_getHeapStats(&heap);
+  heapMaxUsed = heap.totalSize - diagStats.heapMinFree;
+#endif
+
+  for (uint8_t i = 0; i < SBP_HIST_BINS; i++)
+  {
+    failed += attRspStats.failedHist[i];
+  }
+
+  *p++ = SBP_DIAG_VERSION;
+
+  for (uint8_t group = 0; group < 6; group++)
+  {
+    uint8_t numCounters = 0;
+    uint8_t numShorts = 0;
+
+    switch (group)
+    {
+      case 0:
+        counters[0] = (uint32_t)(Timebase_now() / 1000000);
+        counters[1] = sbpLoopStats.wakeups;
+        counters[2] = sbpLoopStats.maxWakeUs;
+        numCounters = 3;
+        break;
+
+      case 1:
+        shorts[0] = diagStats.appQueueMax;
+        shorts[1] = diagStats.allocFailures;
+        shorts[2] = (uint16_t)heap.totalSize;
+        shorts[3] = (uint16_t)heapMaxUsed;
+        numShorts = 4;
+        break;
+
+      case 2:
+        Task_stat(Task_handle(&sbpTask), &taskStat);
+        shorts[0] = (uint16_t)taskStat.used;
+        shorts[1] = (uint16_t)taskStat.stackSize;
+        Task_stat(Task_handle(&gapRoleTask), &taskStat);
+        shorts[2] = (uint16_t)taskStat.used;
+        shorts[3] = (uint16_t)taskStat.stackSize;
+        numShorts = 4;
+        break;
+
+      case 3:
+        counters[0] = attRspStats.retries;
+        shorts[0] = failed;
+        shorts[1] = attRspStats.dropped;
+        shorts[2] = diagStats.fcViolations;
+        numCounters = 1;
+        numShorts = 3;
+        break;
+
+      case 4:
+        counters[0] = sbpLoopStats.oadMsgs;
+        shorts[0] = diagStats.oadIdentify;
+        shorts[1] = diagStats.oadDropped;
+        numCounters = 1;
+        numShorts = 2;
+        break;
+
+      default:
+        counters[0] = diagStats.lcdWrites;
+        counters[1] = diagStats.lcdUs;
+        counters[2] = diagStats.lcdMaxUs;
+        numCounters = 3;
+        break;
+    }
+
+    for (uint8_t i = 0; i < numCounters; i++)
+    {
+      *p++ = BREAK_UINT32(counters[i], 0);
+      *p++ = BREAK_UINT32(counters[i], 1);
+      *p++ = BREAK_UINT32(counters[i], 2);
+      *p++ = BREAK_UINT32(counters[i], 3);
+    }
+
+    for (uint8_t i = 0; i < numShorts; i++)
+    {
+      *p++ = LO_UINT16(shorts[i]);
+      *p++ = HI_UINT16(shorts[i]);
+    }
+  }
+
+  return ((uint8_t)(p - pBuf));
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_updateDiag
+ *
+ * @brief   Refresh the diagnostics characteristic, notifying the
+ *          clients that enabled it.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_updateDiag(void)
+{
+  uint8_t value[DIAG_MAX_LEN];
+  uint8_t len = SimpleBLEPeripheral_buildDiag(value);
+
+  Diag_SetParameter(DIAG_COUNTERS, len, value);
+}
+
+#endif //!FEATURE_OAD_ONCHIP
+
+static void setTime(int year, int month, int day, int hour, int min){
+    memset(&ltm, 0, sizeof(struct tm));
+    // Set the struct date / time to 2016 / 5 / 21 18:00:00
+    ltm.tm_year = year - 1900;
+    ltm.tm_mon = month - 1;
+    ltm.tm_mday = day;
+    ltm.tm_hour = hour;
+    ltm.tm_min = min;
+    ltm.tm_sec = 0;
+    prevDate = day;
+    int_to_bin_digit(day);
+    // Convert to number of seconds, this will also fill up tm_wday and tm_yday
+    time_t seconds = mktime(&ltm);
+
+    // Convert the struct date to string
+    //char* currTime = asctime(&ltm);
+
+    // Convert the number of seconds to string, just to check
+    //currTime = ctime(&seconds);
+
+    // Set the date into the system
+    Seconds_set(seconds);
+}
+
+static void getCurrentDateAndTime(){
+    UInt32 seconds = Seconds_get();
+
+    ltm = *localtime(&seconds);
+
+    char buffer [15];
+    strftime (buffer, 15, "%d/%m/%y %H:%M", &ltm);
+    writeTime(buffer);
+    if(ltm.tm_mday != prevDate){
+        prevDate = ltm.tm_mday;
+        int_to_bin_digit(ltm.tm_mday);
+    }
+}
+
+static int startRing(){
+    UInt32 seconds = Seconds_get();
+    int ring = -1;
+
+    ltm = *localtime(&seconds);
+    for (int i = 0; i < SBP_MAX_ALARMS; i++){
+        if(alarms[i].hour == ltm.tm_hour && alarms[i].minute == ltm.tm_min &&
+           SimpleBLEPeripheral_alarmOnDay(&alarms[i], ltm.tm_wday)){
+            if(alarms[i].days == 0){
+                // One-shot alarm
+                alarms[i].hour = SBP_ALARM_FREE;
+            }
+            ring = 0;
+        }
+    }
+    if(ring == 0){
+        PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, PIN_GPIO_HIGH);//PIN_GPIO_HIGH
+    }
+    return ring;
+}
+char* split(char* line, char delimiter){ //for parsing config file
+    char* start = strchr(line,delimiter);
+    start++;
+    return start;
+}
+static void parseTime(char* timeStr){
+    char buffer[5];
+    snprintf(buffer, 5, "%s", timeStr);
+    timeToSet[0] = atoi(buffer);
+    timeStr = split(timeStr, '/');
+    char buf[3];
+    snprintf(buf, 3, "%s", timeStr);
+    timeToSet[1] = atoi(buf);
+    timeStr = split(timeStr, '/');
+    snprintf(buf, 3, "%s", timeStr);
+    timeToSet[2] = atoi(buf);
+    timeStr = split(timeStr, ' ');
+    snprintf(buf, 3, "%s", timeStr);
+    timeToSet[3] = atoi(buf);
+    timeStr = split(timeStr, ':');
+    snprintf(buf, 3, "%s", timeStr);
+    timeToSet[4] = atoi(buf);
+    timeStr = split(timeStr, ' ');
+    snprintf(buf, 3, "%s", timeStr);
+    wantedTime[0] = atoi(buf);
+    timeStr = split(timeStr, ':');
+    snprintf(buf, 3, "%s", timeStr);
+    wantedTime[1] = atoi(buf);
+}
+static void ManageTime(char *timeStr){
+    UInt32 localSecs = Seconds_get();
+
+    parseTime(timeStr);
+    setTime(timeToSet[0], timeToSet[1], timeToSet[2], timeToSet[3], timeToSet[4]);
+    // The text configuration owns alarm 0 and sets it to ring once
+    alarms[0].hour = wantedTime[0];
+    alarms[0].minute = wantedTime[1];
+    alarms[0].days = 0;
+    SimpleBLEPeripheral_driftShift(localSecs, Seconds_get());
+    SimpleBLEPeripheral_timeChanged(CTS_ADJUST_MANUAL);
+}
+static void resetScreen(){
+    //reset screen
+    PIN_setOutputValue(lcdHandle, Board_DIO25_ANALOG, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO22, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO21, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO15, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO12, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO29_ANALOG, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO28_ANALOG, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO24_ANALOG, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO23_ANALOG, 0);
+    PIN_setOutputValue(lcdHandle, Board_DIO26_ANALOG, PIN_GPIO_HIGH);
+    usleep(2000);
+    PIN_setOutputValue(lcdHandle, Board_DIO26_ANALOG, 0);
+    usleep(200);
 }
 static void chooseScreen2x16(){
     //reset screen
@@ -1495,6 +4168,8 @@ static void writeSpaces(){
 }
 static void writeTime(char time[]){
     int length = 14;
+    uint64_t start = Timebase_now();
+    uint32_t us;
     cursorToFirst();
     for (int i = 0; i<length; i++){
         switch (time[i]){
@@ -1695,105 +4370,855 @@ static void writeTime(char time[]){
             break;
         }
     }
+    us = Timebase_elapsed(start);
+    diagStats.lcdWrites++;
+    diagStats.lcdUs += us;
+    if (us > diagStats.lcdMaxUs){
+        diagStats.lcdMaxUs = us;
+    }
+}
+/*static void writeTimeTest(){
+    writeTime("0123456789: /");
+    sleep(5);
+    writeTime("10:52 11/02");
+}*/
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_processCharValueChangeEvt
+ *
+ * @brief   Process a pending Simple Profile characteristic value change
+ *          event.
+ *
+ * @param   paramID - parameter ID of the value that was changed.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_processCharValueChangeEvt(uint8_t paramID)
+{
+#ifndef FEATURE_OAD_ONCHIP
+  uint8_t newValue;
+
+  switch(paramID)
+  {
+    case SIMPLEPROFILE_CHAR1:
+      SimpleProfile_GetParameter(SIMPLEPROFILE_CHAR1, &newValue);
+
+      Display_print1(dispHandle, 4, 0, "Char 1: %d", (uint16_t)newValue);
+      break;
+
+    default:
+      // should not reach here!
+      break;
+  }
+#endif //!FEATURE_OAD_ONCHIP
+}
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_performMinuteTask
+ *
+ * @brief   Refresh the clock display and check the alarm. Called once
+ *          the time is set and then on every SBP_MINUTE_EVT.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_performMinuteTask(void)
+{
+  getCurrentDateAndTime();
+
+  // A restored time may be minutes out; alarms wait for a sync
+  if (timeIsSet && startRing() == 0)
+  {
+    alarmRinging = TRUE;
+    alarmDismissed = FALSE;
+    SimpleBLEPeripheral_accelerateAdv();
+  }
+
+  SimpleBLEPeripheral_statusChanged();
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_driftSync
+ *
+ * @brief   Record a sync of the clock to a reference. Once a sync
+ *          interval spans SBP_DRIFT_MIN_INTERVAL, the error the clock
+ *          would have built up without any correction is added to the
+ *          drift fit and the fit is saved to SNV.
+ *
+ * @param   localSecs - the clock just before it was set.
+ * @param   refSecs   - the reference time it was set to.
+ * @param   precise   - TRUE if the reference has 1 s resolution and
+ *                      the same time zone as the previous sync.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_driftSync(UInt32 localSecs, UInt32 refSecs,
+                                          bool precise)
+{
+  int32_t step = (int32_t)(localSecs - refSecs);  // Taken off by this sync
+  uint32_t interval = refSecs - driftAnchor;
+  int32_t error;
+
+  // The clock restarts from the reference
+  driftAccNs = 0;
+
+  if (!precise || !timeIsSet || !driftAnchorValid || (int32_t)interval <= 0)
+  {
+    // Nothing to compare against; start a new interval
+    driftAnchorValid = precise;
+    driftAnchor = refSecs;
+    driftRemoved = 0;
+    return;
+  }
+
+  // Error of the uncorrected clock over the interval
+  error = step + driftRemoved;
+
+  if ((uint32_t)(error < 0 ? -error : error) >
+      (interval / (1000000 / SBP_DRIFT_MAX_PPM)) + 2)
+  {
+    // Too big for drift: the clock was set wrong before, start again
+    driftAnchor = refSecs;
+    driftRemoved = 0;
+    return;
+  }
+
+  if (interval < SBP_DRIFT_MIN_INTERVAL)
+  {
+    // Too short to resolve; keep the interval running
+    driftRemoved = error;
+    return;
+  }
+
+  if (driftFit.spanX + interval > SBP_DRIFT_MAX_FIT_SPAN)
+  {
+    SimpleBLEPeripheral_driftForget();
+  }
+
+  // Welford update with the next cumulative (minutes, error) point, in
+  // Q8. The fit starts with the point (0, 0).
+  {
+    int32_t n;
+    int64_t x, y, dx;
+
+    driftFit.spanX += interval;
+    driftFit.errY += error;
+    driftFit.samples++;
+
+    n = driftFit.samples + 1;
+    x = (int64_t)(driftFit.spanX / 60) * SBP_DRIFT_ONE;
+    y = (int64_t)driftFit.errY * SBP_DRIFT_ONE;
+    dx = x - driftFit.meanX;
+    driftFit.meanX += dx / n;
+    driftFit.meanY += (y - driftFit.meanY) / n;
+    driftFit.cxx += dx * (x - driftFit.meanX) /
+                    (SBP_DRIFT_ONE * SBP_DRIFT_ONE);
+    driftFit.cxy += dx * (y - driftFit.meanY) / SBP_DRIFT_ONE;
+  }
+
+  VOID osal_snv_write(SBP_NVID_DRIFT, sizeof(driftFit), &driftFit);
+
+  SimpleBLEPeripheral_driftUpdate();
+
+  driftAnchor = refSecs;
+  driftRemoved = 0;
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_driftShift
+ *
+ * @brief   Account for a set of the clock that is no reference for the
+ *          drift, such as a manual set to the minute. The step counts
+ *          as taken off the clock, so the interval being measured keeps
+ *          running and the next precise sync still measures the drift
+ *          since the last one.
+ *
+ * @param   localSecs - the clock just before it was set.
+ * @param   newSecs   - the time it was set to.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_driftShift(UInt32 localSecs, UInt32 newSecs)
+{
+  if (driftAnchorValid)
+  {
+    driftRemoved += (int32_t)(localSecs - newSecs);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_driftForget
+ *
+ * @brief   Start the drift fit again, empty.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_driftForget(void)
+{
+  memset(&driftFit, 0, sizeof(driftFit));
+  driftFit.version = SBP_DRIFT_FIT_VERSION;
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_driftUpdate
+ *
+ * @brief   Derive the correction rate from the drift fit. No correction
+ *          is made until the fit spans SBP_DRIFT_MIN_SPAN.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_driftUpdate(void)
+{
+  int64_t cxx = driftFit.cxx;
+  int64_t cxy = driftFit.cxy;
+  int64_t ppb;
+
+  driftPpb = 0;
+
+  if (driftFit.samples == 0 || cxx <= 0 ||
+      driftFit.spanX < SBP_DRIFT_MIN_SPAN)
+  {
+    return;
+  }
+
+  // The slope, cxy / cxx, is in Q8 seconds per minute. Scale the sums
+  // down and bound the slope to 8 (about 520 ppm) so that the product
+  // below stays within 64 bits.
+  while (cxx > 0xFFFFFFFF)
+  {
+    cxx /= 2;
+    cxy /= 2;
+  }
+
+  if (cxy > 8 * cxx)
+  {
+    cxy = 8 * cxx;
+  }
+  else if (cxy < -8 * cxx)
+  {
+    cxy = -8 * cxx;
+  }
+
+  // 1e9 / (60 * SBP_DRIFT_ONE) = 15625000 / 240
+  ppb = cxy * 15625000 / (cxx * 240);
+
+  if (ppb > SBP_DRIFT_MAX_PPM * 1000L)
+  {
+    ppb = SBP_DRIFT_MAX_PPM * 1000L;
+  }
+  else if (ppb < -SBP_DRIFT_MAX_PPM * 1000L)
+  {
+    ppb = -SBP_DRIFT_MAX_PPM * 1000L;
+  }
+
+  driftPpb = (int32_t)ppb;
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_driftCorrect
+ *
+ * @brief   Accumulate one minute of drift and take a whole second off
+ *          or add one to the clock when it is due. Called on the
+ *          minute tick after the minute has been shown.
+ *
+ * @param   None.
+ *
+ * @return  Seconds added to the clock: -1, 0 or 1.
+ */
+static int8_t SimpleBLEPeripheral_driftCorrect(void)
+{
+  driftAccNs += driftPpb * (SBP_MINUTE_EVT_PERIOD / 1000);
+
+  if (driftAccNs >= 1000000000L)
+  {
+    // Running fast
+    driftAccNs -= 1000000000L;
+    driftRemoved++;
+    Seconds_set(Seconds_get() - 1);
+
+    return (-1);
+  }
+  else if (driftAccNs <= -1000000000L)
+  {
+    // Running slow
+    driftAccNs += 1000000000L;
+    driftRemoved--;
+    Seconds_set(Seconds_get() + 1);
+
+    return (1);
+  }
+
+  return (0);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_buildClockState
+ *
+ * @brief   Collect the clock state kept in SNV.
+ *
+ * @param   pState - state to fill in.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_buildClockState(sbpClockState_t *pState)
+{
+  memset(pState, 0, sizeof(sbpClockState_t));
+
+  pState->epoch = (timeIsSet || timeRestored) ? Seconds_get() : 0;
+  pState->rtcSecs = (uint32_t)(Timebase_now() / 1000000);
+  memcpy(pState->alarms, alarms, sizeof(alarms));
+  pState->ringing = alarmRinging;
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_clockStateDirty
+ *
+ * @brief   Check whether the clock state differs from the copy in SNV.
+ *          A running clock only counts as changed when it was set or
+ *          every SBP_SAVE_EPOCH_PERIOD seconds.
+ *
+ * @param   None.
+ *
+ * @return  TRUE if the state should be written.
+ */
+static bool SimpleBLEPeripheral_clockStateDirty(void)
+{
+  sbpClockState_t state;
+  uint32_t elapsed;
+  int32_t moved;
+
+  SimpleBLEPeripheral_buildClockState(&state);
+
+  if (memcmp(state.alarms, savedClock.alarms, sizeof(state.alarms)) != 0 ||
+      state.ringing != savedClock.ringing ||
+      (state.epoch == 0) != (savedClock.epoch == 0))
+  {
+    return (TRUE);
+  }
+
+  if (state.epoch == 0)
+  {
+    return (FALSE);
+  }
+
+  // Wraps, and so saves, if the RTC restarted since the last write
+  elapsed = state.rtcSecs - savedClock.rtcSecs;
+  moved = (int32_t)(state.epoch - (savedClock.epoch + elapsed));
+
+  // Drift correction moves the clock by a second at a time
+  return (moved > 1 || moved < -1 || elapsed >= SBP_SAVE_EPOCH_PERIOD);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_scheduleSave
+ *
+ * @brief   Write the clock state to SNV SBP_SAVE_DELAY after the first
+ *          change, so a burst of changes costs one flash write.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_scheduleSave(void)
+{
+  if (!Util_isActive(&saveClock) && SimpleBLEPeripheral_clockStateDirty())
+  {
+    Util_startClock(&saveClock);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_saveClockState
+ *
+ * @brief   Write the clock state to SNV if it still differs.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_saveClockState(void)
+{
+  if (SimpleBLEPeripheral_clockStateDirty())
+  {
+    SimpleBLEPeripheral_buildClockState(&savedClock);
+    VOID osal_snv_write(SBP_NVID_CLOCK, sizeof(savedClock), &savedClock);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_flushClockState
+ *
+ * @brief   Write the clock state to SNV now, changed or not, ahead of
+ *          an intentional reset. The time restored afterwards is then
+ *          only out by the reset itself.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_flushClockState(void)
+{
+  Util_stopClock(&saveClock);
+
+  SimpleBLEPeripheral_buildClockState(&savedClock);
+  VOID osal_snv_write(SBP_NVID_CLOCK, sizeof(savedClock), &savedClock);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_restoreClockState
+ *
+ * @brief   Restore the alarms and time saved before a reset. The time
+ *          was saved up to SBP_SAVE_EPOCH_PERIOD before the reset, and
+ *          the time spent in reset is unknown as the RTC restarts from
+ *          zero at boot, so it is only an estimate: the clock shows it,
+ *          but neither reports the time as set nor rings alarms until a
+ *          client syncs it.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_restoreClockState(void)
+{
+  if (osal_snv_read(SBP_NVID_CLOCK, sizeof(savedClock),
+                    &savedClock) != SUCCESS)
+  {
+    memset(&savedClock, 0, sizeof(savedClock));
+    return;
+  }
+
+  memcpy(alarms, savedClock.alarms, sizeof(alarms));
+
+  if (savedClock.ringing)
+  {
+    alarmRinging = TRUE;
+    PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, PIN_GPIO_HIGH);
+  }
+
+  if (savedClock.epoch != 0)
+  {
+    // The saved RTC reading is from before the reset; it says nothing
+    // about the time since
+    Seconds_set(savedClock.epoch);
+
+    // Not a reference for the drift estimate, nor a synced time
+    SimpleBLEPeripheral_timeChanged(0);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_timeChanged
+ *
+ * @brief   Start keeping time after the clock has been set: refresh
+ *          now, then on every minute tick. Clients of the Current Time
+ *          Service are told about the new time.
+ *
+ * @param   adjustReason - CTS_ADJUST_* bits saying why the time changed,
+ *                         0 for a time restored after a reset.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_timeChanged(uint8_t adjustReason)
+{
+  time_t seconds = Seconds_get();
+
+  timeRestored = (adjustReason == 0);
+  timeIsSet = !timeRestored;
+
+  // Refresh now, then on every minute tick instead of blocking the task
+  SimpleBLEPeripheral_performMinuteTask();
+  Util_restartClock(&minuteClock,
+                    SBP_MINUTE_EVT_PERIOD - (seconds % 60) * 1000);
+
+#ifndef FEATURE_OAD_ONCHIP
+  {
+    uint8_t currentTime[CTS_CURRENT_TIME_LEN];
+
+    ltm = *localtime(&seconds);
+
+    currentTime[0] = LO_UINT16(ltm.tm_year + 1900);
+    currentTime[1] = HI_UINT16(ltm.tm_year + 1900);
+    currentTime[2] = ltm.tm_mon + 1;
+    currentTime[3] = ltm.tm_mday;
+    currentTime[4] = ltm.tm_hour;
+    currentTime[5] = ltm.tm_min;
+    currentTime[6] = ltm.tm_sec;
+    currentTime[7] = ltm.tm_wday ? ltm.tm_wday : 7;  // 1 = Monday
+    currentTime[8] = 0;
+    currentTime[9] = adjustReason;
+
+    Cts_SetParameter(CTS_CURRENT_TIME, sizeof(currentTime), currentTime);
+  }
+#endif //!FEATURE_OAD_ONCHIP
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_nextAlarm
+ *
+ * @brief   Find the alarm that rings next, looking up to a week ahead
+ *          so that weekday alarms count on the days they ring.
+ *
+ * @param   None.
+ *
+ * @return  Minute of the day of the next alarm, or 0xFFFF if none is
+ *          set.
+ */
+static uint16_t SimpleBLEPeripheral_nextAlarm(void)
+{
+  time_t seconds = Seconds_get();
+  // Same clock and weekday as startRing()
+  struct tm local = *localtime(&seconds);
+  uint16_t now = (uint16_t)(local.tm_hour * 60 + local.tm_min);
+  uint8_t today = (uint8_t)local.tm_wday;
+  uint16_t next = 0xFFFF;
+  uint16_t nextWait = 0xFFFF;
+
+  for (uint8_t i = 0; i < SBP_MAX_ALARMS; i++)
+  {
+    if (alarms[i].hour != SBP_ALARM_FREE)
+    {
+      uint16_t at = alarms[i].hour * 60 + alarms[i].minute;
+
+      // Today only if still to come, then the next seven days
+      for (uint8_t day = (at >= now) ? 0 : 1; day <= 7; day++)
+      {
+        if (SimpleBLEPeripheral_alarmOnDay(&alarms[i], (today + day) % 7))
+        {
+          uint16_t wait = day * 24 * 60 + at - now;
+
+          if (wait < nextWait)
+          {
+            next = at;
+            nextWait = wait;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  return (next);
 }
-/*static void writeTimeTest(){
-    writeTime("0123456789: /");
-    sleep(5);
-    writeTime("10:52 11/02");
-}*/
+
 /*********************************************************************
- * @fn      SimpleBLEPeripheral_processCharValueChangeEvt
+ * @fn      SimpleBLEPeripheral_alarmOnDay
  *
- * @brief   Process a pending Simple Profile characteristic value change
- *          event.
+ * @brief   Whether an alarm rings on a weekday.
  *
- * @param   paramID - parameter ID of the value that was changed.
+ * @param   pAlarm - the alarm.
+ * @param   wday   - day of the week, 0 being Sunday.
+ *
+ * @return  TRUE if the alarm rings that day.
+ */
+static bool SimpleBLEPeripheral_alarmOnDay(const sbpAlarm_t *pAlarm,
+                                           uint8_t wday)
+{
+  return (pAlarm->days == 0 || (pAlarm->days & (1 << wday)));
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_updateAdvertData
+ *
+ * @brief   Refresh the clock status in the manufacturer specific
+ *          advertising data and hand the new data to the GAP Role.
+ *
+ * @param   None.
  *
  * @return  None.
  */
-static void SimpleBLEPeripheral_processCharValueChangeEvt(uint8_t paramID)
+static void SimpleBLEPeripheral_updateAdvertData(void)
 {
-#ifndef FEATURE_OAD_ONCHIP
-  uint8_t newValue;
+  uint8_t *pStatus = &advertData[sizeof(advertData) - SBP_ADV_STATUS_LEN];
 
-  switch(paramID)
+  // pStatus[0] is the layout version, pStatus[8..9] the firmware version
+  SimpleBLEPeripheral_buildStatus(&pStatus[1]);
+
+  // The battery monitor reports volts in 3.8 fixed point
+  pStatus[10] = (uint8_t)(AONBatMonBatteryVoltageGet() >> 3);
+
+  GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_buildStatus
+ *
+ * @brief   Fill in the clock status: local time in minutes since 1970,
+ *          the next alarm as minute of the day (0xFFFF if none) and the
+ *          SBP_ADV_FLAG_* flags, all little endian. Seconds counts from
+ *          1900 on this toolchain, so the minutes are taken from the
+ *          localtime() fields instead.
+ *
+ * @param   pStatus - SBP_STATUS_LEN bytes to fill in.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_buildStatus(uint8_t *pStatus)
+{
+  uint32_t epochMinutes = 0;
+  uint16_t nextAlarm;
+  uint8_t flags = 0;
+
+  if (alarmDismissed)
   {
-    case SIMPLEPROFILE_CHAR1:
-      SimpleProfile_GetParameter(SIMPLEPROFILE_CHAR1, &newValue);
+    flags |= SBP_ADV_FLAG_DISMISSED;
+  }
 
-      Display_print1(dispHandle, 4, 0, "Char 1: %d", (uint16_t)newValue);
-      break;
+  if (timeIsSet)
+  {
+    time_t seconds = Seconds_get();
+
+    epochMinutes = ClockStatus_epochMinutes(localtime(&seconds));
+    flags |= SBP_ADV_FLAG_TIME_SET;
+  }
+
+  // Alarms are not armed before the time is synced
+  nextAlarm = timeIsSet ? SimpleBLEPeripheral_nextAlarm() : 0xFFFF;
+  if (nextAlarm != 0xFFFF)
+  {
+    flags |= SBP_ADV_FLAG_ALARM_ARMED;
+  }
+
+  if (alarmRinging)
+  {
+    flags |= SBP_ADV_FLAG_RINGING;
+  }
+
+  ClockStatus_build(pStatus, epochMinutes, nextAlarm, flags);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_statusChanged
+ *
+ * @brief   Note a change of the clock status: time set, minute tick,
+ *          alarm set, fired or dismissed, code digit entered. The
+ *          advertising data is updated at once. Connected clients get
+ *          one Characteristic 7 notification at the end of the next
+ *          connection event, however many changes happen before it.
+ *          Changes to the time and alarms are also saved to SNV.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_statusChanged(void)
+{
+  SimpleBLEPeripheral_updateAdvertData();
+  SimpleBLEPeripheral_scheduleSave();
+
+  if (linkDB_NumActive() == 0)
+  {
+    // Nobody to notify; keep the value current for the next reader
+    SimpleBLEPeripheral_sendStatus();
+  }
+  else if (!statusPending)
+  {
+    statusPending = TRUE;
 
-    case SIMPLEPROFILE_CHAR3:
-      SimpleProfile_GetParameter(SIMPLEPROFILE_CHAR3, &newValue);
-      /*if(newValue == 'A'){
-          //PIN_setOutputValue(ledPinHandle, Board_PIN_LED0, 1);
-          PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, PIN_GPIO_HIGH);//PIN_GPIO_HIGH
+    // The controller hands out connection handles 0 to linkDBNumConns - 1
+    for (uint16_t connHandle = 0; connHandle < linkDBNumConns; connHandle++)
+    {
+      if (linkDB_Up(connHandle))
+      {
+        SimpleBLEPeripheral_updateConnEvtNotice(connHandle);
       }
-      else{
-          if(newValue == 'B'){
-              sprintf(buf,"%s", "2018/03/04 13:16 13:18\0") ;
+    }
+  }
+}
 
-              ManageTime();
-          }
-          //PIN_setOutputValue(ledPinHandle, Board_PIN_LED0, 0);
-          //PIN_setOutputValue(lcdHandle, Board_DIO27_ANALOG, 0);
-
-      }*/
-      buf[bytesRecieved] = (char)newValue;
-      buf[bytesRecieved+1] = '\0';
-      char b[2];
-      b[0] = (char)newValue;
-      b[1]  = '\0';
-      writeTime(b);
-      bytesRecieved++;
-      if(bytesRecieved == 22){
-          ManageTime();
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_sendStatus
+ *
+ * @brief   Set Characteristic 7 to the current clock status, which
+ *          notifies every client that has enabled notifications.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_sendStatus(void)
+{
+#ifndef FEATURE_OAD_ONCHIP
+  uint8_t status[SIMPLEPROFILE_CHAR7_LEN];
+
+  SimpleBLEPeripheral_buildStatus(status);
+
+  // Code digits entered so far
+  status[SBP_STATUS_LEN] = (uint8_t)codeIndex;
+
+  SimpleProfile_SetParameter(SIMPLEPROFILE_CHAR7, sizeof(status), status);
+#endif //!FEATURE_OAD_ONCHIP
+
+  if (statusPending)
+  {
+    statusPending = FALSE;
+
+    for (uint16_t connHandle = 0; connHandle < linkDBNumConns; connHandle++)
+    {
+      if (linkDB_Up(connHandle))
+      {
+        SimpleBLEPeripheral_updateConnEvtNotice(connHandle);
       }
+    }
+  }
+}
 
-      //PIN_setOutputValue(ledPinHandle, Board_PIN_LED1, newValue);
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_requestFastConn
+ *
+ * @brief   Note transfer activity on the link. Requests the fast
+ *          connection parameters if they are neither in effect nor
+ *          already requested, and (re)starts the idle timeout that
+ *          relaxes them again. The link is only taken to be fast once
+ *          it reports a fast interval.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_requestFastConn(void)
+{
+  Util_restartClock(&connIdleClock, SBP_CONN_IDLE_TIMEOUT);
 
-      Display_print1(dispHandle, 4, 0, "Char 3: %d", (uint16_t)newValue);
-      break;
+  if (!fastConnActive && !fastConnRequested)
+  {
+    bStatus_t status = GAPRole_SendUpdateParam(SBP_FAST_CONN_MIN_INTERVAL,
+                                               SBP_FAST_CONN_MAX_INTERVAL,
+                                               SBP_FAST_CONN_SLAVE_LATENCY,
+                                               SBP_FAST_CONN_TIMEOUT,
+                                               GAPROLE_NO_ACTION);
 
-    default:
-      // should not reach here!
-      break;
+    if (status == SUCCESS)
+    {
+      fastConnRequested = TRUE;
+    }
+    else if (status == bleInvalidRange)
+    {
+      // The link already runs with exactly these parameters
+      fastConnActive = TRUE;
+    }
+
+    // Otherwise (e.g. an update already in progress) the next transfer
+    // activity tries again.
   }
-#endif //!FEATURE_OAD_ONCHIP
 }
 
 /*********************************************************************
- * @fn      SimpleBLEPeripheral_performPeriodicTask
+ * @fn      SimpleBLEPeripheral_requestIdleConn
  *
- * @brief   Perform a periodic application task. This function gets called
- *          every five seconds (SBP_PERIODIC_EVT_PERIOD). In this example,
- *          the value of the third characteristic in the SimpleGATTProfile
- *          service is retrieved from the profile, and then copied into the
- *          value of the the fourth characteristic.
+ * @brief   Fall back to the long interval, non-zero slave latency
+ *          parameters once the link has been idle for
+ *          SBP_CONN_IDLE_TIMEOUT. The request is made once; the link
+ *          reports whether the central took it. A central that refused
+ *          the fast parameters leaves the link idle and nothing to do.
  *
  * @param   None.
  *
  * @return  None.
  */
-static void SimpleBLEPeripheral_performPeriodicTask(void)
+static void SimpleBLEPeripheral_requestIdleConn(void)
 {
-#ifndef FEATURE_OAD_ONCHIP
-  uint8_t valueToCopy;
+  // A fast request the central ignored is not waited for any longer
+  fastConnRequested = FALSE;
 
-  // Call to retrieve the value of the third characteristic in the profile
-  if (SimpleProfile_GetParameter(SIMPLEPROFILE_CHAR3, &valueToCopy) == SUCCESS)
+  if (fastConnActive)
   {
-    // Call to set that value of the fourth characteristic in the profile.
-    // Note that if notifications of the fourth characteristic have been
-    // enabled by a GATT client device, then a notification will be sent
-    // every time this function is called.
-    SimpleProfile_SetParameter(SIMPLEPROFILE_CHAR4, sizeof(uint8_t),
-                               &valueToCopy);
+    bStatus_t status = GAPRole_SendUpdateParam(DEFAULT_DESIRED_MIN_CONN_INTERVAL,
+                                               DEFAULT_DESIRED_MAX_CONN_INTERVAL,
+                                               DEFAULT_DESIRED_SLAVE_LATENCY,
+                                               DEFAULT_DESIRED_CONN_TIMEOUT,
+                                               GAPROLE_NO_ACTION);
+
+    if (status == bleInvalidRange || status == bleNotConnected)
+    {
+      // Already idle, or no link to relax
+      fastConnActive = FALSE;
+    }
+    else if (status != SUCCESS)
+    {
+      // The previous update is still being negotiated; try again later.
+      Util_startClock(&connIdleClock);
+    }
   }
-#endif //!FEATURE_OAD_ONCHIP
 }
 
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_setAdvStep
+ *
+ * @brief   Apply one step of the advertising interval back-off and arm
+ *          the clock for the next one. Advertising in progress is
+ *          stopped and restarted from the GAPROLE_WAITING state so that
+ *          the new interval takes effect.
+ *
+ * @param   step - index into advSteps.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_setAdvStep(uint8_t step)
+{
+  bool changed = (step != advStep);
+
+  advStep = step;
+  SimpleBLEPeripheral_setAdvInterval(step);
+
+  if (advSteps[step].duration)
+  {
+    Util_restartClock(&advStepClock, advSteps[step].duration);
+  }
+  else
+  {
+    Util_stopClock(&advStepClock);
+  }
+
+  if (changed && gapProfileState == GAPROLE_ADVERTISING && !advRestartPending)
+  {
+    uint8_t advertEnabled = FALSE;
+
+    advRestartPending = TRUE;
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t),
+                         &advertEnabled);
+  }
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_setAdvInterval
+ *
+ * @brief   Set the GAP advertising interval parameters of one step of
+ *          the back-off. Used by the next GAP_MakeDiscoverable.
+ *
+ * @param   step - index into advSteps.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_setAdvInterval(uint8_t step)
+{
+  GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MIN, advSteps[step].minInt);
+  GAP_SetParamValue(TGAP_LIM_DISC_ADV_INT_MAX, advSteps[step].maxInt);
+  GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MIN, advSteps[step].minInt);
+  GAP_SetParamValue(TGAP_GEN_DISC_ADV_INT_MAX, advSteps[step].maxInt);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_accelerateAdv
+ *
+ * @brief   Restart (or extend) the fast advertising burst after a local
+ *          event such as a button press or the alarm firing. Ignored while
+ *          connected; the burst then starts on disconnect.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_accelerateAdv(void)
+{
+  if (gapProfileState != GAPROLE_CONNECTED &&
+      gapProfileState != GAPROLE_CONNECTED_ADV)
+  {
+    SimpleBLEPeripheral_setAdvStep(0);
+  }
+}
 
 #ifdef FEATURE_OAD
 /*********************************************************************
@@ -1804,6 +5229,7 @@ static void SimpleBLEPeripheral_performPeriodicTask(void)
  * @param   event      - event type:
  *                       OAD_WRITE_IDENTIFY_REQ
  *                       OAD_WRITE_BLOCK_REQ
+ *                       OAD_IMAGE_RESET
  * @param   connHandle - the connection Handle this request is from.
  * @param   pData      - pointer to data for processing and/or storing.
  *
@@ -1812,25 +5238,41 @@ static void SimpleBLEPeripheral_performPeriodicTask(void)
 void SimpleBLEPeripheral_processOadWriteCB(uint8_t event, uint16_t connHandle,
                                            uint8_t *pData)
 {
-  oadTargetWrite_t *oadWriteEvt = ICall_malloc( sizeof(oadTargetWrite_t) + \
-                                             sizeof(uint8_t) * OAD_PACKET_SIZE);
+  sbpOadEvt_t *pEvt;
+
+  if (event == OAD_IMAGE_RESET)
+  {
+    // Called from the task, within OAD_imgBlockWrite(), right before the
+    // reset; nothing queued now would run.
+    SimpleBLEPeripheral_flushClockState();
+    return;
+  }
 
-  if ( oadWriteEvt != NULL )
+  pEvt = ICall_malloc( sizeof(sbpOadEvt_t) + \
+                       sizeof(uint8_t) * OAD_PACKET_SIZE);
+
+  if ( pEvt != NULL )
   {
+    oadTargetWrite_t *oadWriteEvt = &pEvt->write;
+
     oadWriteEvt->event = event;
     oadWriteEvt->connHandle = connHandle;
 
-    oadWriteEvt->pData = (uint8_t *)(&oadWriteEvt->pData + 1);
+    oadWriteEvt->pData = (uint8_t *)(pEvt + 1);
     memcpy(oadWriteEvt->pData, pData, OAD_PACKET_SIZE);
+    pEvt->queued = (uint32_t)Timebase_now();
 
-    Queue_put(hOadQ, (Queue_Elem *)oadWriteEvt);
+    Queue_put(hOadQ, (Queue_Elem *)pEvt);
 
-    // Post the application's semaphore.
-    Semaphore_post(sem);
+    // Post the application's event.
+    Event_post(syncEvent, SBP_OAD_QUEUE_EVT);
   }
   else
   {
-    // Fail silently.
+    // Fail silently; the client repeats the block.
+    diagStats.oadDropped++;
+    diagStats.allocFailures++;
+    SimpleBLEPeripheral_sampleHeap();
   }
 }
 #endif //FEATURE_OAD
@@ -1846,11 +5288,8 @@ void SimpleBLEPeripheral_processOadWriteCB(uint8_t event, uint16_t connHandle,
  */
 static void SimpleBLEPeripheral_clockHandler(UArg arg)
 {
-  // Store the event.
-  events |= arg;
-
   // Wake up the application.
-  Semaphore_post(sem);
+  Event_post(syncEvent, arg);
 }
 
 /*********************************************************************
@@ -1872,10 +5311,120 @@ static void SimpleBLEPeripheral_enqueueMsg(uint8_t event, uint8_t state)
   {
     pMsg->hdr.event = event;
     pMsg->hdr.state = state;
+    pMsg->queued = (uint32_t)Timebase_now();
 
     // Enqueue the message.
-    Util_enqueueMsg(appMsgQueue, sem, (uint8*)pMsg);
+    SimpleBLEPeripheral_countEnqueue();
+    Util_enqueueMsg(appMsgQueue, syncEvent, (uint8*)pMsg);
+  }
+  else
+  {
+    diagStats.allocFailures++;
+    SimpleBLEPeripheral_sampleHeap();
+  }
+}
+
+#ifndef FEATURE_OAD_ONCHIP
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_enqueueData
+ *
+ * @brief   Creates a message carrying a copy of profile data and puts
+ *          it in the RTOS queue. The data is only valid during the
+ *          profile callback.
+ *
+ * @param   event      - message event.
+ * @param   connHandle - connection the data was written on.
+ * @param   pValue     - the data.
+ * @param   len        - length of the data.
+ *
+ * @return  TRUE if the message was queued.
+ */
+static bool SimpleBLEPeripheral_enqueueData(uint8_t event, uint16_t connHandle,
+                                            uint8_t *pValue, uint16_t len)
+{
+  sbpDataEvt_t *pMsg = ICall_malloc(sizeof(sbpDataEvt_t) + len);
+
+  if (pMsg)
+  {
+    pMsg->hdr.event = event;
+    pMsg->hdr.state = 0;
+    pMsg->queued = (uint32_t)Timebase_now();
+    pMsg->connHandle = connHandle;
+    pMsg->len = len;
+    pMsg->pData = (uint8_t *)(pMsg + 1);
+    memcpy(pMsg->pData, pValue, len);
+
+    SimpleBLEPeripheral_countEnqueue();
+    if (Util_enqueueMsg(appMsgQueue, syncEvent, (uint8*)pMsg))
+    {
+      return (TRUE);
+    }
+    else
+    {
+      // Util_enqueueMsg() has freed the message
+      UInt key = Hwi_disable();
+
+      diagStats.appQueueDepth--;
+      Hwi_restore(key);
+    }
+  }
+
+  diagStats.allocFailures++;
+  SimpleBLEPeripheral_sampleHeap();
+
+  return (FALSE);
+}
+#endif //!FEATURE_OAD_ONCHIP
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_countEnqueue
+ *
+ * @brief   Account for a message about to be put in the application
+ *          queue. Called from the stack and GAPRole task contexts.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_countEnqueue(void)
+{
+  UInt key = Hwi_disable();
+
+  if (++diagStats.appQueueDepth > diagStats.appQueueMax)
+  {
+    diagStats.appQueueMax = diagStats.appQueueDepth;
+  }
+
+  Hwi_restore(key);
+}
+
+/*********************************************************************
+ * @fn      SimpleBLEPeripheral_sampleHeap
+ *
+ * @brief   Keep the least free ICall heap seen for the diagnostics
+ *          heap high water. Called from the stack and GAPRole task
+ *          contexts too. Compiled out when the heap manager keeps its
+ *          own high water (HEAPMGR_METRICS).
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+static void SimpleBLEPeripheral_sampleHeap(void)
+{
+#ifndef HEAPMGR_METRICS
+  ICall_heapStats_t heap;
+  UInt key;
+
+  ICall_getHeapStats(&heap);
+
+  key = Hwi_disable();
+  if (heap.totalFreeSize < diagStats.heapMinFree)
+  {
+    diagStats.heapMinFree = heap.totalFreeSize;
   }
+  Hwi_restore(key);
+#endif //!HEAPMGR_METRICS
 }
 
 /*********************************************************************
@@ -0,0 +1,125 @@
+/******************************************************************************
+
+ @file  timebase.c
+
+ @brief This file contains the monotonic microsecond timebase. The AON
+        RTC is reset and started by the kernel at boot and not touched
+        again while the device runs, so its 64-bit value (seconds in the
+        upper word, 2^-32 s fractions in the lower) is a free running
+        clock since boot; it is only converted here. It restarts from
+        zero at every reset.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <driverlib/aon_rtc.h>
+
+#include "timebase.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define TIMEBASE_US_PER_SEC                   1000000
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Timebase_now
+ *
+ * @brief   Microseconds since the device started.
+ *
+ * @param   None.
+ *
+ * @return  Current time.
+ */
+uint64_t Timebase_now(void)
+{
+  // Reads seconds and fractions consistently, also across a carry
+  uint64_t rtc = AONRTCCurrent64BitValueGet();
+
+  return ((rtc >> 32) * TIMEBASE_US_PER_SEC +
+          (((rtc & 0xFFFFFFFF) * TIMEBASE_US_PER_SEC) >> 32));
+}
+
+/*********************************************************************
+ * @fn      Timebase_elapsed
+ *
+ * @brief   Microseconds since a time from Timebase_now().
+ *
+ * @param   since - start of the interval.
+ *
+ * @return  Elapsed time, TIMEBASE_MAX_US if longer.
+ */
+uint32_t Timebase_elapsed(uint64_t since)
+{
+  uint64_t now = Timebase_now();
+
+  if (now <= since)
+  {
+    return (0);
+  }
+
+  return ((now - since > TIMEBASE_MAX_US) ? TIMEBASE_MAX_US :
+                                            (uint32_t)(now - since));
+}
+
+/*********************************************************************
+ * @fn      Timebase_deadline
+ *
+ * @brief   The Timebase_now() time a number of microseconds from now.
+ *
+ * @param   us - microseconds from now.
+ *
+ * @return  Deadline.
+ */
+uint64_t Timebase_deadline(uint32_t us)
+{
+  return (Timebase_now() + us);
+}
+
+/*********************************************************************
+ * @fn      Timebase_expired
+ *
+ * @brief   Check whether a deadline has been reached.
+ *
+ * @param   deadline - time from Timebase_deadline().
+ *
+ * @return  TRUE once the deadline has been reached.
+ */
+bool Timebase_expired(uint64_t deadline)
+{
+  return (Timebase_now() >= deadline);
+}
+
+/*********************************************************************
+ * @fn      Timebase_remaining
+ *
+ * @brief   Microseconds until a deadline.
+ *
+ * @param   deadline - time from Timebase_deadline().
+ *
+ * @return  Time left, 0 once the deadline has been reached and
+ *          TIMEBASE_MAX_US if further away.
+ */
+uint32_t Timebase_remaining(uint64_t deadline)
+{
+  uint64_t now = Timebase_now();
+
+  if (now >= deadline)
+  {
+    return (0);
+  }
+
+  return ((deadline - now > TIMEBASE_MAX_US) ? TIMEBASE_MAX_US :
+                                               (uint32_t)(deadline - now));
+}
+
+/*********************************************************************
+*********************************************************************/
@@ -0,0 +1,93 @@
+/******************************************************************************
+
+ @file  timebase.h
+
+ @brief This file contains the monotonic microsecond timebase used to
+        timestamp events, measure durations and compute deadlines. It
+        runs from the AON RTC, so it keeps counting in standby and is not
+        moved by Seconds_set(). It restarts from zero at every reset.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Largest duration returned by Timebase_elapsed() and
+// Timebase_remaining()
+#define TIMEBASE_MAX_US                       0xFFFFFFFF
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*
+ * Timebase_now - Microseconds since the device started. The resolution
+ *          is one RTC tick, about 30.5 us. Safe to call from any
+ *          context.
+ */
+extern uint64_t Timebase_now(void);
+
+/*
+ * Timebase_elapsed - Microseconds since a time from Timebase_now(),
+ *          TIMEBASE_MAX_US if longer.
+ *
+ *    since - start of the interval
+ */
+extern uint32_t Timebase_elapsed(uint64_t since);
+
+/*
+ * Timebase_deadline - The Timebase_now() time a number of microseconds
+ *          from now.
+ *
+ *    us - microseconds from now
+ */
+extern uint64_t Timebase_deadline(uint32_t us);
+
+/*
+ * Timebase_expired - TRUE once a deadline has been reached.
+ *
+ *    deadline - time from Timebase_deadline()
+ */
+extern bool Timebase_expired(uint64_t deadline);
+
+/*
+ * Timebase_remaining - Microseconds until a deadline, 0 once it has been
+ *          reached and TIMEBASE_MAX_US if further away.
+ *
+ *    deadline - time from Timebase_deadline()
+ */
+extern uint32_t Timebase_remaining(uint64_t deadline);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMEBASE_H */
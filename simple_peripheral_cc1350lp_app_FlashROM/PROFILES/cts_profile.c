@@ -0,0 +1,630 @@
+/******************************************************************************
+
+ @file  cts_profile.c
+
+ @brief This file contains the Current Time Service (0x1805) server: the
+        Current Time (0x2A2B, read/write/notify) and Local Time
+        Information (0x2A0F, read/write) characteristics. The Current
+        Time set by the application keeps running from the Seconds
+        clock, so reads always return the time of the read.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include <ti/sysbios/hal/Seconds.h>
+
+#include "bcomdef.h"
+#include "osal.h"
+#include "linkdb.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gatt_profile_uuid.h"
+#include "gattservapp.h"
+
+#include "cts_profile.h"
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define SERVAPP_NUM_ATTR_SUPPORTED        6
+
+#define CTS_SECONDS_PER_DAY               86400UL
+
+// Local Time Information values meaning "unknown"
+#define CTS_TIME_ZONE_UNKNOWN             (-128)
+#define CTS_DST_UNKNOWN                   255
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Current Time Service UUID: 0x1805
+CONST uint8 ctsServUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(CURRENT_TIME_SERV_UUID), HI_UINT16(CURRENT_TIME_SERV_UUID)
+};
+
+// Current Time UUID: 0x2A2B
+CONST uint8 ctsCurrentTimeUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(CURRENT_TIME_UUID), HI_UINT16(CURRENT_TIME_UUID)
+};
+
+// Local Time Information UUID: 0x2A0F
+CONST uint8 ctsLocalTimeInfoUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(LOCAL_TIME_INFO_UUID), HI_UINT16(LOCAL_TIME_INFO_UUID)
+};
+
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+/*********************************************************************
+ * EXTERNAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+static ctsCBs_t *cts_AppCBs = NULL;
+
+// Seconds clock reading when the Current Time was last set
+static uint32 ctsBaseSeconds = 0;
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+
+// Current Time Service attribute
+static CONST gattAttrType_t ctsService = { ATT_BT_UUID_SIZE, ctsServUUID };
+
+
+// Current Time Characteristic Properties
+static uint8 ctsCurrentTimeProps = GATT_PROP_READ | GATT_PROP_WRITE |
+                                   GATT_PROP_NOTIFY;
+
+// Current Time Characteristic Value as last set, 1 Jan 1970 until then
+static uint8 ctsCurrentTime[CTS_CURRENT_TIME_LEN] =
+{
+  LO_UINT16(1970), HI_UINT16(1970), 1, 1, 0, 0, 0, 4, 0, 0
+};
+
+// Current Time Characteristic Configuration, one per client
+static gattCharCfg_t *ctsCurrentTimeConfig;
+
+
+// Local Time Information Characteristic Properties
+static uint8 ctsLocalTimeInfoProps = GATT_PROP_READ | GATT_PROP_WRITE;
+
+// Local Time Information Characteristic Value
+static uint8 ctsLocalTimeInfo[CTS_LOCAL_TIME_INFO_LEN] =
+{
+  (uint8)CTS_TIME_ZONE_UNKNOWN, CTS_DST_UNKNOWN
+};
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+
+static gattAttribute_t ctsAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
+{
+  // Current Time Service
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&ctsService                      /* pValue */
+  },
+
+    // Current Time Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &ctsCurrentTimeProps
+    },
+
+      // Current Time Value
+      {
+        { ATT_BT_UUID_SIZE, ctsCurrentTimeUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        ctsCurrentTime
+      },
+
+      // Current Time configuration
+      {
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        (uint8 *)&ctsCurrentTimeConfig
+      },
+
+    // Local Time Information Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &ctsLocalTimeInfoProps
+    },
+
+      // Local Time Information Value
+      {
+        { ATT_BT_UUID_SIZE, ctsLocalTimeInfoUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        ctsLocalTimeInfo
+      },
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t cts_ReadAttrCB(uint16_t connHandle,
+                                gattAttribute_t *pAttr,
+                                uint8_t *pValue, uint16_t *pLen,
+                                uint16_t offset, uint16_t maxLen,
+                                uint8_t method);
+static bStatus_t cts_WriteAttrCB(uint16_t connHandle,
+                                 gattAttribute_t *pAttr,
+                                 uint8_t *pValue, uint16_t len,
+                                 uint16_t offset, uint8_t method);
+static bool cts_ValidTime( uint8 *pValue );
+static int32 cts_DaysFromCivil( uint16 year, uint8 month, uint8 day );
+static void cts_CivilFromDays( int32 days, uint16 *pYear, uint8 *pMonth,
+                               uint8 *pDay );
+static void cts_BuildTime( uint8 *pValue );
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+
+// Current Time Service Callbacks
+CONST gattServiceCBs_t ctsCBs =
+{
+  cts_ReadAttrCB,  // Read callback function pointer
+  cts_WriteAttrCB, // Write callback function pointer
+  NULL             // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Cts_AddService
+ *
+ * @brief   Initializes the Current Time Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t Cts_AddService( uint32 services )
+{
+  uint8 status;
+
+  // Allocate Client Characteristic Configuration table
+  ctsCurrentTimeConfig = (gattCharCfg_t *)ICall_malloc( sizeof(gattCharCfg_t) *
+                                                        linkDBNumConns );
+  if ( ctsCurrentTimeConfig == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  // Initialize Client Characteristic Configuration attributes
+  GATTServApp_InitCharCfg( INVALID_CONNHANDLE, ctsCurrentTimeConfig );
+
+  if ( services & CTS_SERVICE )
+  {
+    // Register GATT attribute list and CBs with GATT Server App
+    status = GATTServApp_RegisterService( ctsAttrTbl,
+                                          GATT_NUM_ATTRS( ctsAttrTbl ),
+                                          GATT_MAX_ENCRYPT_KEY_SIZE,
+                                          &ctsCBs );
+  }
+  else
+  {
+    status = SUCCESS;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      Cts_RegisterAppCBs
+ *
+ * @brief   Registers the application callback function. Only call
+ *          this function once.
+ *
+ * @param   callbacks - pointer to application callbacks.
+ *
+ * @return  SUCCESS or bleAlreadyInRequestedMode
+ */
+bStatus_t Cts_RegisterAppCBs( ctsCBs_t *appCallbacks )
+{
+  if ( appCallbacks )
+  {
+    cts_AppCBs = appCallbacks;
+
+    return ( SUCCESS );
+  }
+  else
+  {
+    return ( bleAlreadyInRequestedMode );
+  }
+}
+
+/*********************************************************************
+ * @fn      Cts_SetParameter
+ *
+ * @brief   Set a Current Time Service parameter.
+ *
+ * @param   param - Profile parameter ID
+ * @param   len - length of data to write
+ * @param   value - pointer to data to write.
+ *
+ * @return  bStatus_t
+ */
+bStatus_t Cts_SetParameter( uint8 param, uint8 len, void *value )
+{
+  bStatus_t ret = SUCCESS;
+
+  switch ( param )
+  {
+    case CTS_CURRENT_TIME:
+      if ( len == CTS_CURRENT_TIME_LEN && cts_ValidTime( value ) )
+      {
+        VOID memcpy( ctsCurrentTime, value, CTS_CURRENT_TIME_LEN );
+        ctsBaseSeconds = Seconds_get();
+
+        // See if Notification has been enabled
+        GATTServApp_ProcessCharCfg( ctsCurrentTimeConfig, ctsCurrentTime, FALSE,
+                                    ctsAttrTbl, GATT_NUM_ATTRS( ctsAttrTbl ),
+                                    INVALID_TASK_ID, cts_ReadAttrCB );
+      }
+      else
+      {
+        ret = bleInvalidRange;
+      }
+      break;
+
+    case CTS_LOCAL_TIME_INFO:
+      if ( len == CTS_LOCAL_TIME_INFO_LEN )
+      {
+        VOID memcpy( ctsLocalTimeInfo, value, CTS_LOCAL_TIME_INFO_LEN );
+      }
+      else
+      {
+        ret = bleInvalidRange;
+      }
+      break;
+
+    default:
+      ret = INVALIDPARAMETER;
+      break;
+  }
+
+  return ( ret );
+}
+
+/*********************************************************************
+ * @fn      Cts_GetParameter
+ *
+ * @brief   Get a Current Time Service parameter.
+ *
+ * @param   param - Profile parameter ID
+ * @param   value - pointer to data to put.
+ *
+ * @return  bStatus_t
+ */
+bStatus_t Cts_GetParameter( uint8 param, void *value )
+{
+  bStatus_t ret = SUCCESS;
+
+  switch ( param )
+  {
+    case CTS_CURRENT_TIME:
+      cts_BuildTime( value );
+      break;
+
+    case CTS_LOCAL_TIME_INFO:
+      VOID memcpy( value, ctsLocalTimeInfo, CTS_LOCAL_TIME_INFO_LEN );
+      break;
+
+    default:
+      ret = INVALIDPARAMETER;
+      break;
+  }
+
+  return ( ret );
+}
+
+/*********************************************************************
+ * @fn      cts_ValidTime
+ *
+ * @brief   Check the fields of a Current Time value. The year must be
+ *          one the Seconds clock can hold.
+ *
+ * @param   pValue - Current Time value
+ *
+ * @return  TRUE if the value can be applied
+ */
+static bool cts_ValidTime( uint8 *pValue )
+{
+  uint16 year = BUILD_UINT16( pValue[0], pValue[1] );
+
+  return ( year >= 1970 && year <= 2105 &&
+           pValue[2] >= 1 && pValue[2] <= 12 &&
+           pValue[3] >= 1 && pValue[3] <= 31 &&
+           pValue[4] <= 23 && pValue[5] <= 59 && pValue[6] <= 59 &&
+           pValue[7] <= 7 );
+}
+
+/*********************************************************************
+ * @fn      cts_DaysFromCivil
+ *
+ * @brief   Count the days from 1 Jan 1970 to a date of the Gregorian
+ *          calendar.
+ *
+ * @param   year - year
+ * @param   month - month, 1 to 12
+ * @param   day - day of the month, 1 to 31
+ *
+ * @return  Day number, 0 for 1 Jan 1970
+ */
+static int32 cts_DaysFromCivil( uint16 year, uint8 month, uint8 day )
+{
+  int32 y = (int32)year - ( month <= 2 );
+  int32 era = y / 400;
+  uint32 yoe = (uint32)( y - era * 400 );
+  uint32 doy = ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1;
+  uint32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return ( era * 146097 + (int32)doe - 719468 );
+}
+
+/*********************************************************************
+ * @fn      cts_CivilFromDays
+ *
+ * @brief   Find the Gregorian date of a day number.
+ *
+ * @param   days - day number, 0 for 1 Jan 1970
+ * @param   pYear - year
+ * @param   pMonth - month, 1 to 12
+ * @param   pDay - day of the month, 1 to 31
+ *
+ * @return  none
+ */
+static void cts_CivilFromDays( int32 days, uint16 *pYear, uint8 *pMonth,
+                               uint8 *pDay )
+{
+  int32 z = days + 719468;
+  int32 era = z / 146097;
+  uint32 doe = (uint32)( z - era * 146097 );
+  uint32 yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+  uint32 doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+  uint32 mp = ( 5 * doy + 2 ) / 153;
+  uint8 month = (uint8)( mp < 10 ? mp + 3 : mp - 9 );
+
+  *pDay = (uint8)( doy - ( 153 * mp + 2 ) / 5 + 1 );
+  *pMonth = month;
+  *pYear = (uint16)( (int32)yoe + era * 400 + ( month <= 2 ) );
+}
+
+/*********************************************************************
+ * @fn      cts_BuildTime
+ *
+ * @brief   Build the Current Time value: the time last set plus the
+ *          seconds counted since. Runs in the stack context, so it
+ *          does not use the C library time functions.
+ *
+ * @param   pValue - CTS_CURRENT_TIME_LEN bytes to fill in
+ *
+ * @return  none
+ */
+static void cts_BuildTime( uint8 *pValue )
+{
+  uint32 secs = (uint32)ctsCurrentTime[4] * 3600 +
+                (uint32)ctsCurrentTime[5] * 60 + ctsCurrentTime[6] +
+                ( Seconds_get() - ctsBaseSeconds );
+  int32 days = cts_DaysFromCivil( BUILD_UINT16( ctsCurrentTime[0],
+                                                ctsCurrentTime[1] ),
+                                  ctsCurrentTime[2], ctsCurrentTime[3] ) +
+               (int32)( secs / CTS_SECONDS_PER_DAY );
+  uint16 year;
+
+  secs %= CTS_SECONDS_PER_DAY;
+  cts_CivilFromDays( days, &year, &pValue[2], &pValue[3] );
+
+  pValue[0] = LO_UINT16( year );
+  pValue[1] = HI_UINT16( year );
+  pValue[4] = (uint8)( secs / 3600 );
+  pValue[5] = (uint8)( ( secs / 60 ) % 60 );
+  pValue[6] = (uint8)( secs % 60 );
+
+  // 1 Jan 1970 was a Thursday; 1 = Monday ... 7 = Sunday
+  pValue[7] = (uint8)( ( days + 3 ) % 7 + 1 );
+
+  // Fractions are not kept; the adjust reason is that of the last set
+  pValue[8] = 0;
+  pValue[9] = ctsCurrentTime[9];
+}
+
+/*********************************************************************
+ * @fn          cts_ReadAttrCB
+ *
+ * @brief       Read an attribute.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t cts_ReadAttrCB(uint16_t connHandle,
+                                gattAttribute_t *pAttr,
+                                uint8_t *pValue, uint16_t *pLen,
+                                uint16_t offset, uint16_t maxLen,
+                                uint8_t method)
+{
+  bStatus_t status = SUCCESS;
+
+  // Make sure it's not a blob operation (no attributes in the profile are long)
+  if ( offset > 0 )
+  {
+    return ( ATT_ERR_ATTR_NOT_LONG );
+  }
+
+  if ( pAttr->type.len == ATT_BT_UUID_SIZE )
+  {
+    // 16-bit UUID
+    uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    switch ( uuid )
+    {
+      // No need for "GATT_SERVICE_UUID" or "GATT_CLIENT_CHAR_CFG_UUID" cases;
+      // gattserverapp handles those reads
+
+      case CURRENT_TIME_UUID:
+        *pLen = CTS_CURRENT_TIME_LEN;
+        cts_BuildTime( pValue );
+        break;
+
+      case LOCAL_TIME_INFO_UUID:
+        *pLen = CTS_LOCAL_TIME_INFO_LEN;
+        VOID memcpy( pValue, pAttr->pValue, CTS_LOCAL_TIME_INFO_LEN );
+        break;
+
+      default:
+        // Should never get here!
+        *pLen = 0;
+        status = ATT_ERR_ATTR_NOT_FOUND;
+        break;
+    }
+  }
+  else
+  {
+    // 128-bit UUID
+    *pLen = 0;
+    status = ATT_ERR_INVALID_HANDLE;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      cts_WriteAttrCB
+ *
+ * @brief   Validate attribute data prior to a write operation
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pAttr - pointer to attribute
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ * @param   method - type of write message
+ *
+ * @return  SUCCESS, blePending or Failure
+ */
+static bStatus_t cts_WriteAttrCB(uint16_t connHandle,
+                                 gattAttribute_t *pAttr,
+                                 uint8_t *pValue, uint16_t len,
+                                 uint16_t offset, uint8_t method)
+{
+  bStatus_t status = SUCCESS;
+
+  if ( pAttr->type.len == ATT_BT_UUID_SIZE )
+  {
+    // 16-bit UUID
+    uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    switch ( uuid )
+    {
+      case CURRENT_TIME_UUID:
+        if ( offset != 0 )
+        {
+          status = ATT_ERR_ATTR_NOT_LONG;
+        }
+        else if ( len != CTS_CURRENT_TIME_LEN )
+        {
+          status = ATT_ERR_INVALID_VALUE_SIZE;
+        }
+        else if ( !cts_ValidTime( pValue ) )
+        {
+          status = CTS_ERR_DATA_FIELD_IGNORED;
+        }
+        else if ( cts_AppCBs && cts_AppCBs->pfnCtsTimeWrite )
+        {
+          // The application sets the clock and then the Current Time
+          cts_AppCBs->pfnCtsTimeWrite( connHandle, pValue, len );
+        }
+        break;
+
+      case LOCAL_TIME_INFO_UUID:
+        if ( offset != 0 )
+        {
+          status = ATT_ERR_ATTR_NOT_LONG;
+        }
+        else if ( len != CTS_LOCAL_TIME_INFO_LEN )
+        {
+          status = ATT_ERR_INVALID_VALUE_SIZE;
+        }
+        else if ( ( (int8)pValue[0] < -48 || (int8)pValue[0] > 56 ) &&
+                  (int8)pValue[0] != CTS_TIME_ZONE_UNKNOWN )
+        {
+          status = CTS_ERR_DATA_FIELD_IGNORED;
+        }
+        else if ( pValue[1] != 0 && pValue[1] != 2 && pValue[1] != 4 &&
+                  pValue[1] != 8 && pValue[1] != CTS_DST_UNKNOWN )
+        {
+          status = CTS_ERR_DATA_FIELD_IGNORED;
+        }
+        else
+        {
+          VOID memcpy( pAttr->pValue, pValue, CTS_LOCAL_TIME_INFO_LEN );
+        }
+        break;
+
+      case GATT_CLIENT_CHAR_CFG_UUID:
+        status = GATTServApp_ProcessCCCWriteReq( connHandle, pAttr, pValue, len,
+                                                 offset, GATT_CLIENT_CFG_NOTIFY );
+        break;
+
+      default:
+        // Should never get here!
+        status = ATT_ERR_ATTR_NOT_FOUND;
+        break;
+    }
+  }
+  else
+  {
+    // 128-bit UUID
+    status = ATT_ERR_INVALID_HANDLE;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+*********************************************************************/
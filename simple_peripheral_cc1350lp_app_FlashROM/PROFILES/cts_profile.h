@@ -0,0 +1,120 @@
+/******************************************************************************
+
+ @file  cts_profile.h
+
+ @brief This file contains the Current Time Service (0x1805) definitions
+        and prototypes. A central sets the clock by writing the standard
+        Current Time characteristic instead of a custom string.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+#ifndef CTSPROFILE_H
+#define CTSPROFILE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Profile Parameters
+#define CTS_CURRENT_TIME                      0  // RW 10 bytes - Current Time
+#define CTS_LOCAL_TIME_INFO                   1  // RW 2 bytes - Local Time Information
+
+// Current Time Service bit fields
+#define CTS_SERVICE                           0x00000001
+
+// Current Time: [year lo][year hi][month][day][hours][minutes][seconds]
+// [day of week, 1 = Monday][fractions 1/256 s][adjust reason]
+#define CTS_CURRENT_TIME_LEN                  10
+
+// Local Time Information: [time zone, 15 min units][DST offset]
+#define CTS_LOCAL_TIME_INFO_LEN               2
+
+// Current Time adjust reason bits
+#define CTS_ADJUST_MANUAL                     0x01
+#define CTS_ADJUST_EXTERNAL_REF               0x02
+#define CTS_ADJUST_TIME_ZONE                  0x04
+#define CTS_ADJUST_DST                        0x08
+
+// Application error: the value was valid but could not be applied
+#define CTS_ERR_DATA_FIELD_IGNORED            0x80
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+// Callback when a client has written the Current Time. Called from the
+// stack context, so pValue (CTS_CURRENT_TIME_LEN bytes) must be copied.
+typedef void (*ctsTimeWrite_t)( uint16 connHandle, uint8 *pValue, uint16 len );
+
+typedef struct
+{
+  ctsTimeWrite_t               pfnCtsTimeWrite;  // Called when the Current Time is written
+} ctsCBs_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*
+ * Cts_AddService - Initializes the Current Time Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ */
+extern bStatus_t Cts_AddService( uint32 services );
+
+/*
+ * Cts_RegisterAppCBs - Registers the application callback function.
+ *                    Only call this function once.
+ *
+ *    appCallbacks - pointer to application callbacks.
+ */
+extern bStatus_t Cts_RegisterAppCBs( ctsCBs_t *appCallbacks );
+
+/*
+ * Cts_SetParameter - Set a Current Time Service parameter. Setting the
+ *          Current Time notifies subscribed clients; the time then keeps
+ *          running from the Seconds clock.
+ *
+ *    param - Profile parameter ID
+ *    len - length of data to write
+ *    value - pointer to data to write
+ */
+extern bStatus_t Cts_SetParameter( uint8 param, uint8 len, void *value );
+
+/*
+ * Cts_GetParameter - Get a Current Time Service parameter.
+ *
+ *    param - Profile parameter ID
+ *    value - pointer to data to read
+ */
+extern bStatus_t Cts_GetParameter( uint8 param, void *value );
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTSPROFILE_H */
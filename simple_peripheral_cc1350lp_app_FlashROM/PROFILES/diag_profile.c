@@ -0,0 +1,363 @@
+/******************************************************************************
+
+ @file  diag_profile.c
+
+ @brief This file contains the Diagnostics GATT profile. The counters
+        characteristic holds the last snapshot set by the application;
+        it is readable, including with long reads, and notified to the
+        clients that enabled notifications whenever it is set.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+
+#include "bcomdef.h"
+#include "osal.h"
+#include "linkdb.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gattservapp.h"
+
+#include "diag_profile.h"
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define SERVAPP_NUM_ATTR_SUPPORTED        5
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Diagnostics Service UUID: 0xFFA0
+CONST uint8 diagServUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(DIAG_SERV_UUID), HI_UINT16(DIAG_SERV_UUID)
+};
+
+// Counters UUID: 0xFFA1
+CONST uint8 diagCountersUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(DIAG_COUNTERS_UUID), HI_UINT16(DIAG_COUNTERS_UUID)
+};
+
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+/*********************************************************************
+ * EXTERNAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+
+// Diagnostics Service attribute
+static CONST gattAttrType_t diagService = { ATT_BT_UUID_SIZE, diagServUUID };
+
+
+// Counters Characteristic Properties
+static uint8 diagCountersProps = GATT_PROP_READ | GATT_PROP_NOTIFY;
+
+// Counters Characteristic Value, empty until the application sets it
+static uint8 diagCounters[DIAG_MAX_LEN];
+static uint8 diagCountersLen = 0;
+
+// Counters Characteristic Configuration, one per client
+static gattCharCfg_t *diagCountersConfig;
+
+// Counters Characteristic User Description
+static uint8 diagCountersUserDesp[12] = "Diagnostics";
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+
+static gattAttribute_t diagAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
+{
+  // Diagnostics Service
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&diagService                     /* pValue */
+  },
+
+    // Counters Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &diagCountersProps
+    },
+
+      // Counters Value
+      {
+        { ATT_BT_UUID_SIZE, diagCountersUUID },
+        GATT_PERMIT_READ,
+        0,
+        diagCounters
+      },
+
+      // Counters configuration
+      {
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        (uint8 *)&diagCountersConfig
+      },
+
+      // Counters User Description
+      {
+        { ATT_BT_UUID_SIZE, charUserDescUUID },
+        GATT_PERMIT_READ,
+        0,
+        diagCountersUserDesp
+      },
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t diag_ReadAttrCB(uint16_t connHandle,
+                                 gattAttribute_t *pAttr,
+                                 uint8_t *pValue, uint16_t *pLen,
+                                 uint16_t offset, uint16_t maxLen,
+                                 uint8_t method);
+static bStatus_t diag_WriteAttrCB(uint16_t connHandle,
+                                  gattAttribute_t *pAttr,
+                                  uint8_t *pValue, uint16_t len,
+                                  uint16_t offset, uint8_t method);
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+
+// Diagnostics Service Callbacks
+CONST gattServiceCBs_t diagCBs =
+{
+  diag_ReadAttrCB,  // Read callback function pointer
+  diag_WriteAttrCB, // Write callback function pointer
+  NULL              // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Diag_AddService
+ *
+ * @brief   Initializes the Diagnostics service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t Diag_AddService( uint32 services )
+{
+  uint8 status;
+
+  // Allocate Client Characteristic Configuration table
+  diagCountersConfig = (gattCharCfg_t *)ICall_malloc( sizeof(gattCharCfg_t) *
+                                                      linkDBNumConns );
+  if ( diagCountersConfig == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  // Initialize Client Characteristic Configuration attributes
+  GATTServApp_InitCharCfg( INVALID_CONNHANDLE, diagCountersConfig );
+
+  if ( services & DIAG_SERVICE )
+  {
+    // Register GATT attribute list and CBs with GATT Server App
+    status = GATTServApp_RegisterService( diagAttrTbl,
+                                          GATT_NUM_ATTRS( diagAttrTbl ),
+                                          GATT_MAX_ENCRYPT_KEY_SIZE,
+                                          &diagCBs );
+  }
+  else
+  {
+    status = SUCCESS;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      Diag_SetParameter
+ *
+ * @brief   Set a Diagnostics Profile parameter.
+ *
+ * @param   param - Profile parameter ID
+ * @param   len - length of data to write
+ * @param   value - pointer to data to write.
+ *
+ * @return  bStatus_t
+ */
+bStatus_t Diag_SetParameter( uint8 param, uint8 len, void *value )
+{
+  bStatus_t ret = SUCCESS;
+
+  switch ( param )
+  {
+    case DIAG_COUNTERS:
+      if ( len > 0 && len <= DIAG_MAX_LEN )
+      {
+        VOID memcpy( diagCounters, value, len );
+        diagCountersLen = len;
+
+        // See if Notification has been enabled
+        GATTServApp_ProcessCharCfg( diagCountersConfig, diagCounters, FALSE,
+                                    diagAttrTbl, GATT_NUM_ATTRS( diagAttrTbl ),
+                                    INVALID_TASK_ID, diag_ReadAttrCB );
+      }
+      else
+      {
+        ret = bleInvalidRange;
+      }
+      break;
+
+    default:
+      ret = INVALIDPARAMETER;
+      break;
+  }
+
+  return ( ret );
+}
+
+/*********************************************************************
+ * @fn          diag_ReadAttrCB
+ *
+ * @brief       Read an attribute. The counters may be read in parts
+ *              with long reads; notifications get the first maxLen
+ *              bytes.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t diag_ReadAttrCB(uint16_t connHandle,
+                                 gattAttribute_t *pAttr,
+                                 uint8_t *pValue, uint16_t *pLen,
+                                 uint16_t offset, uint16_t maxLen,
+                                 uint8_t method)
+{
+  bStatus_t status = SUCCESS;
+
+  if ( pAttr->type.len == ATT_BT_UUID_SIZE )
+  {
+    // 16-bit UUID
+    uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    switch ( uuid )
+    {
+      // No need for "GATT_SERVICE_UUID" or "GATT_CLIENT_CHAR_CFG_UUID" cases;
+      // gattserverapp handles those reads
+
+      case DIAG_COUNTERS_UUID:
+        if ( offset > diagCountersLen )
+        {
+          *pLen = 0;
+          status = ATT_ERR_INVALID_OFFSET;
+        }
+        else
+        {
+          *pLen = MIN( maxLen, diagCountersLen - offset );
+          VOID memcpy( pValue, &diagCounters[offset], *pLen );
+        }
+        break;
+
+      default:
+        // Should never get here!
+        *pLen = 0;
+        status = ATT_ERR_ATTR_NOT_FOUND;
+        break;
+    }
+  }
+  else
+  {
+    // 128-bit UUID
+    *pLen = 0;
+    status = ATT_ERR_INVALID_HANDLE;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      diag_WriteAttrCB
+ *
+ * @brief   Validate attribute data prior to a write operation
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pAttr - pointer to attribute
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ * @param   method - type of write message
+ *
+ * @return  SUCCESS, blePending or Failure
+ */
+static bStatus_t diag_WriteAttrCB(uint16_t connHandle,
+                                  gattAttribute_t *pAttr,
+                                  uint8_t *pValue, uint16_t len,
+                                  uint16_t offset, uint8_t method)
+{
+  bStatus_t status = SUCCESS;
+
+  if ( pAttr->type.len == ATT_BT_UUID_SIZE )
+  {
+    // 16-bit UUID
+    uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    switch ( uuid )
+    {
+      case GATT_CLIENT_CHAR_CFG_UUID:
+        status = GATTServApp_ProcessCCCWriteReq( connHandle, pAttr, pValue, len,
+                                                 offset, GATT_CLIENT_CFG_NOTIFY );
+        break;
+
+      default:
+        // Should never get here! (the counters have no write permission)
+        status = ATT_ERR_ATTR_NOT_FOUND;
+        break;
+    }
+  }
+  else
+  {
+    // 128-bit UUID
+    status = ATT_ERR_INVALID_HANDLE;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+*********************************************************************/
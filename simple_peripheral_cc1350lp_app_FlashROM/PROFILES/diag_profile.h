@@ -0,0 +1,89 @@
+/******************************************************************************
+
+ @file  diag_profile.h
+
+ @brief This file contains the Diagnostics GATT profile definitions and
+        prototypes. The profile exposes a snapshot of the application's
+        resource and latency counters, kept by the application, as one
+        readable and notifiable characteristic.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+#ifndef DIAGPROFILE_H
+#define DIAGPROFILE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Profile Parameters
+#define DIAG_COUNTERS                         0  // RN up to DIAG_MAX_LEN bytes
+
+// Diagnostics Profile Service UUID
+#define DIAG_SERV_UUID                        0xFFA0
+
+// Counters characteristic UUID
+#define DIAG_COUNTERS_UUID                    0xFFA1
+
+// Diagnostics Profile Services bit fields
+#define DIAG_SERVICE                          0x00000001
+
+// Maximum length of the counters value in bytes. Longer than one PDU at
+// the default MTU: notifications carry the first (MTU - 3) bytes and
+// the whole value is read with a long read.
+#define DIAG_MAX_LEN                          64
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*
+ * Diag_AddService - Initializes the Diagnostics GATT Profile service by
+ *          registering GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ */
+extern bStatus_t Diag_AddService( uint32 services );
+
+/*
+ * Diag_SetParameter - Set a Diagnostics Profile parameter. Setting the
+ *          counters notifies subscribed clients.
+ *
+ *    param - Profile parameter ID
+ *    len - length of data to write
+ *    value - pointer to data to write
+ */
+extern bStatus_t Diag_SetParameter( uint8 param, uint8 len, void *value );
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIAGPROFILE_H */
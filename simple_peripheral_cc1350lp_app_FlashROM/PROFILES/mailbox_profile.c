@@ -0,0 +1,417 @@
+/******************************************************************************
+
+ @file  mailbox_profile.c
+
+ @brief This file contains the Mailbox GATT profile. A client writes
+        framed commands, with or without response, to the request
+        characteristic; the application answers on the response
+        characteristic as notifications to that client only. Any number
+        of requests may be outstanding, so commands can be pipelined.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+
+#include "bcomdef.h"
+#include "osal.h"
+#include "linkdb.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gattservapp.h"
+
+#include "mailbox_profile.h"
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define SERVAPP_NUM_ATTR_SUPPORTED        8
+
+// Position of the response value in the attribute table
+#define MAILBOX_RSP_VALUE_POS             5
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Mailbox Service UUID: 0xFFB0
+CONST uint8 mailboxServUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(MAILBOX_SERV_UUID), HI_UINT16(MAILBOX_SERV_UUID)
+};
+
+// Request UUID: 0xFFB1
+CONST uint8 mailboxReqUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(MAILBOX_REQ_UUID), HI_UINT16(MAILBOX_REQ_UUID)
+};
+
+// Response UUID: 0xFFB2
+CONST uint8 mailboxRspUUID[ATT_BT_UUID_SIZE] =
+{
+  LO_UINT16(MAILBOX_RSP_UUID), HI_UINT16(MAILBOX_RSP_UUID)
+};
+
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+/*********************************************************************
+ * EXTERNAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+static mailboxCBs_t *mailbox_AppCBs = NULL;
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+
+// Mailbox Service attribute
+static CONST gattAttrType_t mailboxService = { ATT_BT_UUID_SIZE, mailboxServUUID };
+
+
+// Request Characteristic Properties
+static uint8 mailboxReqProps = GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP;
+
+// Request Characteristic Value; requests are passed on, not stored
+static uint8 mailboxReq = 0;
+
+// Request Characteristic User Description
+static uint8 mailboxReqUserDesp[8] = "Request";
+
+
+// Response Characteristic Properties
+static uint8 mailboxRspProps = GATT_PROP_NOTIFY;
+
+// Response Characteristic Value; responses are only notified
+static uint8 mailboxRsp = 0;
+
+// Response Characteristic Configuration, one per client
+static gattCharCfg_t *mailboxRspConfig;
+
+// Response Characteristic User Description
+static uint8 mailboxRspUserDesp[9] = "Response";
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+
+static gattAttribute_t mailboxAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
+{
+  // Mailbox Service
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&mailboxService                  /* pValue */
+  },
+
+    // Request Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &mailboxReqProps
+    },
+
+      // Request Value
+      {
+        { ATT_BT_UUID_SIZE, mailboxReqUUID },
+        GATT_PERMIT_WRITE,
+        0,
+        &mailboxReq
+      },
+
+      // Request User Description
+      {
+        { ATT_BT_UUID_SIZE, charUserDescUUID },
+        GATT_PERMIT_READ,
+        0,
+        mailboxReqUserDesp
+      },
+
+    // Response Declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &mailboxRspProps
+    },
+
+      // Response Value
+      {
+        { ATT_BT_UUID_SIZE, mailboxRspUUID },
+        0,
+        0,
+        &mailboxRsp
+      },
+
+      // Response configuration
+      {
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE,
+        0,
+        (uint8 *)&mailboxRspConfig
+      },
+
+      // Response User Description
+      {
+        { ATT_BT_UUID_SIZE, charUserDescUUID },
+        GATT_PERMIT_READ,
+        0,
+        mailboxRspUserDesp
+      },
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t mailbox_ReadAttrCB(uint16_t connHandle,
+                                    gattAttribute_t *pAttr,
+                                    uint8_t *pValue, uint16_t *pLen,
+                                    uint16_t offset, uint16_t maxLen,
+                                    uint8_t method);
+static bStatus_t mailbox_WriteAttrCB(uint16_t connHandle,
+                                     gattAttribute_t *pAttr,
+                                     uint8_t *pValue, uint16_t len,
+                                     uint16_t offset, uint8_t method);
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+
+// Mailbox Service Callbacks
+CONST gattServiceCBs_t mailboxCBs =
+{
+  mailbox_ReadAttrCB,  // Read callback function pointer
+  mailbox_WriteAttrCB, // Write callback function pointer
+  NULL                 // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Mailbox_AddService
+ *
+ * @brief   Initializes the Mailbox service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t Mailbox_AddService( uint32 services )
+{
+  uint8 status;
+
+  // Allocate Client Characteristic Configuration table
+  mailboxRspConfig = (gattCharCfg_t *)ICall_malloc( sizeof(gattCharCfg_t) *
+                                                    linkDBNumConns );
+  if ( mailboxRspConfig == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  // Initialize Client Characteristic Configuration attributes
+  GATTServApp_InitCharCfg( INVALID_CONNHANDLE, mailboxRspConfig );
+
+  if ( services & MAILBOX_SERVICE )
+  {
+    // Register GATT attribute list and CBs with GATT Server App
+    status = GATTServApp_RegisterService( mailboxAttrTbl,
+                                          GATT_NUM_ATTRS( mailboxAttrTbl ),
+                                          GATT_MAX_ENCRYPT_KEY_SIZE,
+                                          &mailboxCBs );
+  }
+  else
+  {
+    status = SUCCESS;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      Mailbox_RegisterAppCBs
+ *
+ * @brief   Registers the application callback function. Only call
+ *          this function once.
+ *
+ * @param   callbacks - pointer to application callbacks.
+ *
+ * @return  SUCCESS or bleAlreadyInRequestedMode
+ */
+bStatus_t Mailbox_RegisterAppCBs( mailboxCBs_t *appCallbacks )
+{
+  if ( appCallbacks )
+  {
+    mailbox_AppCBs = appCallbacks;
+
+    return ( SUCCESS );
+  }
+  else
+  {
+    return ( bleAlreadyInRequestedMode );
+  }
+}
+
+/*********************************************************************
+ * @fn      Mailbox_Notify
+ *
+ * @brief   Send a response notification to one connection.
+ *
+ * @param   connHandle - connection to notify
+ * @param   pValue - response
+ * @param   len - length of the response
+ *
+ * @return  SUCCESS, bleIncorrectMode if notifications are disabled,
+ *          bleMemAllocError if no buffer is available, or Failure
+ */
+bStatus_t Mailbox_Notify( uint16 connHandle, uint8 *pValue, uint8 len )
+{
+  attHandleValueNoti_t noti;
+  bStatus_t status;
+
+  if ( len == 0 || len > MAILBOX_MAX_LEN )
+  {
+    return ( bleInvalidRange );
+  }
+
+  if ( !( GATTServApp_ReadCharCfg( connHandle, mailboxRspConfig ) &
+          GATT_CLIENT_CFG_NOTIFY ) )
+  {
+    return ( bleIncorrectMode );
+  }
+
+  noti.pValue = (uint8 *)GATT_bm_alloc( connHandle, ATT_HANDLE_VALUE_NOTI,
+                                        len, NULL );
+  if ( noti.pValue == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  noti.handle = mailboxAttrTbl[MAILBOX_RSP_VALUE_POS].handle;
+  noti.len = len;
+  VOID memcpy( noti.pValue, pValue, len );
+
+  status = GATT_Notification( connHandle, &noti, FALSE );
+  if ( status != SUCCESS )
+  {
+    GATT_bm_free( (gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI );
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn          mailbox_ReadAttrCB
+ *
+ * @brief       Read an attribute.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t mailbox_ReadAttrCB(uint16_t connHandle,
+                                    gattAttribute_t *pAttr,
+                                    uint8_t *pValue, uint16_t *pLen,
+                                    uint16_t offset, uint16_t maxLen,
+                                    uint8_t method)
+{
+  // Neither value is readable; the GATT server handles the declarations,
+  // descriptors and configuration.
+  *pLen = 0;
+
+  return ( ATT_ERR_ATTR_NOT_FOUND );
+}
+
+/*********************************************************************
+ * @fn      mailbox_WriteAttrCB
+ *
+ * @brief   Validate attribute data prior to a write operation
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pAttr - pointer to attribute
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ * @param   method - type of write message
+ *
+ * @return  SUCCESS, blePending or Failure
+ */
+static bStatus_t mailbox_WriteAttrCB(uint16_t connHandle,
+                                     gattAttribute_t *pAttr,
+                                     uint8_t *pValue, uint16_t len,
+                                     uint16_t offset, uint8_t method)
+{
+  bStatus_t status = SUCCESS;
+
+  if ( pAttr->type.len == ATT_BT_UUID_SIZE )
+  {
+    // 16-bit UUID
+    uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    switch ( uuid )
+    {
+      case MAILBOX_REQ_UUID:
+        if ( offset != 0 )
+        {
+          status = ATT_ERR_ATTR_NOT_LONG;
+        }
+        else if ( len == 0 || len > MAILBOX_MAX_LEN )
+        {
+          status = ATT_ERR_INVALID_VALUE_SIZE;
+        }
+        else if ( mailbox_AppCBs && mailbox_AppCBs->pfnMailboxRequest )
+        {
+          mailbox_AppCBs->pfnMailboxRequest( connHandle, pValue, len );
+        }
+        break;
+
+      case GATT_CLIENT_CHAR_CFG_UUID:
+        status = GATTServApp_ProcessCCCWriteReq( connHandle, pAttr, pValue, len,
+                                                 offset, GATT_CLIENT_CFG_NOTIFY );
+        break;
+
+      default:
+        // Should never get here! (the response has no write permission)
+        status = ATT_ERR_ATTR_NOT_FOUND;
+        break;
+    }
+  }
+  else
+  {
+    // 128-bit UUID
+    status = ATT_ERR_INVALID_HANDLE;
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+*********************************************************************/
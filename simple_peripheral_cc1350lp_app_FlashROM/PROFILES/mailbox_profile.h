@@ -0,0 +1,103 @@
+/******************************************************************************
+
+ @file  mailbox_profile.h
+
+ @brief This file contains the Mailbox GATT profile definitions and
+        prototypes. The profile carries framed commands from a client in
+        a request characteristic and returns the responses as
+        notifications of a response characteristic.
+
+ Target Device: CC1350
+
+ *****************************************************************************/
+
+#ifndef MAILBOXPROFILE_H
+#define MAILBOXPROFILE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Mailbox Profile Service UUID
+#define MAILBOX_SERV_UUID                     0xFFB0
+
+// Request and Response characteristic UUIDs
+#define MAILBOX_REQ_UUID                      0xFFB1
+#define MAILBOX_RSP_UUID                      0xFFB2
+
+// Mailbox Profile Services bit fields
+#define MAILBOX_SERVICE                       0x00000001
+
+// Maximum length of a request or response in bytes (one PDU at the
+// default MTU)
+#define MAILBOX_MAX_LEN                       20
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+// Callback when a request has been written. Called from the stack
+// context for every write, so pValue must be copied.
+typedef void (*mailboxRequest_t)( uint16 connHandle, uint8 *pValue, uint16 len );
+
+typedef struct
+{
+  mailboxRequest_t             pfnMailboxRequest;  // Called for each request
+} mailboxCBs_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*
+ * Mailbox_AddService - Initializes the Mailbox GATT Profile service by
+ *          registering GATT attributes with the GATT server.
+ *
+ * @param   services - services to add. This is a bit map and can
+ *                     contain more than one service.
+ */
+extern bStatus_t Mailbox_AddService( uint32 services );
+
+/*
+ * Mailbox_RegisterAppCBs - Registers the application callback function.
+ *                    Only call this function once.
+ *
+ *    appCallbacks - pointer to application callbacks.
+ */
+extern bStatus_t Mailbox_RegisterAppCBs( mailboxCBs_t *appCallbacks );
+
+/*
+ * Mailbox_Notify - Send a response to the client of one connection, if
+ *          that client has enabled notifications.
+ *
+ *    connHandle - connection to notify
+ *    pValue - response
+ *    len - length of the response, at most MAILBOX_MAX_LEN
+ */
+extern bStatus_t Mailbox_Notify( uint16 connHandle, uint8 *pValue, uint8 len );
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAILBOXPROFILE_H */
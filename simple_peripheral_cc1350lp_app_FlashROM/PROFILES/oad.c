@@ -655,7 +655,13 @@ void OAD_imgBlockWrite(uint16_t connHandle, uint8_t *pValue)
   if (oadBlkNum == oadBlkTot)
   {
 #if FEATURE_OAD_ONCHIP
-    // Handle CRC verification in BIM.
+    // Let the application save its state, then handle CRC verification in
+    // BIM.
+    if (oadTargetWriteCB != NULL)
+    {
+      (*oadTargetWriteCB)(OAD_IMAGE_RESET, connHandle, NULL);
+    }
+
     OADTarget_systemReset();
 #else // !FEATURE_OAD_ONCHIP
     // Run CRC check on new image.
@@ -686,6 +692,12 @@ void OAD_imgBlockWrite(uint16_t connHandle, uint8_t *pValue)
         // here.
         if (flagRecord & (OAD_IMG_APP_FLAG|OAD_IMG_STACK_FLAG))
         {
+          // Let the application save its state first.
+          if (oadTargetWriteCB != NULL)
+          {
+            (*oadTargetWriteCB)(OAD_IMAGE_RESET, connHandle, NULL);
+          }
+
           OADTarget_systemReset();
         }
 
@@ -86,6 +86,8 @@ extern "C"
 #define OAD_WRITE_IDENTIFY_REQ 0x01
 #define OAD_WRITE_BLOCK_REQ    0x02
 #define OAD_IMAGE_COMPLETE     0x03
+#define OAD_IMAGE_RESET        0x04  // Reset to the new image follows the
+                                     // callback's return
 
 // Default Image A Page
 #if !defined OAD_IMG_A_PAGE
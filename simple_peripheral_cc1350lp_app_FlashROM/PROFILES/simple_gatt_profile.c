@@ -69,12 +69,24 @@
  * CONSTANTS
  */
 
-#define SERVAPP_NUM_ATTR_SUPPORTED        17
+#define SERVAPP_NUM_ATTR_SUPPORTED        24
+
+// Position of the Characteristic 4 value in the attribute table
+#define SIMPLEPROFILE_CHAR4_VALUE_POS     11
 
 /*********************************************************************
  * TYPEDEFS
  */
 
+// Characteristic 6 write reassembly state of one connection
+typedef struct
+{
+  uint16 connHandle;  // Connection the value is written on
+  uint16 expected;    // Value length announced in the header
+  uint16 received;    // Value bytes received so far
+  uint8 *pData;       // Value buffer, allocated while a write is in progress
+} simpleProfileRx_t;
+
 /*********************************************************************
  * GLOBAL VARIABLES
  */
@@ -114,6 +126,18 @@ CONST uint8 simpleProfilechar5UUID[ATT_BT_UUID_SIZE] =
   LO_UINT16(SIMPLEPROFILE_CHAR5_UUID), HI_UINT16(SIMPLEPROFILE_CHAR5_UUID)
 };
 
+// Characteristic 6 UUID: 0xFFF6
+CONST uint8 simpleProfilechar6UUID[ATT_BT_UUID_SIZE] =
+{ 
+  LO_UINT16(SIMPLEPROFILE_CHAR6_UUID), HI_UINT16(SIMPLEPROFILE_CHAR6_UUID)
+};
+
+// Characteristic 7 UUID: 0xFFF7
+CONST uint8 simpleProfilechar7UUID[ATT_BT_UUID_SIZE] =
+{ 
+  LO_UINT16(SIMPLEPROFILE_CHAR7_UUID), HI_UINT16(SIMPLEPROFILE_CHAR7_UUID)
+};
+
 /*********************************************************************
  * EXTERNAL VARIABLES
  */
@@ -128,6 +152,9 @@ CONST uint8 simpleProfilechar5UUID[ATT_BT_UUID_SIZE] =
 
 static simpleProfileCBs_t *simpleProfile_AppCBs = NULL;
 
+// Characteristic 6 write reassembly, one slot per possible connection
+static simpleProfileRx_t *simpleProfileChar6Rx = NULL;
+
 /*********************************************************************
  * Profile Attributes - variables
  */
@@ -157,7 +184,7 @@ static uint8 simpleProfileChar2UserDesp[17] = "Characteristic 2";
 
 
 // Simple Profile Characteristic 3 Properties
-static uint8 simpleProfileChar3Props = GATT_PROP_WRITE;
+static uint8 simpleProfileChar3Props = GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP;
 
 // Characteristic 3 Value
 static uint8 simpleProfileChar3 = 0;
@@ -170,7 +197,8 @@ static uint8 simpleProfileChar3UserDesp[17] = "Set Clock";
 static uint8 simpleProfileChar4Props = GATT_PROP_NOTIFY;
 
 // Characteristic 4 Value
-static uint8 simpleProfileChar4 = 0;
+static uint8 simpleProfileChar4[SIMPLEPROFILE_CHAR4_LEN] = { 0, 0 };
+static uint8 simpleProfileChar4Len = 1;
 
 // Simple Profile Characteristic 4 Configuration Each client has its own
 // instantiation of the Client Characteristic Configuration. Reads of the
@@ -191,6 +219,30 @@ static uint8 simpleProfileChar5[SIMPLEPROFILE_CHAR5_LEN] = { 0, 0, 0, 0, 0 };
 // Simple Profile Characteristic 5 User Description
 static uint8 simpleProfileChar5UserDesp[17] = "Characteristic 5";
 
+
+// Simple Profile Characteristic 6 Properties
+static uint8 simpleProfileChar6Props = GATT_PROP_READ | GATT_PROP_WRITE;
+
+// Characteristic 6 Value, read with Read Blob when longer than one PDU
+static uint8 simpleProfileChar6[SIMPLEPROFILE_CHAR6_MAX_LEN];
+static uint16 simpleProfileChar6Len = 0;
+
+// Simple Profile Characteristic 6 User Description
+static uint8 simpleProfileChar6UserDesp[17] = "Config";
+
+
+// Simple Profile Characteristic 7 Properties
+static uint8 simpleProfileChar7Props = GATT_PROP_READ | GATT_PROP_NOTIFY;
+
+// Characteristic 7 Value
+static uint8 simpleProfileChar7[SIMPLEPROFILE_CHAR7_LEN] = { 0 };
+
+// Simple Profile Characteristic 7 Configuration, one per client
+static gattCharCfg_t *simpleProfileChar7Config;
+
+// Simple Profile Characteristic 7 User Description
+static uint8 simpleProfileChar7UserDesp[17] = "Status";
+
 /*********************************************************************
  * Profile Attributes - Table
  */
@@ -290,7 +342,7 @@ static gattAttribute_t simpleProfileAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
         { ATT_BT_UUID_SIZE, simpleProfilechar4UUID },
         0, 
         0, 
-        &simpleProfileChar4 
+        simpleProfileChar4 
       },
 
       // Characteristic 4 configuration
@@ -332,6 +384,62 @@ static gattAttribute_t simpleProfileAttrTbl[SERVAPP_NUM_ATTR_SUPPORTED] =
         0, 
         simpleProfileChar5UserDesp 
       },
+
+    // Characteristic 6 Declaration
+    { 
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ, 
+      0,
+      &simpleProfileChar6Props 
+    },
+
+      // Characteristic Value 6
+      { 
+        { ATT_BT_UUID_SIZE, simpleProfilechar6UUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE, 
+        0, 
+        simpleProfileChar6 
+      },
+
+      // Characteristic 6 User Description
+      { 
+        { ATT_BT_UUID_SIZE, charUserDescUUID },
+        GATT_PERMIT_READ, 
+        0, 
+        simpleProfileChar6UserDesp 
+      },
+
+    // Characteristic 7 Declaration
+    { 
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ, 
+      0,
+      &simpleProfileChar7Props 
+    },
+
+      // Characteristic Value 7
+      { 
+        { ATT_BT_UUID_SIZE, simpleProfilechar7UUID },
+        GATT_PERMIT_READ, 
+        0, 
+        simpleProfileChar7 
+      },
+
+      // Characteristic 7 configuration
+      { 
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_WRITE, 
+        0, 
+        (uint8 *)&simpleProfileChar7Config 
+      },
+
+      // Characteristic 7 User Description
+      { 
+        { ATT_BT_UUID_SIZE, charUserDescUUID },
+        GATT_PERMIT_READ, 
+        0, 
+        simpleProfileChar7UserDesp 
+      },
 };
 
 /*********************************************************************
@@ -346,6 +454,12 @@ static bStatus_t simpleProfile_WriteAttrCB(uint16_t connHandle,
                                            gattAttribute_t *pAttr,
                                            uint8_t *pValue, uint16_t len,
                                            uint16_t offset, uint8_t method);
+static bStatus_t simpleProfile_WriteChar6(uint16_t connHandle,
+                                          uint8_t *pValue, uint16_t len,
+                                          uint16_t offset);
+static simpleProfileRx_t *simpleProfile_FindRx(uint16_t connHandle,
+                                               uint8_t alloc);
+static void simpleProfile_FreeRx(simpleProfileRx_t *pRx);
 
 /*********************************************************************
  * PROFILE CALLBACKS
@@ -395,6 +509,29 @@ bStatus_t SimpleProfile_AddService( uint32 services )
   
   // Initialize Client Characteristic Configuration attributes
   GATTServApp_InitCharCfg( INVALID_CONNHANDLE, simpleProfileChar4Config );
+
+  simpleProfileChar7Config = (gattCharCfg_t *)ICall_malloc( sizeof(gattCharCfg_t) *
+                                                            linkDBNumConns );
+  if ( simpleProfileChar7Config == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  GATTServApp_InitCharCfg( INVALID_CONNHANDLE, simpleProfileChar7Config );
+
+  // Allocate Characteristic 6 reassembly table
+  simpleProfileChar6Rx = (simpleProfileRx_t *)ICall_malloc( sizeof(simpleProfileRx_t) *
+                                                            linkDBNumConns );
+  if ( simpleProfileChar6Rx == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  VOID memset( simpleProfileChar6Rx, 0, sizeof(simpleProfileRx_t) * linkDBNumConns );
+  for ( uint8 i = 0; i < linkDBNumConns; i++ )
+  {
+    simpleProfileChar6Rx[i].connHandle = INVALID_CONNHANDLE;
+  }
   
   if ( services & SIMPLEPROFILE_SERVICE )
   {
@@ -489,12 +626,13 @@ bStatus_t SimpleProfile_SetParameter( uint8 param, uint8 len, void *value )
       break;
 
     case SIMPLEPROFILE_CHAR4:
-      if ( len == sizeof ( uint8 ) ) 
+      if ( len >= 1 && len <= SIMPLEPROFILE_CHAR4_LEN ) 
       {
-        simpleProfileChar4 = *((uint8*)value);
+        VOID memcpy( simpleProfileChar4, value, len );
+        simpleProfileChar4Len = len;
         
         // See if Notification has been enabled
-        GATTServApp_ProcessCharCfg( simpleProfileChar4Config, &simpleProfileChar4, FALSE,
+        GATTServApp_ProcessCharCfg( simpleProfileChar4Config, simpleProfileChar4, FALSE,
                                     simpleProfileAttrTbl, GATT_NUM_ATTRS( simpleProfileAttrTbl ),
                                     INVALID_TASK_ID, simpleProfile_ReadAttrCB );
       }
@@ -514,6 +652,34 @@ bStatus_t SimpleProfile_SetParameter( uint8 param, uint8 len, void *value )
         ret = bleInvalidRange;
       }
       break;
+
+    case SIMPLEPROFILE_CHAR6:
+      if ( len <= SIMPLEPROFILE_CHAR6_MAX_LEN ) 
+      {
+        VOID memcpy( simpleProfileChar6, value, len );
+        simpleProfileChar6Len = len;
+      }
+      else
+      {
+        ret = bleInvalidRange;
+      }
+      break;
+
+    case SIMPLEPROFILE_CHAR7:
+      if ( len == SIMPLEPROFILE_CHAR7_LEN ) 
+      {
+        VOID memcpy( simpleProfileChar7, value, SIMPLEPROFILE_CHAR7_LEN );
+
+        // See if Notification has been enabled
+        GATTServApp_ProcessCharCfg( simpleProfileChar7Config, simpleProfileChar7, FALSE,
+                                    simpleProfileAttrTbl, GATT_NUM_ATTRS( simpleProfileAttrTbl ),
+                                    INVALID_TASK_ID, simpleProfile_ReadAttrCB );
+      }
+      else
+      {
+        ret = bleInvalidRange;
+      }
+      break;
       
     default:
       ret = INVALIDPARAMETER;
@@ -554,12 +720,20 @@ bStatus_t SimpleProfile_GetParameter( uint8 param, void *value )
       break;  
 
     case SIMPLEPROFILE_CHAR4:
-      *((uint8*)value) = simpleProfileChar4;
+      VOID memcpy( value, simpleProfileChar4, simpleProfileChar4Len );
       break;
 
     case SIMPLEPROFILE_CHAR5:
       VOID memcpy( value, simpleProfileChar5, SIMPLEPROFILE_CHAR5_LEN );
       break;      
+
+    case SIMPLEPROFILE_CHAR6:
+      VOID memcpy( value, simpleProfileChar6, simpleProfileChar6Len );
+      break;
+
+    case SIMPLEPROFILE_CHAR7:
+      VOID memcpy( value, simpleProfileChar7, SIMPLEPROFILE_CHAR7_LEN );
+      break;
       
     default:
       ret = INVALIDPARAMETER;
@@ -569,6 +743,77 @@ bStatus_t SimpleProfile_GetParameter( uint8 param, void *value )
   return ( ret );
 }
 
+/*********************************************************************
+ * @fn      SimpleProfile_NotifyChar4
+ *
+ * @brief   Send a Characteristic 4 notification to one connection only,
+ *          e.g. to acknowledge that client's stream frames. The stored
+ *          Characteristic 4 value is not changed.
+ *
+ * @param   connHandle - connection to notify
+ * @param   len - length of the value
+ * @param   value - pointer to the value
+ *
+ * @return  SUCCESS, bleIncorrectMode if notifications are disabled,
+ *          bleMemAllocError if no buffer is available, or Failure
+ */
+bStatus_t SimpleProfile_NotifyChar4( uint16 connHandle, uint8 len, uint8 *value )
+{
+  attHandleValueNoti_t noti;
+  bStatus_t status;
+
+  if ( len == 0 || len > SIMPLEPROFILE_CHAR4_LEN )
+  {
+    return ( bleInvalidRange );
+  }
+
+  if ( !( GATTServApp_ReadCharCfg( connHandle, simpleProfileChar4Config ) &
+          GATT_CLIENT_CFG_NOTIFY ) )
+  {
+    return ( bleIncorrectMode );
+  }
+
+  noti.pValue = (uint8 *)GATT_bm_alloc( connHandle, ATT_HANDLE_VALUE_NOTI,
+                                        len, NULL );
+  if ( noti.pValue == NULL )
+  {
+    return ( bleMemAllocError );
+  }
+
+  noti.handle = simpleProfileAttrTbl[SIMPLEPROFILE_CHAR4_VALUE_POS].handle;
+  noti.len = len;
+  VOID memcpy( noti.pValue, value, len );
+
+  status = GATT_Notification( connHandle, &noti, FALSE );
+  if ( status != SUCCESS )
+  {
+    GATT_bm_free( (gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI );
+  }
+
+  return ( status );
+}
+
+/*********************************************************************
+ * @fn      SimpleProfile_ReleaseConns
+ *
+ * @brief   Release the Characteristic 6 reassembly buffers of connections
+ *          that are no longer up.
+ *
+ * @return  none
+ */
+void SimpleProfile_ReleaseConns( void )
+{
+  for ( uint8 i = 0; i < linkDBNumConns; i++ )
+  {
+    simpleProfileRx_t *pRx = &simpleProfileChar6Rx[i];
+
+    if ( pRx->connHandle != INVALID_CONNHANDLE && !linkDB_Up( pRx->connHandle ) )
+    {
+      simpleProfile_FreeRx( pRx );
+    }
+  }
+}
+
 /*********************************************************************
  * @fn          simpleProfile_ReadAttrCB
  *
@@ -592,8 +837,8 @@ static bStatus_t simpleProfile_ReadAttrCB(uint16_t connHandle,
 {
   bStatus_t status = SUCCESS;
   
-  // Make sure it's not a blob operation (no attributes in the profile are long)
-  if ( offset > 0 )
+  // Make sure it's not a blob operation (only characteristic 6 is long)
+  if ( offset > 0 && pAttr->pValue != simpleProfileChar6 )
   {
     return ( ATT_ERR_ATTR_NOT_LONG );
   }
@@ -614,15 +859,42 @@ static bStatus_t simpleProfile_ReadAttrCB(uint16_t connHandle,
       //   can be sent as a notification, it is included here
       case SIMPLEPROFILE_CHAR1_UUID:
       case SIMPLEPROFILE_CHAR2_UUID:
-      case SIMPLEPROFILE_CHAR4_UUID:
         *pLen = 1;
         pValue[0] = *pAttr->pValue;
         break;
 
+      case SIMPLEPROFILE_CHAR4_UUID:
+        *pLen = simpleProfileChar4Len;
+        VOID memcpy( pValue, pAttr->pValue, simpleProfileChar4Len );
+        break;
+
       case SIMPLEPROFILE_CHAR5_UUID:
         *pLen = SIMPLEPROFILE_CHAR5_LEN;
         VOID memcpy( pValue, pAttr->pValue, SIMPLEPROFILE_CHAR5_LEN );
         break;
+
+      case SIMPLEPROFILE_CHAR7_UUID:
+        *pLen = SIMPLEPROFILE_CHAR7_LEN;
+        VOID memcpy( pValue, pAttr->pValue, SIMPLEPROFILE_CHAR7_LEN );
+        break;
+
+      case SIMPLEPROFILE_CHAR6_UUID:
+        if ( offset > simpleProfileChar6Len )
+        {
+          *pLen = 0;
+          status = ATT_ERR_INVALID_OFFSET;
+        }
+        else
+        {
+          // Return what fits; the client continues with Read Blob
+          *pLen = simpleProfileChar6Len - offset;
+          if ( *pLen > maxLen )
+          {
+            *pLen = maxLen;
+          }
+          VOID memcpy( pValue, pAttr->pValue + offset, *pLen );
+        }
+        break;
         
       default:
         // Should never get here! (characteristics 3 and 4 do not have read permissions)
@@ -669,9 +941,35 @@ static bStatus_t simpleProfile_WriteAttrCB(uint16_t connHandle,
     uint16 uuid = BUILD_UINT16( pAttr->type.uuid[0], pAttr->type.uuid[1]);
     switch ( uuid )
     {
-      case SIMPLEPROFILE_CHAR1_UUID:
       case SIMPLEPROFILE_CHAR3_UUID:
+        // Writes, with or without response, are passed to the application
+        // together with the connection they came from, so that several
+        // clients can write at the same time. Single bytes are the legacy
+        // protocol, longer writes are stream frames.
+        if ( simpleProfile_AppCBs && simpleProfile_AppCBs->pfnSimpleProfileStream )
+        {
+          if ( offset != 0 )
+          {
+            status = ATT_ERR_ATTR_NOT_LONG;
+          }
+          else if ( len == 0 || len > SIMPLEPROFILE_CHAR3_MAX_LEN )
+          {
+            status = ATT_ERR_INVALID_VALUE_SIZE;
+          }
+          else
+          {
+            if ( len == 1 )
+            {
+              simpleProfileChar3 = pValue[0];
+            }
+
+            simpleProfile_AppCBs->pfnSimpleProfileStream( connHandle, pValue, len );
+          }
+          break;
+        }
+        // Without a stream callback only single byte writes are taken
 
+      case SIMPLEPROFILE_CHAR1_UUID:
         //Validate the value
         // Make sure it's not a blob oper
         if ( offset == 0 )
@@ -704,6 +1002,10 @@ static bStatus_t simpleProfile_WriteAttrCB(uint16_t connHandle,
              
         break;
 
+      case SIMPLEPROFILE_CHAR6_UUID:
+        status = simpleProfile_WriteChar6( connHandle, pValue, len, offset );
+        break;
+
       case GATT_CLIENT_CHAR_CFG_UUID:
         status = GATTServApp_ProcessCCCWriteReq( connHandle, pAttr, pValue, len,
                                                  offset, GATT_CLIENT_CFG_NOTIFY );
@@ -730,5 +1032,147 @@ static bStatus_t simpleProfile_WriteAttrCB(uint16_t connHandle,
   return ( status );
 }
 
+/*********************************************************************
+ * @fn      simpleProfile_WriteChar6
+ *
+ * @brief   Reassemble a Characteristic 6 value. The value is preceded by
+ *          its length so that completion can be detected whether it
+ *          arrives in one Write Request or as the segments of an
+ *          Execute Write. The application is called once the whole
+ *          value has been received.
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ *
+ * @return  SUCCESS or Failure
+ */
+static bStatus_t simpleProfile_WriteChar6(uint16_t connHandle,
+                                          uint8_t *pValue, uint16_t len,
+                                          uint16_t offset)
+{
+  simpleProfileRx_t *pRx = simpleProfile_FindRx( connHandle, offset == 0 );
+
+  if ( pRx == NULL )
+  {
+    return ( offset == 0 ? ATT_ERR_INSUFFICIENT_RESOURCES : ATT_ERR_INVALID_OFFSET );
+  }
+
+  if ( offset == 0 )
+  {
+    // Start of a new value; any unfinished one is discarded
+    if ( len < SIMPLEPROFILE_CHAR6_HDR_LEN )
+    {
+      simpleProfile_FreeRx( pRx );
+      return ( ATT_ERR_INVALID_VALUE_SIZE );
+    }
+
+    pRx->expected = BUILD_UINT16( pValue[0], pValue[1] );
+    pRx->received = 0;
+
+    if ( pRx->expected > SIMPLEPROFILE_CHAR6_MAX_LEN )
+    {
+      simpleProfile_FreeRx( pRx );
+      return ( ATT_ERR_INVALID_VALUE_SIZE );
+    }
+
+    pValue += SIMPLEPROFILE_CHAR6_HDR_LEN;
+    len -= SIMPLEPROFILE_CHAR6_HDR_LEN;
+  }
+  else if ( offset != SIMPLEPROFILE_CHAR6_HDR_LEN + pRx->received )
+  {
+    return ( ATT_ERR_INVALID_OFFSET );
+  }
+
+  if ( pRx->received + len > pRx->expected )
+  {
+    simpleProfile_FreeRx( pRx );
+    return ( ATT_ERR_INVALID_VALUE_SIZE );
+  }
+
+  VOID memcpy( pRx->pData + pRx->received, pValue, len );
+  pRx->received += len;
+
+  if ( pRx->received == pRx->expected )
+  {
+    if ( simpleProfile_AppCBs && simpleProfile_AppCBs->pfnSimpleProfileBlob )
+    {
+      simpleProfile_AppCBs->pfnSimpleProfileBlob( connHandle, pRx->pData,
+                                                  pRx->expected );
+    }
+
+    simpleProfile_FreeRx( pRx );
+  }
+
+  return ( SUCCESS );
+}
+
+/*********************************************************************
+ * @fn      simpleProfile_FindRx
+ *
+ * @brief   Find the Characteristic 6 reassembly slot of a connection.
+ *
+ * @param   connHandle - connection handle
+ * @param   alloc - TRUE to claim a free slot and buffer if none is found
+ *
+ * @return  Pointer to the slot, or NULL if not found or out of memory
+ */
+static simpleProfileRx_t *simpleProfile_FindRx(uint16_t connHandle,
+                                               uint8_t alloc)
+{
+  simpleProfileRx_t *pFree = NULL;
+
+  for ( uint8 i = 0; i < linkDBNumConns; i++ )
+  {
+    simpleProfileRx_t *pRx = &simpleProfileChar6Rx[i];
+
+    if ( pRx->connHandle == connHandle )
+    {
+      return ( pRx );
+    }
+
+    if ( pFree == NULL && pRx->connHandle == INVALID_CONNHANDLE )
+    {
+      pFree = pRx;
+    }
+  }
+
+  if ( alloc && pFree != NULL )
+  {
+    pFree->pData = (uint8 *)ICall_malloc( SIMPLEPROFILE_CHAR6_MAX_LEN );
+    if ( pFree->pData != NULL )
+    {
+      pFree->connHandle = connHandle;
+      pFree->expected = 0;
+      pFree->received = 0;
+
+      return ( pFree );
+    }
+  }
+
+  return ( NULL );
+}
+
+/*********************************************************************
+ * @fn      simpleProfile_FreeRx
+ *
+ * @brief   Return a Characteristic 6 reassembly slot to the pool.
+ *
+ * @param   pRx - slot to release
+ *
+ * @return  none
+ */
+static void simpleProfile_FreeRx(simpleProfileRx_t *pRx)
+{
+  if ( pRx->pData != NULL )
+  {
+    ICall_free( pRx->pData );
+    pRx->pData = NULL;
+  }
+
+  pRx->connHandle = INVALID_CONNHANDLE;
+}
+
 /*********************************************************************
 *********************************************************************/
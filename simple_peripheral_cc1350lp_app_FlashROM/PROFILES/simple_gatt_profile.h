@@ -65,8 +65,10 @@ extern "C"
 #define SIMPLEPROFILE_CHAR1                   0  // RW uint8 - Profile Characteristic 1 value 
 #define SIMPLEPROFILE_CHAR2                   1  // RW uint8 - Profile Characteristic 2 value
 #define SIMPLEPROFILE_CHAR3                   2  // RW uint8 - Profile Characteristic 3 value
-#define SIMPLEPROFILE_CHAR4                   3  // RW uint8 - Profile Characteristic 4 value
+#define SIMPLEPROFILE_CHAR4                   3  // RW 1-2 bytes - Profile Characteristic 4 value
 #define SIMPLEPROFILE_CHAR5                   4  // RW uint8 - Profile Characteristic 4 value
+#define SIMPLEPROFILE_CHAR6                   5  // RW variable - Profile Characteristic 6 value
+#define SIMPLEPROFILE_CHAR7                   6  // R 8 bytes - Clock status
   
 // Simple Profile Service UUID
 #define SIMPLEPROFILE_SERV_UUID               0xFFF0
@@ -77,13 +79,34 @@ extern "C"
 #define SIMPLEPROFILE_CHAR3_UUID            0xFFF3
 #define SIMPLEPROFILE_CHAR4_UUID            0xFFF4
 #define SIMPLEPROFILE_CHAR5_UUID            0xFFF5
+#define SIMPLEPROFILE_CHAR6_UUID            0xFFF6
+#define SIMPLEPROFILE_CHAR7_UUID            0xFFF7
   
 // Simple Keys Profile Services bit fields
 #define SIMPLEPROFILE_SERVICE               0x00000001
 
+// Maximum length of a Characteristic 3 write in bytes (one PDU at the
+// default MTU). Single byte writes are the legacy byte-by-byte protocol;
+// longer writes are stream frames: a sequence number followed by data.
+#define SIMPLEPROFILE_CHAR3_MAX_LEN       20
+
+// Maximum length of Characteristic 4 in bytes. Stream acknowledgements
+// are two bytes: the last sequence number accepted and the credits left.
+#define SIMPLEPROFILE_CHAR4_LEN           2
+
 // Length of Characteristic 5 in bytes
 #define SIMPLEPROFILE_CHAR5_LEN           5  
 
+// Maximum length of the Characteristic 6 value in bytes. Writes carry a
+// SIMPLEPROFILE_CHAR6_HDR_LEN byte little-endian length ahead of the value
+// and may be split over several Prepare Write requests.
+#define SIMPLEPROFILE_CHAR6_MAX_LEN       200
+#define SIMPLEPROFILE_CHAR6_HDR_LEN       2
+
+// Length of Characteristic 7 in bytes. The clock status is notified to
+// subscribed clients each time it is set.
+#define SIMPLEPROFILE_CHAR7_LEN           8
+
 /*********************************************************************
  * TYPEDEFS
  */
@@ -100,9 +123,18 @@ extern "C"
 // Callback when a characteristic value has changed
 typedef void (*simpleProfileChange_t)( uint8 paramID );
 
+// Callback when a complete Characteristic 6 value has been written
+typedef void (*simpleProfileBlob_t)( uint16 connHandle, uint8 *pValue, uint16 len );
+
+// Callback when Characteristic 3 has been written: a single legacy byte
+// or a stream frame. Replaces the change callback for Characteristic 3.
+typedef void (*simpleProfileStream_t)( uint16 connHandle, uint8 *pValue, uint16 len );
+
 typedef struct
 {
   simpleProfileChange_t        pfnSimpleProfileChange;  // Called when characteristic value changes
+  simpleProfileBlob_t          pfnSimpleProfileBlob;    // Called when a Characteristic 6 write completes
+  simpleProfileStream_t        pfnSimpleProfileStream;  // Called for each Characteristic 3 write
 } simpleProfileCBs_t;
 
     
@@ -153,6 +185,22 @@ extern bStatus_t SimpleProfile_SetParameter( uint8 param, uint8 len, void *value
  */
 extern bStatus_t SimpleProfile_GetParameter( uint8 param, void *value );
 
+/*
+ * SimpleProfile_NotifyChar4 - Send a Characteristic 4 notification to a
+ *          single connection, if that client has enabled notifications.
+ *
+ *    connHandle - connection to notify
+ *    len - length of the value, at most SIMPLEPROFILE_CHAR4_LEN
+ *    value - pointer to the value
+ */
+extern bStatus_t SimpleProfile_NotifyChar4( uint16 connHandle, uint8 len, uint8 *value );
+
+/*
+ * SimpleProfile_ReleaseConns - Release the write reassembly buffers of
+ *          connections that are no longer up. Call after a disconnect.
+ */
+extern void SimpleProfile_ReleaseConns( void );
+
 
 /*********************************************************************
 *********************************************************************/
@@ -0,0 +1,75 @@
+/******************************************************************************
+
+ @file  clock_status_test.c
+
+ @brief Host test of the clock status encoding, pinning known dates to
+        the bytes the clock advertises.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "clock_status.h"
+
+static int failures = 0;
+
+static void checkMinutes(int year, int yday, int hour, int min,
+                         uint32_t expected)
+{
+  struct tm local;
+  uint32_t minutes;
+
+  memset(&local, 0, sizeof(local));
+  local.tm_year = year - 1900;
+  local.tm_yday = yday;
+  local.tm_hour = hour;
+  local.tm_min = min;
+
+  minutes = ClockStatus_epochMinutes(&local);
+  if (minutes != expected)
+  {
+    printf("FAIL %d day %d %02d:%02d: %lu minutes, expected %lu\n",
+           year, yday, hour, min, (unsigned long)minutes,
+           (unsigned long)expected);
+    failures++;
+  }
+}
+
+int main(void)
+{
+  static const uint8_t expected[CLOCK_STATUS_LEN] =
+  {
+    0x09, 0xDE, 0xB2, 0x01,   // 28499465 minutes
+    0x86, 0x01,               // 06:30
+    0x03                      // time set, alarm armed
+  };
+  struct tm local;
+  uint8_t status[CLOCK_STATUS_LEN];
+
+  checkMinutes(1970, 0, 0, 0, 0);
+  checkMinutes(1969, 364, 23, 59, 0);
+  checkMinutes(2000, 60, 0, 0, 15864480);    // 1 March 2000, a leap year
+  checkMinutes(2100, 59, 0, 0, 68459040);    // 1 March 2100, not one
+  checkMinutes(2024, 68, 7, 5, 28499465);
+
+  // 9 March 2024 07:05, alarm at 06:30, as advertised
+  memset(&local, 0, sizeof(local));
+  local.tm_year = 2024 - 1900;
+  local.tm_mon = 2;
+  local.tm_mday = 9;
+  local.tm_yday = 68;
+  local.tm_hour = 7;
+  local.tm_min = 5;
+  ClockStatus_build(status, ClockStatus_epochMinutes(&local), 6 * 60 + 30,
+                    0x03);
+  if (memcmp(status, expected, sizeof(status)) != 0)
+  {
+    printf("FAIL status of 2024-03-09 07:05\n");
+    failures++;
+  }
+
+  printf("clock_status_test: %s\n", failures ? "FAILED" : "passed");
+
+  return (failures ? 1 : 0);
+}